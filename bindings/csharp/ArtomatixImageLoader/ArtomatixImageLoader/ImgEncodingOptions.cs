@@ -35,4 +35,39 @@ namespace Artomatix.ImageLoader.ImgEncodingOptions
             _type = (Int32)AImgFileFormat.PNG_IMAGE_FORMAT;
         }
     }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct JpegEncodingOptions : FormatEncodeOptions
+    {
+        private Int32 _type;
+        private Int32 _quality;
+        private Subsampling _subsampling;
+        private Int32 _progressive;
+        private Int32 _optimizeCoding;
+        private Int32 _restartInterval;
+
+        public Int32 type { get { return _type; } }
+        public Int32 quality { get { return _quality; } }
+        public Subsampling subsampling { get { return _subsampling; } }
+        public bool progressive { get { return _progressive != 0; } }
+        public bool optimizeCoding { get { return _optimizeCoding != 0; } }
+        public Int32 restartInterval { get { return _restartInterval; } }
+
+        public enum Subsampling : int
+        {
+            JPEG_SUBSAMPLING_444 = 0,
+            JPEG_SUBSAMPLING_422 = 1,
+            JPEG_SUBSAMPLING_420 = 2
+        }
+
+        public JpegEncodingOptions(Int32 quality, Subsampling subsampling, bool progressive, bool optimizeCoding, Int32 restartInterval)
+        {
+            _quality = quality;
+            _subsampling = subsampling;
+            _progressive = progressive ? 1 : 0;
+            _optimizeCoding = optimizeCoding ? 1 : 0;
+            _restartInterval = restartInterval;
+            _type = (Int32)AImgFileFormat.JPEG_IMAGE_FORMAT;
+        }
+    }
 }
\ No newline at end of file
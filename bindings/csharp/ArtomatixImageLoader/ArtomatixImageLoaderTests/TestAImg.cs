@@ -187,6 +187,32 @@ namespace ArtomatixImageLoaderTests
             }
         }
 
+        [Test]
+        public static void TestWriteJpegWithOptions()
+        {
+            using (AImg img = new AImg(File.Open(getImagesDir() + "/jpeg/test.jpeg", FileMode.Open)))
+            {
+                byte[] data = new byte[img.width * img.height * img.decodedImgFormat.numChannels() * img.decodedImgFormat.bytesPerChannel()];
+                img.decodeImage(data);
+
+                using (var writeStream = new MemoryStream())
+                {
+                    var wImg = new AImg(AImgFileFormat.JPEG_IMAGE_FORMAT);
+
+                    JpegEncodingOptions options = new JpegEncodingOptions(85, JpegEncodingOptions.Subsampling.JPEG_SUBSAMPLING_420, true, true, 0);
+
+                    wImg.writeImage(data, img.width, img.height, img.decodedImgFormat, img.colourProfileName, img.colourProfile, writeStream, options);
+                    writeStream.Seek(0, SeekOrigin.Begin);
+
+                    using (AImg img2 = new AImg(writeStream))
+                    {
+                        Assert.AreEqual(img.width, img2.width);
+                        Assert.AreEqual(img.height, img2.height);
+                    }
+                }
+            }
+        }
+
         [Test]
         public static void TestWrite32BitToPng()
         {
@@ -20,4 +20,25 @@ class PngEncodingOptions(ctypes.Structure):
         self.type = enums.AImgFileFormats['PNG_IMAGE_FORMAT'].val
         self.compressionLevel = compressionLevel
         self.filter = filter
-        
+
+class JpegEncodingOptions(ctypes.Structure):
+    JPEG_SUBSAMPLING_444 = 0
+    JPEG_SUBSAMPLING_422 = 1
+    JPEG_SUBSAMPLING_420 = 2
+
+    _fields_ = [
+        ('type', ctypes.c_int),
+        ('quality', ctypes.c_int),
+        ('subsampling', ctypes.c_int),
+        ('progressive', ctypes.c_int),
+        ('optimizeCoding', ctypes.c_int),
+        ('restartInterval', ctypes.c_int)
+    ]
+
+    def __init__(self, quality, subsampling, progressive, optimizeCoding, restartInterval):
+        self.type = enums.AImgFileFormats['JPEG_IMAGE_FORMAT'].val
+        self.quality = quality
+        self.subsampling = subsampling
+        self.progressive = int(progressive)
+        self.optimizeCoding = int(optimizeCoding)
+        self.restartInterval = restartInterval
@@ -122,6 +122,21 @@ class TestAImg(unittest.TestCase):
                     self.assertEqual(decoded2[y][x][c], decoded[y][x][c])
 
 
+    def test_write_jpeg_options(self):
+        img = AImg.AImg(imagesDir + "/jpeg/test.jpeg")
+        decoded = img.decode()
+
+        outFile = io.BytesIO()
+
+        options = AImg.JpegEncodingOptions(85, AImg.JpegEncodingOptions.JPEG_SUBSAMPLING_420, True, True, 0)
+        AImg.write(outFile, decoded, AImg.AImgFileFormats["JPEG_IMAGE_FORMAT"], img.profileName, img.colourProfile, encodeOptions=options)
+
+        outFile.seek(0)
+        img2 = AImg.AImg(outFile)
+
+        self.assertEqual(img2.width, img.width)
+        self.assertEqual(img2.height, img.height)
+
     def test_icc_png(self):
         # Read image with colour profile
         img = AImg.AImg(imagesDir + "/png/ICC.png")
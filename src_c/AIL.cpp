@@ -1,8 +1,23 @@
-#include <map>
+#include <mutex>
+#include <atomic>
 #include <vector>
 #include <iostream>
 #include <algorithm>
 #include <cstring>
+#include <limits>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #include "AIL.h"
 #include "AIL_internal.h"
@@ -13,530 +28,460 @@
 #include "tga.h"
 #include "tiff.h"
 #include "hdr.h"
+#include "convert.h"
+#include "probe.h"
+#include "readbuffer.h"
+#include "scratch.h"
+#include "stats.h"
+#include "trace.h"
+
+// Built once by AImgInitialise and never changed after that, so lookups don't need to lock anything
+struct LoaderRegistry
+{
+    // indexed by AImgFileFormat, NULL for formats that weren't compiled in
+    AImg::ImageLoaderBase* loaders[AImg::NUM_FILE_FORMATS] = {};
+    int32_t initialiseError = AImgErrorCode::AIMG_SUCCESS;
 
-#ifdef HAVE_EXR
-#include <half.h>
-#endif
+    ~LoaderRegistry()
+    {
+        for (int32_t i = 0; i < AImg::NUM_FILE_FORMATS; i++)
+            delete loaders[i];
+    }
+};
+
+std::mutex registryMutex; // only taken by AImgInitialise and AImgCleanUp
+std::atomic<LoaderRegistry*> registry(nullptr);
+
+AImg::ImageLoaderBase* getLoader(int32_t fileFormat)
+{
+    LoaderRegistry* currentRegistry = registry.load(std::memory_order_acquire);
 
-std::map<int32_t, AImg::ImageLoaderBase*> loaders;
+    if (currentRegistry == nullptr || fileFormat < 0 || fileFormat >= AImg::NUM_FILE_FORMATS)
+        return NULL;
+
+    return currentRegistry->loaders[fileFormat];
+}
 
 int32_t AImgInitialise()
 {
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    // calling it again is harmless, and reports how the first call went
+    if (registry.load() != nullptr)
+        return registry.load()->initialiseError;
+
+    LoaderRegistry* newRegistry = new LoaderRegistry();
+
 #ifdef HAVE_EXR
-    loaders[AImgFileFormat::EXR_IMAGE_FORMAT] = new AImg::ExrImageLoader();
+    newRegistry->loaders[AImgFileFormat::EXR_IMAGE_FORMAT] = new AImg::ExrImageLoader();
 #endif
 
 #ifdef HAVE_PNG
-    loaders[AImgFileFormat::PNG_IMAGE_FORMAT] = new AImg::PNGImageLoader();
+    newRegistry->loaders[AImgFileFormat::PNG_IMAGE_FORMAT] = new AImg::PNGImageLoader();
 #endif
 
 #ifdef HAVE_JPEG
-    loaders[AImgFileFormat::JPEG_IMAGE_FORMAT] = new AImg::JPEGImageLoader();
+    newRegistry->loaders[AImgFileFormat::JPEG_IMAGE_FORMAT] = new AImg::JPEGImageLoader();
 #endif
 
 #ifdef HAVE_TGA
-    loaders[AImgFileFormat::TGA_IMAGE_FORMAT] = new AImg::TGAImageLoader();
+    newRegistry->loaders[AImgFileFormat::TGA_IMAGE_FORMAT] = new AImg::TGAImageLoader();
 #endif
 
 #ifdef HAVE_TIFF
-    loaders[AImgFileFormat::TIFF_IMAGE_FORMAT] = new AImg::TIFFImageLoader();
+    newRegistry->loaders[AImgFileFormat::TIFF_IMAGE_FORMAT] = new AImg::TIFFImageLoader();
 #endif
 
 #ifdef HAVE_HDR
-    loaders[AImgFileFormat::HDR_IMAGE_FORMAT] = new AImg::HDRImageLoader();
+    newRegistry->loaders[AImgFileFormat::HDR_IMAGE_FORMAT] = new AImg::HDRImageLoader();
 #endif
 
-    for (auto it = loaders.begin(); it != loaders.end(); ++it)
+    for (int32_t i = 0; i < AImg::NUM_FILE_FORMATS; i++)
     {
-        int32_t err = it->second->initialise();
+        if (newRegistry->loaders[i] == NULL)
+            continue;
+
+        int32_t err = newRegistry->loaders[i]->initialise();
         if (err != AImgErrorCode::AIMG_SUCCESS)
-            return err;
+        {
+            newRegistry->initialiseError = err;
+            break;
+        }
     }
 
-    return AImgErrorCode::AIMG_SUCCESS;
+    registry.store(newRegistry, std::memory_order_release);
+
+    return newRegistry->initialiseError;
 }
 
 void AImgCleanUp()
 {
-    for (auto it = loaders.begin(); it != loaders.end(); ++it)
-        delete it->second;
+    std::lock_guard<std::mutex> lock(registryMutex);
 
-    loaders.clear();
+    delete registry.exchange(nullptr);
 }
 
 namespace AImg
 {
     AImgBase::~AImgBase() {} // go away c++
     ImageLoaderBase::~ImageLoaderBase() {}
-}
-
-int32_t AImgOpen(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, AImgHandle* imgH, int32_t* detectedFileFormat)
-{
-    *imgH = (AImgHandle*)NULL;
-
-    int32_t startPos = tellCallback(callbackData);
-
-    uint8_t testByte;
-    if (readCallback(callbackData, &testByte, 1) != 1)
-        return AImgErrorCode::AIMG_OPEN_FAILED_EMPTY_INPUT;
 
-    seekCallback(callbackData, startPos);
-
-    int32_t fileFormat = UNKNOWN_IMAGE_FORMAT;
-    int32_t retval = AIMG_UNSUPPORTED_FILETYPE;
-
-    for (auto it = loaders.begin(); it != loaders.end(); ++it)
+    int32_t AImgBase::decodeRows(void* destBuffer, int32_t firstRow, int32_t numRows, size_t destStride, int32_t forceImageFormat)
     {
-        if (it->second->canLoadImage(readCallback, tellCallback, seekCallback, callbackData))
-        {
-            fileFormat = it->second->getAImgFileFormatValue();
+        int32_t width, height, numChannels, bytesPerChannel, floatOrInt, decodedImgFormat;
+        int32_t err = getImageInfo(&width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &decodedImgFormat, NULL);
+        if (err != AImgErrorCode::AIMG_SUCCESS)
+            return err;
 
-            AImg::AImgBase* img = it->second->getAImg();
-            *imgH = img;
+        AIGetFormatDetails(decodedImgFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+        size_t rowSize = (size_t)width * numChannels * bytesPerChannel;
 
-            retval = img->openImage(readCallback, tellCallback, seekCallback, callbackData);
-            break;
+        if (mDecodeRowsCache.empty())
+        {
+            mDecodeRowsCache.resize(rowSize * height);
+
+            err = decodeImage(&mDecodeRowsCache[0], AImgFormat::INVALID_FORMAT);
+            if (err != AImgErrorCode::AIMG_SUCCESS)
+            {
+                mDecodeRowsCache.clear();
+                return err;
+            }
         }
-    }
 
-    if (detectedFileFormat != NULL)
-        *detectedFileFormat = fileFormat;
+        return convertRows(&mDecodeRowsCache[firstRow * rowSize], rowSize, destBuffer, destStride, width, numRows, decodedImgFormat, forceImageFormat);
+    }
 
-    return retval;
-}
+    int32_t AImgBase::decodeRegion(void* destBuffer, int32_t x, int32_t y, int32_t width, int32_t height, size_t destStride, int32_t forceImageFormat)
+    {
+        int32_t imgWidth, imgHeight, numChannels, bytesPerChannel, floatOrInt, decodedImgFormat;
+        int32_t err = getImageInfo(&imgWidth, &imgHeight, &numChannels, &bytesPerChannel, &floatOrInt, &decodedImgFormat, NULL);
+        if (err != AImgErrorCode::AIMG_SUCCESS)
+            return err;
 
-void AImgClose(AImgHandle imgH)
-{
-    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
-    delete img;
-}
+        AIGetFormatDetails(decodedImgFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+        size_t pixelSize = numChannels * bytesPerChannel;
+        size_t rowSize = imgWidth * pixelSize;
 
-EXPORT_FUNC const char* AImgGetErrorDetails(AImgHandle imgH)
-{
-    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
-    return img->getErrorDetails();
-}
+        // rows come out of the decoders full width, so stage a band of them and only convert the part inside the region
+        int32_t bandRows = std::min(getDecodeBandRows(imgWidth, decodedImgFormat), height);
+        ScratchBuffer bandScratch(mScratch, Scratch::REGION);
+        uint8_t* bandBuffer = bandScratch.resize(bandRows * rowSize);
 
-int32_t AImgGetColourProfile(AImgHandle imgH, char *profileName, uint8_t *colourProfile, uint32_t *colourProfileLen)
-{
-    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
-    return img->getColourProfile(profileName, colourProfile, colourProfileLen);
-}
+        for (int32_t row = 0; row < height; row += bandRows)
+        {
+            int32_t rows = std::min(bandRows, height - row);
 
-int32_t AImgGetInfo(AImgHandle imgH, int32_t* width, int32_t* height, int32_t* numChannels, int32_t* bytesPerChannel, int32_t* floatOrInt, int32_t* decodedImgFormat, uint32_t *colourProfileLen)
-{
-    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
-    return img->getImageInfo(width, height, numChannels, bytesPerChannel, floatOrInt, decodedImgFormat, colourProfileLen);
-}
+            err = decodeRows(bandBuffer, y + row, rows, rowSize, decodedImgFormat);
+            if (err != AImgErrorCode::AIMG_SUCCESS)
+                return err;
 
-int32_t AImgDecodeImage(AImgHandle imgH, void* destBuffer, int32_t forceImageFormat)
-{
-    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
-    return img->decodeImage(destBuffer, forceImageFormat);
-}
+            err = convertRows(&bandBuffer[x * pixelSize], rowSize, (uint8_t*)destBuffer + row * destStride, destStride, width, rows, decodedImgFormat, forceImageFormat);
+            if (err != AImgErrorCode::AIMG_SUCCESS)
+                return err;
+        }
 
-AImgHandle AImgGetAImg(int32_t fileFormat)
-{
-    return loaders[fileFormat]->getAImg();
+        return AImgErrorCode::AIMG_SUCCESS;
+    }
 }
 
-int32_t AImgWriteImage(AImgHandle imgH, void* data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat, const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
-    WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, void* encodingOptions)
+int32_t AImgOpen64(ReadCallback64 readCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void* callbackData, AImgHandle* imgH, int32_t* detectedFileFormat)
 {
-    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
-
-    int32_t err = img->verifyEncodeOptions(encodingOptions);
-    if (err != AImgErrorCode::AIMG_SUCCESS)
-        return err;
-
-    return img->writeImage(data, width, height, inputFormat, outputFormat, profileName, colourProfile, colourProfileLen,
-        writeCallback, tellCallback, seekCallback, callbackData, encodingOptions);
+    return AImgOpenWithFlags64(readCallback, tellCallback, seekCallback, callbackData, imgH, detectedFileFormat, AImgOpenFlags::AIMG_OPEN_FLAGS_NONE);
 }
 
-void convertToRGBA32F(void* src, std::vector<float>& dest, size_t i, int32_t inFormat)
+// Picks the loader for a file from its first HEADER_SNIFF_SIZE bytes, NULL if none of them recognise it
+static AImg::ImageLoaderBase* findLoader(const uint8_t* header, int32_t headerSize)
 {
-    switch (inFormat)
-    {
-    case AImgFormat::R8U:
-    {
-        uint8_t* srcF = ((uint8_t*)src) + (i * 1);
-
-        dest[0] = ((float)srcF[0]) / 255.0f;
-        dest[1] = ((float)srcF[0]) / 255.0f;
-        dest[2] = ((float)srcF[0]) / 255.0f;
-        dest[3] = 1;
-
-        break;
-    }
-
-    case AImgFormat::RG8U:
-    {
-        uint8_t* srcF = ((uint8_t*)src) + (i * 2);
-
-        dest[0] = ((float)srcF[0]) / 255.0f;
-        dest[1] = ((float)srcF[1]) / 255.0f;
-        dest[2] = 0;
-        dest[3] = 1;
-
-        break;
-    }
-
-    case AImgFormat::RGB8U:
-    {
-        uint8_t* srcF = ((uint8_t*)src) + (i * 3);
-
-        dest[0] = ((float)srcF[0]) / 255.0f;
-        dest[1] = ((float)srcF[1]) / 255.0f;
-        dest[2] = ((float)srcF[2]) / 255.0f;
-        dest[3] = 1;
-
-        break;
-    }
-
-    case AImgFormat::RGBA8U:
-    {
-        uint8_t* srcF = ((uint8_t*)src) + (i * 4);
-
-        dest[0] = ((float)srcF[0]) / 255.0f;
-        dest[1] = ((float)srcF[1]) / 255.0f;
-        dest[2] = ((float)srcF[2]) / 255.0f;
-        dest[3] = ((float)srcF[3]) / 255.0f;
-
-        break;
-    }
-
-#ifdef HAVE_EXR
-    case AImgFormat::R16F:
-    {
-        half* srcF = ((half*)src) + (i * 1);
-
-        dest[0] = (float)srcF[0];
-        dest[1] = (float)srcF[0];
-        dest[2] = (float)srcF[0];
-        dest[3] = 1;
-
-        break;
-    }
-
-    case AImgFormat::RG16F:
+    // loaders with a real magic number get the first chance, so a heuristic one (TGA) can't claim their files
+    for (int32_t pass = 0; pass < 2; pass++)
     {
-        half* srcF = ((half*)src) + (i * 2);
+        bool magicNumberPass = pass == 0;
 
-        dest[0] = (float)srcF[0];
-        dest[1] = (float)srcF[1];
-        dest[2] = 0;
-        dest[3] = 1;
-
-        break;
-    }
-
-    case AImgFormat::RGB16F:
-    {
-        half* srcF = ((half*)src) + (i * 3);
-
-        dest[0] = (float)srcF[0];
-        dest[1] = (float)srcF[1];
-        dest[2] = (float)srcF[2];
-        dest[3] = 1;
-
-        break;
-    }
-
-    case AImgFormat::RGBA16F:
-    {
-        half* srcF = ((half*)src) + (i * 4);
-
-        dest[0] = (float)srcF[0];
-        dest[1] = (float)srcF[1];
-        dest[2] = (float)srcF[2];
-        dest[3] = (float)srcF[3];
+        for (int32_t i = 0; i < AImg::NUM_FILE_FORMATS; i++)
+        {
+            AImg::ImageLoaderBase* loader = getLoader(i);
 
-        break;
+            if (loader != NULL && loader->hasMagicNumber() == magicNumberPass && loader->canLoadImage(header, headerSize))
+                return loader;
+        }
     }
-#endif
 
-    case AImgFormat::R16U:
-    {
-        uint16_t* srcF = ((uint16_t*)src) + (i * 1);
+    return NULL;
+}
 
-        dest[0] = ((float)srcF[0]) / 65535.0f;
-        dest[1] = ((float)srcF[0]) / 65535.0f;
-        dest[2] = ((float)srcF[0]) / 65535.0f;
-        dest[3] = 1;
+static int32_t openWithFlags64(ReadCallback64 readCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void* callbackData, AImgHandle* imgH, int32_t* detectedFileFormat, int32_t openFlags)
+{
+    *imgH = (AImgHandle*)NULL;
 
-        break;
-    }
+    const uint8_t* inMemoryData = NULL;
+    int64_t inMemorySize = 0;
+    int32_t readBufferSize = AImg::getReadBufferSize();
 
-    case AImgFormat::RG16U:
+    // input that's already in memory gains nothing from a buffer, and would stop being read in place
+    if ((openFlags & AImgOpenFlags::AIMG_OPEN_BUFFERED_READS) && readBufferSize > 0 && !AImg::getInMemoryData(readCallback, callbackData, &inMemoryData, &inMemorySize))
     {
-        uint16_t* srcF = ((uint16_t*)src) + (i * 2);
-
-        dest[0] = ((float)srcF[0]) / 65535.0f;
-        dest[1] = ((float)srcF[1]) / 65535.0f;
-        dest[2] = 0;
-        dest[3] = 1;
-
-        break;
-    }
+        AImg::ReadBuffer* readBuffer = new AImg::ReadBuffer(readCallback, tellCallback, seekCallback, callbackData, readBufferSize);
 
-    case AImgFormat::RGB16U:
-    {
-        uint16_t* srcF = ((uint16_t*)src) + (i * 3);
+        int32_t err = openWithFlags64(&AImg::ReadBuffer::readCallback, &AImg::ReadBuffer::tellCallback, &AImg::ReadBuffer::seekCallback, readBuffer,
+            imgH, detectedFileFormat, openFlags & ~AImgOpenFlags::AIMG_OPEN_BUFFERED_READS);
 
-        dest[0] = ((float)srcF[0]) / 65535.0f;
-        dest[1] = ((float)srcF[1]) / 65535.0f;
-        dest[2] = ((float)srcF[2]) / 65535.0f;
-        dest[3] = 1;
+        // like the 32 bit wrapper, the handle owns the buffer
+        if (*imgH != NULL)
+            ((AImg::AImgBase*)*imgH)->mReadBuffer = readBuffer;
+        else
+            delete readBuffer;
 
-        break;
+        return err;
     }
 
-    case AImgFormat::RGBA16U:
+    AImg::ImageLoaderBase* loader = NULL;
     {
-        uint16_t* srcF = ((uint16_t*)src) + (i * 4);
+        AImg::TraceScope detectTrace(AImg::TRACE_OPEN_DETECT);
 
-        dest[0] = ((float)srcF[0]) / 65535.0f;
-        dest[1] = ((float)srcF[1]) / 65535.0f;
-        dest[2] = ((float)srcF[2]) / 65535.0f;
-        dest[3] = ((float)srcF[3]) / 65535.0f;
+        int64_t startPos = tellCallback(callbackData);
 
-        break;
-    }
+        // every loader detects from the same header, so detection costs one read and one seek however many loaders there are
+        uint8_t header[AImg::HEADER_SNIFF_SIZE];
+        int32_t headerSize = (int32_t)readCallback(callbackData, header, AImg::HEADER_SNIFF_SIZE);
 
-    case AImgFormat::R32F:
-    {
-        float* srcF = ((float*)src) + (i * 1);
+        seekCallback(callbackData, startPos);
 
-        dest[0] = srcF[0];
-        dest[1] = srcF[0];
-        dest[2] = srcF[0];
-        dest[3] = 1;
+        if (headerSize <= 0)
+            return AImgErrorCode::AIMG_OPEN_FAILED_EMPTY_INPUT;
 
-        break;
+        loader = findLoader(header, headerSize);
     }
 
-    case AImgFormat::RG32F:
-    {
-        float* srcF = ((float*)src) + (i * 2);
-
-        dest[0] = srcF[0];
-        dest[1] = srcF[1];
-        dest[2] = 0;
-        dest[3] = 1;
-
-        break;
-    }
+    int32_t fileFormat = UNKNOWN_IMAGE_FORMAT;
+    int32_t retval = AIMG_UNSUPPORTED_FILETYPE;
 
-    case AImgFormat::RGB32F:
+    if (loader != NULL)
     {
-        float* srcF = ((float*)src) + (i * 3);
+        fileFormat = loader->getAImgFileFormatValue();
 
-        dest[0] = srcF[0];
-        dest[1] = srcF[1];
-        dest[2] = srcF[2];
-        dest[3] = 1;
+        AImg::AImgBase* img = loader->getAImg();
+        *imgH = img;
 
-        break;
+        AImg::TraceScope headerTrace(AImg::TRACE_OPEN_HEADER);
+        retval = img->openImage(readCallback, tellCallback, seekCallback, callbackData);
     }
 
-    case AImgFormat::RGBA32F:
-    {
-        float* srcF = ((float*)src) + (i * 4);
-
-        dest[0] = srcF[0];
-        dest[1] = srcF[1];
-        dest[2] = srcF[2];
-        dest[3] = srcF[3];
-
-        break;
-    }
+    if (detectedFileFormat != NULL)
+        *detectedFileFormat = fileFormat;
 
-    default:
-    {
-        break;
-    }
-    }
+    return retval;
 }
 
-void convertFromRGBA32F(std::vector<float>& src, void* dst, size_t i, int32_t outFormat)
+int32_t AImgOpenWithFlags64(ReadCallback64 readCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void* callbackData, AImgHandle* imgH, int32_t* detectedFileFormat, int32_t openFlags)
 {
-    switch (outFormat)
-    {
-    case AImgFormat::R8U:
-    {
-        uint8_t* dstF = ((uint8_t*)dst) + (i * 1);
-
-        dstF[0] = (uint8_t)(src[0] * 255.0f);
-
-        break;
-    }
-
-    case AImgFormat::RG8U:
-    {
-        uint8_t* dstF = ((uint8_t*)dst) + (i * 2);
-
-        dstF[0] = (uint8_t)(src[0] * 255.0f);
-        dstF[1] = (uint8_t)(src[1] * 255.0f);
-
-        break;
-    }
-
-    case AImgFormat::RGB8U:
-    {
-        uint8_t* dstF = ((uint8_t*)dst) + (i * 3);
+    AImg::TraceScope trace(AImg::TRACE_OPEN);
+
+    if (!AImg::isStatsEnabled())
+        return openWithFlags64(readCallback, tellCallback, seekCallback, callbackData, imgH, detectedFileFormat, openFlags);
+
+    // the stats wrap the caller's callbacks directly, so they count what reaches the caller even when reads are buffered
+    AImg::Stats* stats = new AImg::Stats();
+    stats->readCallbacks.readCallback = readCallback;
+    stats->readCallbacks.tellCallback = tellCallback;
+    stats->readCallbacks.seekCallback = seekCallback;
+    stats->readCallbacks.callbackData = callbackData;
+
+    int64_t start = AImg::getStatsTime();
+    int32_t err = openWithFlags64(&AImg::StatsCallbacks::read, &AImg::StatsCallbacks::tell, &AImg::StatsCallbacks::seek, &stats->readCallbacks,
+        imgH, detectedFileFormat, openFlags);
+    stats->counters.codecTime += AImg::getStatsTime() - start - stats->counters.callbackTime;
+
+    // like the read buffer, the handle owns the stats
+    if (*imgH != NULL)
+        ((AImg::AImgBase*)*imgH)->mStats = stats;
+    else
+        delete stats;
+
+    return err;
+}
 
-        dstF[0] = (uint8_t)(src[0] * 255.0f);
-        dstF[1] = (uint8_t)(src[1] * 255.0f);
-        dstF[2] = (uint8_t)(src[2] * 255.0f);
+int32_t AImgProbe64(ReadCallback64 readCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void* callbackData, AImgProbeInfo* info)
+{
+    if (info == NULL)
+        return AImgErrorCode::AIMG_INVALID_ARGS;
 
-        break;
-    }
+    // the parsers read the header through this too, so for most files detecting and probing is a single read
+    AImg::ProbeReader reader(readCallback, tellCallback, seekCallback, callbackData);
 
-    case AImgFormat::RGBA8U:
-    {
-        uint8_t* dstF = ((uint8_t*)dst) + (i * 4);
+    int32_t headerSize = AImg::HEADER_SNIFF_SIZE;
+    const uint8_t* header = reader.getUpTo(0, &headerSize);
 
-        dstF[0] = (uint8_t)(src[0] * 255.0f);
-        dstF[1] = (uint8_t)(src[1] * 255.0f);
-        dstF[2] = (uint8_t)(src[2] * 255.0f);
-        dstF[3] = (uint8_t)(src[3] * 255.0f);
+    if (headerSize <= 0)
+        return AImgErrorCode::AIMG_OPEN_FAILED_EMPTY_INPUT;
 
-        break;
-    }
+    AImg::ImageLoaderBase* loader = findLoader(header, headerSize);
+    if (loader == NULL)
+        return AImgErrorCode::AIMG_UNSUPPORTED_FILETYPE;
 
-#ifdef HAVE_EXR
-    case AImgFormat::R16F:
-    {
-        half* dstF = ((half*)dst) + (i * 1);
+    *info = AImgProbeInfo();
+    info->fileFormat = loader->getAImgFileFormatValue();
 
-        dstF[0] = src[0];
+    return loader->probeImage(reader, info);
+}
 
-        break;
-    }
+void AImgClose(AImgHandle imgH)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    if (img == NULL)
+        return;
 
-    case AImgFormat::RG16F:
-    {
-        half* dstF = ((half*)dst) + (i * 2);
+    // the loader might still use the callbacks while it's being destroyed, so they go last
+    Callbacks32Data* callbacks32 = img->mCallbacks32;
+    AImg::ReadBuffer* readBuffer = img->mReadBuffer;
+    AImg::Stats* stats = img->mStats;
 
-        dstF[0] = src[0];
-        dstF[1] = src[1];
+    delete img;
+    delete readBuffer;
+    delete stats;
+    delete callbacks32;
+}
 
-        break;
-    }
+EXPORT_FUNC const char* AImgGetErrorDetails(AImgHandle imgH)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    return img->getErrorDetails();
+}
 
-    case AImgFormat::RGB16F:
-    {
-        half* dstF = ((half*)dst) + (i * 3);
+int32_t AImgGetColourProfile(AImgHandle imgH, char *profileName, uint8_t *colourProfile, uint32_t *colourProfileLen)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    return img->getColourProfile(profileName, colourProfile, colourProfileLen);
+}
 
-        dstF[0] = src[0];
-        dstF[1] = src[1];
-        dstF[2] = src[2];
+int32_t AImgGetInfo(AImgHandle imgH, int32_t* width, int32_t* height, int32_t* numChannels, int32_t* bytesPerChannel, int32_t* floatOrInt, int32_t* decodedImgFormat, uint32_t *colourProfileLen)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    return img->getImageInfo(width, height, numChannels, bytesPerChannel, floatOrInt, decodedImgFormat, colourProfileLen);
+}
 
-        break;
-    }
+int32_t AImgSetDecodeScale(AImgHandle imgH, int32_t scaleDenom)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    if (img == NULL || (scaleDenom != 1 && scaleDenom != 2 && scaleDenom != 4 && scaleDenom != 8))
+        return AImgErrorCode::AIMG_INVALID_ARGS;
 
-    case AImgFormat::RGBA16F:
-    {
-        half* dstF = ((half*)dst) + (i * 4);
+    return img->setDecodeScale(scaleDenom);
+}
 
-        dstF[0] = src[0];
-        dstF[1] = src[1];
-        dstF[2] = src[2];
-        dstF[3] = src[3];
+int32_t AImgSetDecodingOptions(AImgHandle imgH, void* decodingOptions)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    if (img == NULL)
+        return AImgErrorCode::AIMG_INVALID_ARGS;
 
-        break;
-    }
-#endif
+    return img->setDecodingOptions(decodingOptions);
+}
 
-    case AImgFormat::R16U:
-    {
-        uint16_t* dstF = ((uint16_t*)dst) + (i * 1);
+int32_t AImgDecodeImage(AImgHandle imgH, void* destBuffer, int32_t forceImageFormat)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    AImg::StatsCall statsCall(img);
+    AImg::TraceScope trace(AImg::TRACE_DECODE);
 
-        dstF[0] = (uint16_t)(src[0] * 65535.0f);
+    return img->decodeImage(destBuffer, forceImageFormat);
+}
 
-        break;
-    }
+int32_t AImgDecodeRows(AImgHandle imgH, void* destBuffer, int32_t firstRow, int32_t numRows, int32_t destStride, int32_t forceImageFormat)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    AImg::StatsCall statsCall(img);
+    AImg::TraceScope trace(AImg::TRACE_DECODE_ROWS);
 
-    case AImgFormat::RG16U:
-    {
-        uint16_t* dstF = ((uint16_t*)dst) + (i * 2);
+    int32_t width, height, numChannels, bytesPerChannel, floatOrInt, decodedImgFormat;
+    int32_t err = img->getImageInfo(&width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &decodedImgFormat, NULL);
+    if (err != AImgErrorCode::AIMG_SUCCESS)
+        return err;
 
-        dstF[0] = (uint16_t)(src[0] * 65535.0f);
-        dstF[1] = (uint16_t)(src[1] * 65535.0f);
+    if (forceImageFormat == AImgFormat::INVALID_FORMAT)
+        forceImageFormat = decodedImgFormat;
 
-        break;
-    }
+    AIGetFormatDetails(forceImageFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+    size_t rowSize = (size_t)width * numChannels * bytesPerChannel;
 
-    case AImgFormat::RGB16U:
-    {
-        uint16_t* dstF = ((uint16_t*)dst) + (i * 3);
+    if (numChannels <= 0 || firstRow < 0 || numRows < 0 || firstRow > height - numRows || destStride < 0 || (destStride != 0 && (size_t)destStride < rowSize))
+        return AImgErrorCode::AIMG_INVALID_ARGS;
 
-        dstF[0] = (uint16_t)(src[0] * 65535.0f);
-        dstF[1] = (uint16_t)(src[1] * 65535.0f);
-        dstF[2] = (uint16_t)(src[2] * 65535.0f);
+    if (numRows == 0)
+        return AImgErrorCode::AIMG_SUCCESS;
 
-        break;
-    }
+    return img->decodeRows(destBuffer, firstRow, numRows, destStride == 0 ? rowSize : destStride, forceImageFormat);
+}
 
-    case AImgFormat::RGBA16U:
-    {
-        uint16_t* dstF = ((uint16_t*)dst) + (i * 4);
+int32_t AImgDecodeRegion(AImgHandle imgH, int32_t x, int32_t y, int32_t width, int32_t height, void* destBuffer, int32_t destStride, int32_t forceImageFormat)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    AImg::StatsCall statsCall(img);
+    AImg::TraceScope trace(AImg::TRACE_DECODE_REGION);
 
-        dstF[0] = (uint16_t)(src[0] * 65535.0f);
-        dstF[1] = (uint16_t)(src[1] * 65535.0f);
-        dstF[2] = (uint16_t)(src[2] * 65535.0f);
-        dstF[3] = (uint16_t)(src[3] * 65535.0f);
+    int32_t imgWidth, imgHeight, numChannels, bytesPerChannel, floatOrInt, decodedImgFormat;
+    int32_t err = img->getImageInfo(&imgWidth, &imgHeight, &numChannels, &bytesPerChannel, &floatOrInt, &decodedImgFormat, NULL);
+    if (err != AImgErrorCode::AIMG_SUCCESS)
+        return err;
 
-        break;
-    }
+    if (forceImageFormat == AImgFormat::INVALID_FORMAT)
+        forceImageFormat = decodedImgFormat;
 
-    case AImgFormat::R32F:
-    {
-        float* dstF = ((float*)dst) + (i * 1);
+    AIGetFormatDetails(forceImageFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+    size_t rowSize = (size_t)width * numChannels * bytesPerChannel;
 
-        dstF[0] = src[0];
+    if (numChannels <= 0 || x < 0 || y < 0 || width < 0 || height < 0 || x > imgWidth - width || y > imgHeight - height ||
+        destStride < 0 || (destStride != 0 && (size_t)destStride < rowSize))
+        return AImgErrorCode::AIMG_INVALID_ARGS;
 
-        break;
-    }
+    if (width == 0 || height == 0)
+        return AImgErrorCode::AIMG_SUCCESS;
 
-    case AImgFormat::RG32F:
-    {
-        float* dstF = ((float*)dst) + (i * 2);
+    return img->decodeRegion(destBuffer, x, y, width, height, destStride == 0 ? rowSize : destStride, forceImageFormat);
+}
 
-        dstF[0] = src[0];
-        dstF[1] = src[1];
+AImgHandle AImgGetAImg(int32_t fileFormat)
+{
+    AImg::ImageLoaderBase* loader = getLoader(fileFormat);
+    if (loader == NULL)
+        return NULL;
 
-        break;
-    }
+    AImg::AImgBase* img = loader->getAImg();
+    if (AImg::isStatsEnabled())
+        img->mStats = new AImg::Stats();
 
-    case AImgFormat::RGB32F:
-    {
-        float* dstF = ((float*)dst) + (i * 3);
+    return img;
+}
 
-        dstF[0] = src[0];
-        dstF[1] = src[1];
-        dstF[2] = src[2];
+int32_t AImgWriteImage64(AImgHandle imgH, void* data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat, const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
+    WriteCallback64 writeCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void* callbackData, void* encodingOptions)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    AImg::StatsCall statsCall(img);
+    AImg::TraceScope trace(AImg::TRACE_ENCODE);
 
-        break;
-    }
+    int32_t err = img->verifyEncodeOptions(encodingOptions);
+    if (err != AImgErrorCode::AIMG_SUCCESS)
+        return err;
 
-    case AImgFormat::RGBA32F:
+    // the write callbacks only live for this call, so they're wrapped here rather than kept with the stats
+    AImg::StatsCallbacks statsCallbacks;
+    if (img->mStats != NULL)
     {
-        float* dstF = ((float*)dst) + (i * 4);
-
-        dstF[0] = src[0];
-        dstF[1] = src[1];
-        dstF[2] = src[2];
-        dstF[3] = src[3];
+        statsCallbacks.readCallback = NULL;
+        statsCallbacks.writeCallback = writeCallback;
+        statsCallbacks.tellCallback = tellCallback;
+        statsCallbacks.seekCallback = seekCallback;
+        statsCallbacks.callbackData = callbackData;
+        statsCallbacks.stats = img->mStats;
 
-        break;
+        writeCallback = &AImg::StatsCallbacks::write;
+        tellCallback = &AImg::StatsCallbacks::tell;
+        seekCallback = &AImg::StatsCallbacks::seek;
+        callbackData = &statsCallbacks;
     }
 
-    default:
-    {
-        break;
-    }
-    }
+    return img->writeImage(data, width, height, inputFormat, outputFormat, profileName, colourProfile, colourProfileLen,
+        writeCallback, tellCallback, seekCallback, callbackData, encodingOptions);
 }
 
 int32_t AIGetBitDepth(int32_t format)
@@ -747,58 +692,46 @@ int32_t AImgConvertFormat(void* src, void* dest, int32_t width, int32_t height,
     }
 #endif
 
-    std::vector<float> scratch(4);
-
-    int32_t _, floatOrInt;
-    AIGetFormatDetails(inFormat, &_, &_, &floatOrInt);
-    bool inIsFloat = floatOrInt == AImgFloatOrIntType::FITYPE_FLOAT;
-    AIGetFormatDetails(outFormat, &_, &_, &floatOrInt);
-    bool outIsFloat = floatOrInt == AImgFloatOrIntType::FITYPE_FLOAT;
-
-    for (int32_t i = 0; i < width*height; i++)
-    {
-        convertToRGBA32F(src, scratch, i, inFormat);
-
-        // clamp to 0-1 range
-        if (inIsFloat && !outIsFloat)
-        {
-            scratch[0] = std::min(1.0f, std::max(0.0f, scratch[0]));
-            scratch[1] = std::min(1.0f, std::max(0.0f, scratch[1]));
-            scratch[2] = std::min(1.0f, std::max(0.0f, scratch[2]));
-            scratch[3] = std::min(1.0f, std::max(0.0f, scratch[3]));
-        }
-
-        convertFromRGBA32F(scratch, dest, i, outFormat);
-    }
+    AImg::StatsConvertTimer convertTimer;
+    AImg::TraceScope trace(AImg::TRACE_CONVERT);
+    AImg::convertImage(src, dest, width, height, inFormat, outFormat);
 
     return AImgErrorCode::AIMG_SUCCESS;
 }
 
 int32_t AImgIsFormatSupported(int32_t fileFormat, int32_t outputFormat)
 {
-    return loaders[fileFormat]->isFormatSupported(outputFormat);
+    AImg::ImageLoaderBase* loader = getLoader(fileFormat);
+    if (loader == NULL)
+        return false;
+
+    return loader->isFormatSupported(outputFormat);
 }
 
 int32_t AImgGetWhatFormatWillBeWrittenForData(int32_t fileFormat, int32_t inputFormat, int32_t outputFormat)
 {
-    return loaders[fileFormat]->getWhatFormatWillBeWrittenForData(inputFormat, outputFormat);
+    AImg::ImageLoaderBase* loader = getLoader(fileFormat);
+    if (loader == NULL)
+        return AImgFormat::INVALID_FORMAT;
+
+    return loader->getWhatFormatWillBeWrittenForData(inputFormat, outputFormat);
 }
 
 struct SimpleMemoryCallbackData
 {
-    int32_t size;
+    int64_t size;
     uint8_t* buffer;
-    int32_t currentPos;
+    int64_t currentPos;
 
     std::vector<uint8_t>* vecBuffer = NULL; // will be NULL unless buffer is resizable
 };
 
-int32_t CALLCONV simpleMemoryReadCallback(void* callbackData, uint8_t* dest, int32_t count)
+int64_t CALLCONV simpleMemoryReadCallback64(void* callbackData, uint8_t* dest, int64_t count)
 {
     auto data = (SimpleMemoryCallbackData*)callbackData;
 
-    int32_t toWrite = count;
-    int32_t end = data->currentPos + count;
+    int64_t toWrite = count;
+    int64_t end = data->currentPos + count;
 
     if (end > data->size)
         toWrite = data->size - data->currentPos;
@@ -810,12 +743,12 @@ int32_t CALLCONV simpleMemoryReadCallback(void* callbackData, uint8_t* dest, int
     return toWrite;
 }
 
-void CALLCONV simpleMemoryWriteCallback(void* callbackData, const uint8_t* src, int32_t count)
+void CALLCONV simpleMemoryWriteCallback64(void* callbackData, const uint8_t* src, int64_t count)
 {
     auto data = (SimpleMemoryCallbackData*)callbackData;
 
-    int32_t toWrite = count;
-    int32_t end = data->currentPos + count;
+    int64_t toWrite = count;
+    int64_t end = data->currentPos + count;
 
     if (end > data->size)
         toWrite = data->size - data->currentPos;
@@ -825,18 +758,18 @@ void CALLCONV simpleMemoryWriteCallback(void* callbackData, const uint8_t* src,
     data->currentPos += toWrite;
 }
 
-void CALLCONV simpleMemoryResizableWriteCallback(void* callbackData, const uint8_t* src, int32_t count)
+void CALLCONV simpleMemoryResizableWriteCallback64(void* callbackData, const uint8_t* src, int64_t count)
 {
     auto data = (SimpleMemoryCallbackData*)callbackData;
 
-    int32_t toWrite = count;
-    int32_t end = data->currentPos + count;
+    int64_t toWrite = count;
+    int64_t end = data->currentPos + count;
 
     if (end > data->size)
     {
         data->vecBuffer->resize(end);
         data->buffer = &data->vecBuffer->operator[](0);
-        data->size = (int32_t)data->vecBuffer->size();
+        data->size = (int64_t)data->vecBuffer->size();
     }
 
     memcpy(data->buffer + data->currentPos, src, toWrite);
@@ -844,18 +777,48 @@ void CALLCONV simpleMemoryResizableWriteCallback(void* callbackData, const uint8
     data->currentPos += toWrite;
 }
 
-int32_t CALLCONV simpleMemoryTellCallback(void* callbackData)
+int64_t CALLCONV simpleMemoryTellCallback64(void* callbackData)
 {
     auto data = (SimpleMemoryCallbackData*)callbackData;
     return data->currentPos;
 }
 
-void CALLCONV simpleMemorySeekCallback(void* callbackData, int32_t pos)
+void CALLCONV simpleMemorySeekCallback64(void* callbackData, int64_t pos)
 {
     auto data = (SimpleMemoryCallbackData*)callbackData;
     data->currentPos = pos;
 }
 
+int32_t CALLCONV simpleMemoryReadCallback(void* callbackData, uint8_t* dest, int32_t count)
+{
+    return (int32_t)simpleMemoryReadCallback64(callbackData, dest, count);
+}
+
+void CALLCONV simpleMemoryWriteCallback(void* callbackData, const uint8_t* src, int32_t count)
+{
+    simpleMemoryWriteCallback64(callbackData, src, count);
+}
+
+void CALLCONV simpleMemoryResizableWriteCallback(void* callbackData, const uint8_t* src, int32_t count)
+{
+    simpleMemoryResizableWriteCallback64(callbackData, src, count);
+}
+
+int32_t CALLCONV simpleMemoryTellCallback(void* callbackData)
+{
+    return (int32_t)simpleMemoryTellCallback64(callbackData);
+}
+
+void CALLCONV simpleMemorySeekCallback(void* callbackData, int32_t pos)
+{
+    simpleMemorySeekCallback64(callbackData, pos);
+}
+
+bool isSimpleMemoryCallbacks(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback)
+{
+    return readCallback == &simpleMemoryReadCallback && tellCallback == &simpleMemoryTellCallback && seekCallback == &simpleMemorySeekCallback;
+}
+
 void AIGetSimpleMemoryBufferCallbacks(ReadCallback* readCallback, WriteCallback* writeCallback, TellCallback* tellCallback, SeekCallback* seekCallback, void** callbackData, void* buffer, int32_t size)
 {
     *readCallback = &simpleMemoryReadCallback;
@@ -871,6 +834,21 @@ void AIGetSimpleMemoryBufferCallbacks(ReadCallback* readCallback, WriteCallback*
     *callbackData = data;
 }
 
+void AIGetSimpleMemoryBufferCallbacks64(ReadCallback64* readCallback, WriteCallback64* writeCallback, TellCallback64* tellCallback, SeekCallback64* seekCallback, void** callbackData, void* buffer, int64_t size)
+{
+    *readCallback = &simpleMemoryReadCallback64;
+    *writeCallback = &simpleMemoryWriteCallback64;
+    *tellCallback = &simpleMemoryTellCallback64;
+    *seekCallback = &simpleMemorySeekCallback64;
+
+    auto data = new SimpleMemoryCallbackData();
+    data->size = size;
+    data->buffer = (uint8_t*)buffer;
+    data->currentPos = 0;
+
+    *callbackData = data;
+}
+
 void AIGetResizableMemoryBufferCallbacks(ReadCallback* readCallback, WriteCallback* writeCallback, TellCallback* tellCallback, SeekCallback* seekCallback, void** callbackData, std::vector<uint8_t>* vec)
 {
     *readCallback = &simpleMemoryReadCallback;
@@ -879,7 +857,7 @@ void AIGetResizableMemoryBufferCallbacks(ReadCallback* readCallback, WriteCallba
     *seekCallback = &simpleMemorySeekCallback;
 
     auto data = new SimpleMemoryCallbackData();
-    data->size = (int32_t)vec->size();
+    data->size = (int64_t)vec->size();
     data->buffer = &vec->operator[](0);
     data->currentPos = 0;
     data->vecBuffer = vec;
@@ -897,3 +875,293 @@ void AIDestroySimpleMemoryBufferCallbacks(ReadCallback readCallback, WriteCallba
     auto data = (SimpleMemoryCallbackData*)callbackData;
     delete data;
 }
+
+void AIDestroySimpleMemoryBufferCallbacks64(ReadCallback64 readCallback, WriteCallback64 writeCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void* callbackData)
+{
+    AIL_UNUSED_PARAM(readCallback);
+    AIL_UNUSED_PARAM(writeCallback);
+    AIL_UNUSED_PARAM(tellCallback);
+    AIL_UNUSED_PARAM(seekCallback);
+
+    auto data = (SimpleMemoryCallbackData*)callbackData;
+    delete data;
+}
+
+bool AImg::getInMemoryData(ReadCallback64 readCallback, void* callbackData, const uint8_t** data, int64_t* size)
+{
+    // stats don't stop a loader reading in place, reads it makes from memory just aren't counted
+    if (readCallback == &AImg::StatsCallbacks::read)
+    {
+        auto statsCallbacks = (AImg::StatsCallbacks*)callbackData;
+        return getInMemoryData(statsCallbacks->readCallback, statsCallbacks->callbackData, data, size);
+    }
+
+    // the mapped file callbacks share the simple memory buffer ones, so this covers both
+    if (readCallback != &simpleMemoryReadCallback64)
+        return false;
+
+    auto memoryData = (SimpleMemoryCallbackData*)callbackData;
+    *data = memoryData->buffer;
+    *size = memoryData->size;
+
+    return true;
+}
+
+// 64 bit callbacks that forward to the 32 bit ones the caller gave us
+int64_t CALLCONV callbacks32ReadCallback(void* callbackData, uint8_t* dest, int64_t count)
+{
+    auto callbacks = (Callbacks32Data*)callbackData;
+
+    // the 32 bit callback can only be asked for 2GiB at a time
+    int64_t totalRead = 0;
+    while (totalRead < count)
+    {
+        int32_t toRead = (int32_t)std::min<int64_t>(count - totalRead, std::numeric_limits<int32_t>::max());
+        int32_t bytesRead = callbacks->readCallback(callbacks->callbackData, dest + totalRead, toRead);
+
+        if (bytesRead > 0)
+            totalRead += bytesRead;
+
+        if (bytesRead < toRead)
+            break;
+    }
+
+    return totalRead;
+}
+
+void CALLCONV callbacks32WriteCallback(void* callbackData, const uint8_t* src, int64_t count)
+{
+    auto callbacks = (Callbacks32Data*)callbackData;
+
+    int64_t totalWritten = 0;
+    while (totalWritten < count)
+    {
+        int32_t toWrite = (int32_t)std::min<int64_t>(count - totalWritten, std::numeric_limits<int32_t>::max());
+        callbacks->writeCallback(callbacks->callbackData, src + totalWritten, toWrite);
+        totalWritten += toWrite;
+    }
+}
+
+int64_t CALLCONV callbacks32TellCallback(void* callbackData)
+{
+    auto callbacks = (Callbacks32Data*)callbackData;
+    return callbacks->tellCallback(callbacks->callbackData);
+}
+
+void CALLCONV callbacks32SeekCallback(void* callbackData, int64_t pos)
+{
+    auto callbacks = (Callbacks32Data*)callbackData;
+    callbacks->seekCallback(callbacks->callbackData, (int32_t)pos);
+}
+
+struct MappedFileCallbackData : public SimpleMemoryCallbackData
+{
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#endif
+};
+
+int32_t mapFile(const char* path, int64_t maxSize, void** callbackData)
+{
+    if (path == NULL)
+        return AImgErrorCode::AIMG_INVALID_ARGS;
+
+    auto data = new MappedFileCallbackData();
+    data->currentPos = 0;
+
+#ifdef _WIN32
+    data->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (data->file == INVALID_HANDLE_VALUE)
+    {
+        delete data;
+        return AImgErrorCode::AIMG_OPEN_FAILED_FILE;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(data->file, &fileSize) || fileSize.QuadPart > maxSize)
+    {
+        CloseHandle(data->file);
+        delete data;
+        return AImgErrorCode::AIMG_OPEN_FAILED_FILE;
+    }
+
+    if (fileSize.QuadPart == 0)
+    {
+        CloseHandle(data->file);
+        delete data;
+        return AImgErrorCode::AIMG_OPEN_FAILED_EMPTY_INPUT;
+    }
+
+    data->mapping = CreateFileMappingA(data->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    void* view = data->mapping != NULL ? MapViewOfFile(data->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (view == NULL)
+    {
+        if (data->mapping != NULL)
+            CloseHandle(data->mapping);
+        CloseHandle(data->file);
+        delete data;
+        return AImgErrorCode::AIMG_OPEN_FAILED_FILE;
+    }
+
+    data->size = (int64_t)fileSize.QuadPart;
+    data->buffer = (uint8_t*)view;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        delete data;
+        return AImgErrorCode::AIMG_OPEN_FAILED_FILE;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || (int64_t)fileStat.st_size > maxSize)
+    {
+        close(fd);
+        delete data;
+        return AImgErrorCode::AIMG_OPEN_FAILED_FILE;
+    }
+
+    if (fileStat.st_size == 0)
+    {
+        close(fd);
+        delete data;
+        return AImgErrorCode::AIMG_OPEN_FAILED_EMPTY_INPUT;
+    }
+
+    void* view = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // the mapping keeps its own reference to the file
+    close(fd);
+
+    if (view == MAP_FAILED)
+    {
+        delete data;
+        return AImgErrorCode::AIMG_OPEN_FAILED_FILE;
+    }
+
+    data->size = (int64_t)fileStat.st_size;
+    data->buffer = (uint8_t*)view;
+#endif
+
+    *callbackData = data;
+
+    return AImgErrorCode::AIMG_SUCCESS;
+}
+
+void unmapFile(void* callbackData)
+{
+    auto data = (MappedFileCallbackData*)callbackData;
+
+#ifdef _WIN32
+    UnmapViewOfFile(data->buffer);
+    CloseHandle(data->mapping);
+    CloseHandle(data->file);
+#else
+    munmap(data->buffer, (size_t)data->size);
+#endif
+
+    delete data;
+}
+
+int32_t AIGetMappedFileCallbacks(const char* path, ReadCallback* readCallback, TellCallback* tellCallback, SeekCallback* seekCallback, void** callbackData)
+{
+    int32_t err = mapFile(path, std::numeric_limits<int32_t>::max(), callbackData);
+    if (err != AImgErrorCode::AIMG_SUCCESS)
+        return err;
+
+    *readCallback = &simpleMemoryReadCallback;
+    *tellCallback = &simpleMemoryTellCallback;
+    *seekCallback = &simpleMemorySeekCallback;
+
+    return AImgErrorCode::AIMG_SUCCESS;
+}
+
+int32_t AIGetMappedFileCallbacks64(const char* path, ReadCallback64* readCallback, TellCallback64* tellCallback, SeekCallback64* seekCallback, void** callbackData)
+{
+    int32_t err = mapFile(path, std::numeric_limits<int64_t>::max(), callbackData);
+    if (err != AImgErrorCode::AIMG_SUCCESS)
+        return err;
+
+    *readCallback = &simpleMemoryReadCallback64;
+    *tellCallback = &simpleMemoryTellCallback64;
+    *seekCallback = &simpleMemorySeekCallback64;
+
+    return AImgErrorCode::AIMG_SUCCESS;
+}
+
+void AIDestroyMappedFileCallbacks(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData)
+{
+    AIL_UNUSED_PARAM(readCallback);
+    AIL_UNUSED_PARAM(tellCallback);
+    AIL_UNUSED_PARAM(seekCallback);
+
+    unmapFile(callbackData);
+}
+
+void AIDestroyMappedFileCallbacks64(ReadCallback64 readCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void* callbackData)
+{
+    AIL_UNUSED_PARAM(readCallback);
+    AIL_UNUSED_PARAM(tellCallback);
+    AIL_UNUSED_PARAM(seekCallback);
+
+    unmapFile(callbackData);
+}
+
+int32_t AImgOpen(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, AImgHandle* imgH, int32_t* detectedFileFormat)
+{
+    return AImgOpenWithFlags(readCallback, tellCallback, seekCallback, callbackData, imgH, detectedFileFormat, AImgOpenFlags::AIMG_OPEN_FLAGS_NONE);
+}
+
+int32_t AImgOpenWithFlags(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, AImgHandle* imgH, int32_t* detectedFileFormat, int32_t openFlags)
+{
+    // our own memory callbacks already have 64 bit versions, so there's no need to wrap them
+    if (isSimpleMemoryCallbacks(readCallback, tellCallback, seekCallback))
+        return AImgOpenWithFlags64(&simpleMemoryReadCallback64, &simpleMemoryTellCallback64, &simpleMemorySeekCallback64, callbackData, imgH, detectedFileFormat, openFlags);
+
+    // the loader can use the callbacks for as long as the image is open, so the handle owns the wrapper
+    Callbacks32Data* callbacks32 = new Callbacks32Data();
+    callbacks32->readCallback = readCallback;
+    callbacks32->tellCallback = tellCallback;
+    callbacks32->seekCallback = seekCallback;
+    callbacks32->writeCallback = NULL;
+    callbacks32->callbackData = callbackData;
+
+    int32_t err = AImgOpenWithFlags64(&callbacks32ReadCallback, &callbacks32TellCallback, &callbacks32SeekCallback, callbacks32, imgH, detectedFileFormat, openFlags);
+
+    if (*imgH != NULL)
+        ((AImg::AImgBase*)*imgH)->mCallbacks32 = callbacks32;
+    else
+        delete callbacks32;
+
+    return err;
+}
+
+int32_t AImgProbe(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, AImgProbeInfo* info)
+{
+    if (isSimpleMemoryCallbacks(readCallback, tellCallback, seekCallback))
+        return AImgProbe64(&simpleMemoryReadCallback64, &simpleMemoryTellCallback64, &simpleMemorySeekCallback64, callbackData, info);
+
+    Callbacks32Data callbacks32;
+    callbacks32.readCallback = readCallback;
+    callbacks32.tellCallback = tellCallback;
+    callbacks32.seekCallback = seekCallback;
+    callbacks32.writeCallback = NULL;
+    callbacks32.callbackData = callbackData;
+
+    return AImgProbe64(&callbacks32ReadCallback, &callbacks32TellCallback, &callbacks32SeekCallback, &callbacks32, info);
+}
+
+int32_t AImgWriteImage(AImgHandle imgH, void* data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat, const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
+    WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, void* encodingOptions)
+{
+    Callbacks32Data callbacks32;
+    callbacks32.readCallback = NULL;
+    callbacks32.writeCallback = writeCallback;
+    callbacks32.tellCallback = tellCallback;
+    callbacks32.seekCallback = seekCallback;
+    callbacks32.callbackData = callbackData;
+
+    return AImgWriteImage64(imgH, data, width, height, inputFormat, outputFormat, profileName, colourProfile, colourProfileLen,
+        &callbacks32WriteCallback, &callbacks32TellCallback, &callbacks32SeekCallback, &callbacks32, encodingOptions);
+}
@@ -1,6 +1,7 @@
 #ifndef ARTOMATIX_AIL_H
 #define ARTOMATIX_AIL_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -29,6 +30,29 @@ extern "C"
     typedef int32_t(CALLCONV *TellCallback)    (void* callbackData);
     typedef void    (CALLCONV *SeekCallback)    (void* callbackData, int32_t pos);
 
+    // 64 bit versions of the above, for streams over 2GiB. These are what the loaders use internally, the 32 bit
+    // entry points just wrap the callbacks they are given in a set of these.
+    typedef int64_t(CALLCONV *ReadCallback64)  (void* callbackData, uint8_t* dest, int64_t count);
+    typedef void    (CALLCONV *WriteCallback64) (void* callbackData, const uint8_t* src, int64_t count);
+    typedef int64_t(CALLCONV *TellCallback64)  (void* callbackData);
+    typedef void    (CALLCONV *SeekCallback64)  (void* callbackData, int64_t pos);
+
+    // Gives AImgDecodeBatch the buffer to decode a job into, once the image's header has been read. size is the number of bytes
+    // needed for width x height tightly packed pixels of format. Called from the batch's worker threads, possibly several at once.
+    typedef void*   (CALLCONV *AImgBatchAllocateCallback)(void* allocatorData, int32_t width, int32_t height, int32_t format, int64_t size);
+
+    // Called from a pool thread when a decode started by AImgDecodeImageAsync has finished, with its AImgErrorCode
+    typedef void    (CALLCONV *AImgDecodeCompleteCallback)(void* userData, void* img, int32_t error);
+
+    // Allocator hooks for AImgSetAllocator, with the same contracts as malloc, realloc and free
+    typedef void*   (CALLCONV *AImgMallocCallback)(void* userData, size_t size);
+    typedef void*   (CALLCONV *AImgReallocCallback)(void* userData, void* ptr, size_t size);
+    typedef void    (CALLCONV *AImgFreeCallback)(void* userData, void* ptr);
+
+    // Tracing hooks for AImgSetTraceHooks. stage is one of the names listed there, and stays valid for the life of the process.
+    typedef void    (CALLCONV *AImgTraceBeginCallback)(void* userData, const char* stage);
+    typedef void    (CALLCONV *AImgTraceEndCallback)(void* userData, const char* stage);
+
     ////////////////
     // Core enums //
     ////////////////
@@ -83,7 +107,10 @@ extern "C"
         AIMG_LOAD_FAILED_UNSUPPORTED_TIFF = -7,
         AIMG_OPEN_FAILED_EMPTY_INPUT = -8,
         AIMG_INVALID_ENCODE_ARGS = -9,
-        AIMG_WRITE_NOT_SUPPORTED_FOR_FORMAT = -10
+        AIMG_WRITE_NOT_SUPPORTED_FOR_FORMAT = -10,
+        AIMG_INVALID_ARGS = -11,
+        AIMG_OPEN_FAILED_FILE = -12, // the file couldn't be opened or mapped into memory
+        AIMG_NOT_READY = -13 // AImgFutureWait timed out before the decode finished
     };
 
     enum AImgFileFormat
@@ -97,6 +124,17 @@ extern "C"
         HDR_IMAGE_FORMAT = 6
     };
 
+    // Flags for AImgOpenWithFlags, can be or'd together
+    enum AImgOpenFlags
+    {
+        AIMG_OPEN_FLAGS_NONE = 0,
+
+        // Read ahead from the stream in blocks of AImgSetReadBufferSize bytes, and serve the loader's reads and short seeks
+        // from that. Worth it when each callback is expensive, eg when it calls back into python or C#.
+        // The stream's position is undefined until the handle is closed. Has no effect on memory buffer or mapped file input.
+        AIMG_OPEN_BUFFERED_READS = 1 << 0
+    };
+
     enum AImgFloatOrIntType
     {
         FITYPE_UNKNOWN = -1,
@@ -133,21 +171,183 @@ extern "C"
         int32_t filter; // Used with png_set_filter(), set to some combination of AIL_PNG_ flag defines from above.
     };
 
+#define AIL_JPEG_SUBSAMPLING_444 0 // full resolution chroma
+#define AIL_JPEG_SUBSAMPLING_422 1 // chroma at half the width
+#define AIL_JPEG_SUBSAMPLING_420 2 // chroma at half the width and height, libjpeg's default
+
+    struct JpegEncodingOptions
+    {
+        int32_t type;
+        int32_t quality; // Used with jpeg_set_quality(), 1 to 100
+        int32_t subsampling; // One of the AIL_JPEG_SUBSAMPLING_ defines from above
+        int32_t progressive; // Non zero to write a progressive JPEG, using jpeg_simple_progression()
+        int32_t optimizeCoding; // Non zero to build Huffman tables for the image, for smaller files at the cost of a slower write
+        int32_t restartInterval; // MCUs between restart markers, up to 65535, or 0 for none
+    };
+
+    // Decoding option structs, for AImgSetDecodingOptions, follow the same rule
+
+    // These defines copied from libjpeg's jpeglib.h
+#define AIL_JPEG_DCT_ISLOW 0 // libjpeg's default, accurate integer
+#define AIL_JPEG_DCT_IFAST 1 // faster, less accurate integer
+#define AIL_JPEG_DCT_FLOAT 2
+
+#define AIL_JPEG_COLOURSPACE_DEFAULT   0 // whatever libjpeg picks for the file, RGB for colour images and grey for greyscale ones
+#define AIL_JPEG_COLOURSPACE_GREYSCALE 1
+#define AIL_JPEG_COLOURSPACE_RGB       2
+#define AIL_JPEG_COLOURSPACE_YCBCR     3 // the colour image's data as it's stored, without converting it to RGB
+
+    struct JpegDecodingOptions
+    {
+        int32_t type;
+        int32_t dctMethod; // One of the AIL_JPEG_DCT_ defines from above
+        int32_t fancyUpsampling; // 0 to upsample the chroma channels by duplicating pixels instead of interpolating
+        int32_t blockSmoothing; // 0 to skip smoothing the blocks of progressive JPEGs while they're still being decoded
+        int32_t colourSpace; // One of the AIL_JPEG_COLOURSPACE_ defines from above, changes the channel count to match
+    };
+
+    // One image for AImgDecodeBatch
+    typedef struct AImgDecodeJob
+    {
+        // Set by the caller. forceImageFormat works as in AImgDecodeImage.
+        ReadCallback64 readCallback;
+        TellCallback64 tellCallback;
+        SeekCallback64 seekCallback;
+        void* callbackData;
+        AImgBatchAllocateCallback allocateCallback;
+        void* allocatorData;
+        int32_t forceImageFormat;
+
+        // Set by AImgDecodeBatch. destBuffer is whatever allocateCallback returned, or NULL if it was never called.
+        // format is the format the pixels in destBuffer were decoded to, and error is an AImgErrorCode.
+        void* destBuffer;
+        int32_t width;
+        int32_t height;
+        int32_t format;
+        int32_t error;
+    } AImgDecodeJob;
+
+    // Counters for one handle, see AImgGetStats. Times are in nanoseconds.
+    typedef struct AImgStats
+    {
+        // Calls to, and bytes passed through, the callbacks the handle was opened or written with. Input the loader
+        // reads in place from memory (memory buffer or mapped file callbacks) doesn't go through readCallback.
+        int64_t bytesRead;
+        int64_t bytesWritten;
+        int64_t readCalls;
+        int64_t writeCalls;
+        int64_t seekCalls;
+        int64_t tellCalls;
+
+        int64_t callbackTime;   // inside those callbacks
+        int64_t convertTime;    // converting between pixel formats
+        int64_t codecTime;      // the rest of the time spent in calls on the handle, decoding and encoding
+
+        // The most memory held at once by temporary buffers (format conversions, row bands), whether or not they came
+        // from an AImgScratch
+        int64_t peakScratchBytes;
+    } AImgStats;
+
+    // Filled in by AImgProbe, the same values AImgOpen and AImgGetInfo would give
+    typedef struct AImgProbeInfo
+    {
+        int32_t fileFormat;
+        int32_t width;
+        int32_t height;
+        int32_t numChannels;
+        int32_t bytesPerChannel;
+        int32_t floatOrInt;
+        int32_t decodedImgFormat;
+    } AImgProbeInfo;
+
     //////////////////////////
     // Public API functions //
     //////////////////////////
 
     typedef void* AImgHandle;
+    typedef void* AImgFuture;
+    typedef void* AImgScratch;
 
     EXPORT_FUNC const char* AImgGetErrorDetails(AImgHandle img);
 
     // detectedFileFormat will be set to a member from AImgFileFormat if non-null, otherwise it is ignored.
     EXPORT_FUNC int32_t AImgOpen(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, AImgHandle* imgPtr, int32_t* detectedFileFormat);
+    EXPORT_FUNC int32_t AImgOpen64(ReadCallback64 readCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void* callbackData, AImgHandle* imgPtr, int32_t* detectedFileFormat);
+
+    // openFlags is a combination of AImgOpenFlags values
+    EXPORT_FUNC int32_t AImgOpenWithFlags(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, AImgHandle* imgPtr, int32_t* detectedFileFormat, int32_t openFlags);
+    EXPORT_FUNC int32_t AImgOpenWithFlags64(ReadCallback64 readCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void* callbackData, AImgHandle* imgPtr, int32_t* detectedFileFormat, int32_t openFlags);
     EXPORT_FUNC void AImgClose(AImgHandle img);
 
+    // Reads an image's size and format straight from its header, for when that's all you need from it. This is much
+    // cheaper than AImgOpen, it only reads the few bytes it needs and never sets up a decoder, but it doesn't check any
+    // more of the file than that, so an image that probes fine can still fail to open. Leaves the stream where it was.
+    EXPORT_FUNC int32_t AImgProbe(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, AImgProbeInfo* info);
+    EXPORT_FUNC int32_t AImgProbe64(ReadCallback64 readCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void* callbackData, AImgProbeInfo* info);
+
+    // Makes img decode at 1/scaleDenom of its width and height, rounded up, where scaleDenom is 1, 2, 4 or 8. This is much
+    // faster than decoding at full size and then shrinking, as the decoder skips the detail it would throw away. Only JPEG
+    // supports it, other formats fail with AIMG_INVALID_ARGS for anything but 1. Must be called before anything is decoded
+    // from img, and AImgGetInfo reports the scaled size afterwards. AImgProbe always gives the full size.
+    EXPORT_FUNC int32_t AImgSetDecodeScale(AImgHandle img, int32_t scaleDenom);
+
+    // Trades decode accuracy for speed. decodingOptions should be the decoding option struct for img's file format, as
+    // detailed at the top of this file, or NULL to go back to the defaults. Formats without one fail with
+    // AIMG_INVALID_ARGS for anything but NULL. Like AImgSetDecodeScale, it must be called before anything is decoded.
+    EXPORT_FUNC int32_t AImgSetDecodingOptions(AImgHandle img, void* decodingOptions);
+
     EXPORT_FUNC int32_t AImgGetInfo(AImgHandle img, int32_t* width, int32_t* height, int32_t* numChannels, int32_t* bytesPerChannel, int32_t* floatOrInt, int32_t* decodedImgFormat, uint32_t *colourProfileLen);
     EXPORT_FUNC int32_t AImgGetColourProfile(AImgHandle img, char* profileName, uint8_t* colourProfile, uint32_t *colourProfileLen);
     EXPORT_FUNC int32_t AImgDecodeImage(AImgHandle img, void* destBuffer, int32_t forceImageFormat);
+
+    // Decodes numRows rows starting at firstRow into destBuffer, so large images can be pulled out in bands without
+    // ever holding the whole thing in memory. destStride is the number of bytes from the start of one row in destBuffer
+    // to the next, or 0 for tightly packed rows. forceImageFormat works the same as in AImgDecodeImage.
+    // Bands should be requested from the top down. PNG and JPEG can only skip forwards, asking them for rows above ones
+    // already decoded fails with AIMG_INVALID_ARGS. TIFF and EXR can be read in any order.
+    EXPORT_FUNC int32_t AImgDecodeRows(AImgHandle img, void* destBuffer, int32_t firstRow, int32_t numRows, int32_t destStride, int32_t forceImageFormat);
+
+    // Decodes just the width x height rectangle with its top left corner at (x, y) into destBuffer. destStride and
+    // forceImageFormat work as in AImgDecodeRows. Only the rows covering the region are read where the format allows it
+    // (TIFF strips, EXR lines), other formats decode up to the bottom of the region and throw away what isn't needed.
+    // This goes through the same row reader as AImgDecodeRows, so the same ordering rules apply to PNG and JPEG.
+    EXPORT_FUNC int32_t AImgDecodeRegion(AImgHandle img, int32_t x, int32_t y, int32_t width, int32_t height, void* destBuffer, int32_t destStride, int32_t forceImageFormat);
+
+    // Queues the image to be decoded on the library thread pool as AImgDecodeImage would, and returns straight away. When the
+    // decode is done, completionCallback is called (if it isn't NULL) from the pool thread, and then the future becomes ready.
+    // future can be NULL if the callback is all that's needed, otherwise it must be freed with AImgFutureRelease.
+    // Neither img nor destBuffer can be touched until the decode has finished. With AImgSetThreadCount(1), the decode runs
+    // on the calling thread before this returns.
+    EXPORT_FUNC int32_t AImgDecodeImageAsync(AImgHandle img, void* destBuffer, int32_t forceImageFormat, AImgDecodeCompleteCallback completionCallback,
+        void* userData, AImgFuture* future);
+
+    // Waits up to timeoutMs milliseconds for the decode to finish, forever if timeoutMs is negative, or just checks if it is 0.
+    // Returns the decode's AImgErrorCode, or AIMG_NOT_READY if it hasn't finished yet.
+    EXPORT_FUNC int32_t AImgFutureWait(AImgFuture future, int32_t timeoutMs);
+
+    // Frees the future. The decode carries on if it hasn't finished, and still calls its completion callback.
+    EXPORT_FUNC void AImgFutureRelease(AImgFuture future);
+
+    // Opens, decodes and closes count images, spread over the library thread pool (see AImgSetThreadCount). openFlags is
+    // used to open every job, as in AImgOpenWithFlags64. Each job gets its own error code, and the return value is AIMG_SUCCESS
+    // if they all succeeded, otherwise the error of the first job that failed. If allocateCallback returns NULL, that job
+    // fails with AIMG_INVALID_ARGS. Large TIFF and EXR images read from memory or a mapped file are split into bands of strips
+    // or line blocks that are decoded on separate handles, so one big image can't keep the rest of the batch waiting.
+    EXPORT_FUNC int32_t AImgDecodeBatch(AImgDecodeJob* jobs, int32_t count, int32_t openFlags);
+
+    // A few buffers that decode and write calls reuse, rather than allocating new ones for each image. See AImgSetScratch.
+    EXPORT_FUNC AImgScratch AImgCreateScratch();
+    EXPORT_FUNC void AImgDestroyScratch(AImgScratch scratch);
+
+    // Makes every decode and write call on img from now on take its temporary buffers (format conversions, row bands) from
+    // scratch, or allocate its own again if scratch is NULL. Once the buffers have grown to fit, a loop that opens, decodes
+    // and closes images of the same size with one scratch makes no more large allocations. A scratch can be set on any number
+    // of handles, but only one of them can be in a call at a time, and it must not be destroyed while any of them still use it.
+    EXPORT_FUNC int32_t AImgSetScratch(AImgHandle img, AImgScratch scratch);
+
+    // AImgInitialise must be called before anything else. Calling it again does nothing and returns the result of the first call.
+    // Once it has returned, any number of threads can open, decode and write images at the same time, as long as no two of
+    // them use the same handle at once. AImgCleanUp must not be called while any other AIL call is in progress.
     EXPORT_FUNC int32_t AImgInitialise();
     EXPORT_FUNC void AImgCleanUp();
 
@@ -156,6 +356,46 @@ extern "C"
     EXPORT_FUNC void AIGetFormatDetails(int32_t format, int32_t* numChannels, int32_t* bytesPerChannel, int32_t* floatOrInt);
     EXPORT_FUNC int32_t AImgConvertFormat(void* src, void* dest, int32_t width, int32_t height, int32_t inFormat, int32_t outFormat);
 
+    // Sets how many threads (including the calling one) large conversions are split across. This covers AImgConvertFormat,
+    // and so also any conversion done while decoding with a forced format or writing a format the file type can't store.
+    // AImgDecodeImage also splits large JPEGs with restart markers across them.
+    // 0 means use one thread per hardware thread, which is the default. 1 disables threading.
+    EXPORT_FUNC int32_t AImgSetThreadCount(int32_t threadCount);
+
+    // Sets the block size used by handles opened with AIMG_OPEN_BUFFERED_READS from now on. The default is 256KiB,
+    // 0 turns buffering off even for handles that ask for it.
+    EXPORT_FUNC int32_t AImgSetReadBufferSize(int32_t readBufferSize);
+
+    // Calls begin and end around each stage of the library's work, on the thread doing it, so it can show up in a profiler
+    // like Perfetto or Tracy. Stages nest, and every begin is matched by an end with the same stage on the same thread.
+    // The stage names are fixed:
+    //   "aimg.open"          AImgOpen and its variants
+    //   "aimg.open.detect"   reading the header and picking a loader, inside aimg.open
+    //   "aimg.open.header"   the loader reading the file's header, inside aimg.open
+    //   "aimg.decode"        AImgDecodeImage, including when it's called by AImgDecodeImageAsync or AImgDecodeBatch
+    //   "aimg.decode.rows"   AImgDecodeRows
+    //   "aimg.decode.region" AImgDecodeRegion
+    //   "aimg.decode.block"  one TIFF strip, one band of rows decoded before converting it to a forced format, or one
+    //                        band of a JPEG decoded in parallel
+    //   "aimg.convert"       converting between pixel formats, including AImgConvertFormat
+    //   "aimg.encode"        AImgWriteImage
+    // Pass both NULL to turn tracing off. Like AImgSetAllocator, this must only be called when no other AIL call is in progress.
+    EXPORT_FUNC int32_t AImgSetTraceHooks(AImgTraceBeginCallback begin, AImgTraceEndCallback end, void* userData);
+
+    // Turns on collecting AImgStats for handles opened or created with AImgGetAImg from now on. Handles created while it's
+    // off don't collect anything, and cost nothing extra. Off by default.
+    EXPORT_FUNC int32_t AImgSetStatsEnabled(int32_t enabled);
+
+    // Gives the totals over every call made on img so far, including opening it. Fails with AIMG_INVALID_ARGS if img was
+    // created while stats were off.
+    EXPORT_FUNC int32_t AImgGetStats(AImgHandle img, AImgStats* stats);
+
+    // Routes the library's own allocations through the given functions: image handles, decode and conversion buffers, and the
+    // memory libpng and stb_image allocate. libjpeg, libtiff and OpenEXR still use their own allocators. Pass all NULL to go
+    // back to malloc, realloc and free. Memory has to be freed with the allocator it came from, so this must only be called
+    // when no handles are open and no other AIL call is in progress, ideally once before AImgInitialise.
+    EXPORT_FUNC int32_t AImgSetAllocator(AImgMallocCallback mallocCallback, AImgFreeCallback freeCallback, AImgReallocCallback reallocCallback, void* userData);
+
     EXPORT_FUNC int32_t AImgIsFormatSupported(int32_t fileFormat, int32_t outputFormat);
 
     EXPORT_FUNC int32_t AImgGetWhatFormatWillBeWrittenForData(int32_t fileFormat, int32_t inputFormat, int32_t outputFormat);
@@ -165,9 +405,22 @@ extern "C"
     // encodingOptions should be one of the encoding option structs detailed in the section above. It shoudl be the struct that corresponds to the image format being written.
     EXPORT_FUNC int32_t AImgWriteImage(AImgHandle imgH, void* data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat, const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
         WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, void* encodingOptions);
+    EXPORT_FUNC int32_t AImgWriteImage64(AImgHandle imgH, void* data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat, const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
+        WriteCallback64 writeCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void* callbackData, void* encodingOptions);
 
     EXPORT_FUNC void AIGetSimpleMemoryBufferCallbacks(ReadCallback* readCallback, WriteCallback* writeCallback, TellCallback* tellCallback, SeekCallback* seekCallback, void** callbackData, void* buffer, int32_t size);
     EXPORT_FUNC void AIDestroySimpleMemoryBufferCallbacks(ReadCallback readCallback, WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData);
+    EXPORT_FUNC void AIGetSimpleMemoryBufferCallbacks64(ReadCallback64* readCallback, WriteCallback64* writeCallback, TellCallback64* tellCallback, SeekCallback64* seekCallback, void** callbackData, void* buffer, int64_t size);
+    EXPORT_FUNC void AIDestroySimpleMemoryBufferCallbacks64(ReadCallback64 readCallback, WriteCallback64 writeCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void* callbackData);
+
+    // Maps the file at path into memory and sets up read callbacks over it. Loaders that can work straight from memory (TIFF, EXR, TGA and HDR)
+    // will use the mapping in place instead of copying it out through readCallback. The file must stay unchanged until
+    // AIDestroyMappedFileCallbacks is called, and any image opened with these callbacks must be closed before that.
+    // The 32 bit version fails with AIMG_OPEN_FAILED_FILE for files over 2GiB.
+    EXPORT_FUNC int32_t AIGetMappedFileCallbacks(const char* path, ReadCallback* readCallback, TellCallback* tellCallback, SeekCallback* seekCallback, void** callbackData);
+    EXPORT_FUNC void AIDestroyMappedFileCallbacks(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData);
+    EXPORT_FUNC int32_t AIGetMappedFileCallbacks64(const char* path, ReadCallback64* readCallback, TellCallback64* tellCallback, SeekCallback64* seekCallback, void** callbackData);
+    EXPORT_FUNC void AIDestroyMappedFileCallbacks64(ReadCallback64 readCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void* callbackData);
 
 #ifdef __cplusplus
 }
@@ -25,6 +25,17 @@
 #endif
 
 typedef struct CallbackData
+{
+    ReadCallback64 readCallback;
+    TellCallback64 tellCallback;
+    SeekCallback64 seekCallback;
+    WriteCallback64 writeCallback;
+    void * callbackData;
+
+} CallbackData;
+
+// The callbacks passed to the 32 bit entry points, which AIL.cpp wraps in 64 bit callbacks for the loaders
+typedef struct Callbacks32Data
 {
     ReadCallback readCallback;
     TellCallback tellCallback;
@@ -32,7 +43,17 @@ typedef struct CallbackData
     WriteCallback writeCallback;
     void * callbackData;
 
-} CallbackData;
+} Callbacks32Data;
+
+#ifdef __cplusplus
+namespace AImg
+{
+    // If callbackData belongs to callbacks that read from memory we already have (AIGetSimpleMemoryBufferCallbacks or
+    // AIGetMappedFileCallbacks), gives the whole of that memory, indexed by the positions tellCallback returns, so a loader
+    // can use it in place. Returns false for any other callbacks.
+    bool getInMemoryData(ReadCallback64 readCallback, void* callbackData, const uint8_t** data, int64_t* size);
+}
+#endif
 
 
 #endif // ARTOMATIX_AIL_INTERNAL_H
@@ -2,30 +2,85 @@
 #define ARTOMATIX_IMAGE_LOADER_BASE_H
 
 #include <string>
+#include <vector>
 
 #include "AIL.h"
+#include "allocator.h"
+
+struct Callbacks32Data;
 
 namespace AImg
 {
-    class AImgBase
+    // AImgOpen reads this many bytes from the start of the stream once, and every loader detects its format from them
+    const int32_t HEADER_SNIFF_SIZE = 32;
+
+    // one more than the largest AImgFileFormat value
+    const int32_t NUM_FILE_FORMATS = AImgFileFormat::HDR_IMAGE_FORMAT + 1;
+
+    class ProbeReader;
+    class ReadBuffer;
+    class Scratch;
+    class Stats;
+
+    // Handles are created with the AImgSetAllocator allocator
+    class AImgBase : public Allocated
     {
         public:
             virtual ~AImgBase();
 
-            virtual int32_t openImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData) = 0;
+            virtual int32_t openImage(ReadCallback64 readCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void* callbackData) = 0;
             virtual int32_t getImageInfo(int32_t* width, int32_t* height, int32_t* numChannels, int32_t* bytesPerChannel, int32_t* floatOrInt, int32_t* decodedImgFormat, uint32_t *colourProfileLen) = 0;
             virtual int32_t getColourProfile(char* profileName, uint8_t* colourProfile, uint32_t *colourProfileLen) = 0;
             virtual int32_t decodeImage(void* destBuffer, int32_t forceImageFormat) = 0;
 
+            // Called by AImgDecodeRows, after it has checked the row range and filled in forceImageFormat and destStride.
+            // The default just decodes the whole image on the first call and hands out rows from that, so loaders that
+            // can decode a band at a time should override it.
+            virtual int32_t decodeRows(void* destBuffer, int32_t firstRow, int32_t numRows, size_t destStride, int32_t forceImageFormat);
+
+            // Called by AImgDecodeRegion, after it has checked the region and filled in forceImageFormat and destStride.
+            // The default reads the region's rows a band at a time through decodeRows, and converts just the columns we want.
+            virtual int32_t decodeRegion(void* destBuffer, int32_t x, int32_t y, int32_t width, int32_t height, size_t destStride, int32_t forceImageFormat);
+
+            // If the file stores its rows in blocks that can be decoded independently of each other (TIFF strips, EXR line
+            // blocks), the number of rows in a block, so AImgDecodeBatch can split a large image across threads with a handle
+            // per band. 0, the default, means rows can only be decoded in order.
+            virtual int32_t getRowBlockSize() { return 0; }
+
             virtual int32_t writeImage(void* data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat,
                                         const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
-                                        WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, void* encodingOptions) = 0;
+                                        WriteCallback64 writeCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void* callbackData, void* encodingOptions) = 0;
 
             const char* getErrorDetails()
             {
                 return mErrorDetails.c_str();
             }
 
+            // Called by AImgSetDecodeScale. Loaders that can decode straight to a smaller size override this, and then report
+            // the scaled size from getImageInfo.
+            virtual int32_t setDecodeScale(int32_t scaleDenom)
+            {
+                if (scaleDenom != 1)
+                {
+                    mErrorDetails = "[AImgBase::setDecodeScale] this format can only be decoded at full size";
+                    return AImgErrorCode::AIMG_INVALID_ARGS;
+                }
+
+                return AImgErrorCode::AIMG_SUCCESS;
+            }
+
+            // Called by AImgSetDecodingOptions, decodingOptions is either NULL or meant to be the loader's own options struct
+            virtual int32_t setDecodingOptions(void* decodingOptions)
+            {
+                if (decodingOptions != NULL)
+                {
+                    mErrorDetails = "[AImgBase::setDecodingOptions] decoding options passed to a decoder that doesn't support any options!";
+                    return AImgErrorCode::AIMG_INVALID_ARGS;
+                }
+
+                return AImgErrorCode::AIMG_SUCCESS;
+            }
+
             virtual int32_t verifyEncodeOptions(void* encodeOptions)
             {
                 if(encodeOptions != NULL)
@@ -37,8 +92,23 @@ namespace AImg
                 return AImgErrorCode::AIMG_SUCCESS;
             }
 
+            // Set by AImgOpen when it had to wrap 32 bit callbacks for openImage, freed by AImgClose
+            Callbacks32Data* mCallbacks32 = nullptr;
+
+            // Set by AImgOpen when the handle was opened with AIMG_OPEN_BUFFERED_READS, freed by AImgClose
+            ReadBuffer* mReadBuffer = nullptr;
+
+            // Set by AImgSetScratch, owned by the caller. Temporary buffers come from here when it's set, see ScratchBuffer.
+            Scratch* mScratch = nullptr;
+
+            // Set when the handle is created if stats are on, freed by AImgClose
+            Stats* mStats = nullptr;
+
         protected:
             std::string mErrorDetails;
+
+        private:
+            Vector<uint8_t> mDecodeRowsCache;
     };
 
     class ImageLoaderBase
@@ -49,10 +119,19 @@ namespace AImg
             virtual AImgBase* getAImg() = 0;
 
             virtual int32_t initialise() = 0;
-            virtual bool canLoadImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData) = 0;
+            // header is the first HEADER_SNIFF_SIZE bytes of the file, or fewer if the file is shorter than that
+            virtual bool canLoadImage(const uint8_t* header, int32_t headerSize) = 0;
+
+            // Loaders that can only guess from the header rather than check a magic number (TGA has none) return false,
+            // so AImgOpen tries them after all the others
+            virtual bool hasMagicNumber() { return true; }
             virtual std::string getFileExtension() = 0;
             virtual int32_t getAImgFileFormatValue() = 0;
 
+            // For AImgProbe, fills in everything in info but fileFormat with what AImgGetInfo would give for the file, by
+            // parsing just enough of the header by hand. Mustn't create any codec state.
+            virtual int32_t probeImage(ProbeReader& reader, AImgProbeInfo* info) = 0;
+
             virtual bool isFormatSupported(int32_t format) = 0;
 
             virtual AImgFormat getWhatFormatWillBeWrittenForData(int32_t inputFormat, int32_t outputFormat) = 0;
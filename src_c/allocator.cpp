@@ -0,0 +1,55 @@
+#include <cstdlib>
+
+#include "AIL.h"
+#include "allocator.h"
+
+namespace AImg
+{
+    AImgMallocCallback userMalloc = NULL;
+    AImgReallocCallback userRealloc = NULL;
+    AImgFreeCallback userFree = NULL;
+    void* userAllocatorData = NULL;
+
+    void* allocate(size_t size)
+    {
+        if (userMalloc != NULL)
+            return userMalloc(userAllocatorData, size);
+
+        return malloc(size);
+    }
+
+    void* reallocate(void* ptr, size_t size)
+    {
+        if (userRealloc != NULL)
+            return userRealloc(userAllocatorData, ptr, size);
+
+        return realloc(ptr, size);
+    }
+
+    void deallocate(void* ptr)
+    {
+        if (ptr == NULL)
+            return;
+
+        if (userFree != NULL)
+            userFree(userAllocatorData, ptr);
+        else
+            free(ptr);
+    }
+}
+
+int32_t AImgSetAllocator(AImgMallocCallback mallocCallback, AImgFreeCallback freeCallback, AImgReallocCallback reallocCallback, void* userData)
+{
+    bool allSet = mallocCallback != NULL && freeCallback != NULL && reallocCallback != NULL;
+    bool noneSet = mallocCallback == NULL && freeCallback == NULL && reallocCallback == NULL;
+
+    if (!allSet && !noneSet)
+        return AImgErrorCode::AIMG_INVALID_ARGS;
+
+    AImg::userMalloc = mallocCallback;
+    AImg::userFree = freeCallback;
+    AImg::userRealloc = reallocCallback;
+    AImg::userAllocatorData = userData;
+
+    return AImgErrorCode::AIMG_SUCCESS;
+}
@@ -0,0 +1,64 @@
+#ifndef ARTOMATIX_ALLOCATOR_H
+#define ARTOMATIX_ALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#include "AIL.h"
+
+namespace AImg
+{
+    // Allocate through whatever was set with AImgSetAllocator, or malloc/realloc/free by default.
+    // Like malloc, allocate and reallocate return NULL on failure.
+    void* allocate(size_t size);
+    void* reallocate(void* ptr, size_t size);
+    void deallocate(void* ptr);
+
+    // Standard library allocator over the functions above, for the buffers loaders keep in vectors
+    template <typename T>
+    struct Allocator
+    {
+        typedef T value_type;
+
+        Allocator() {}
+        template <typename U> Allocator(const Allocator<U>&) {}
+
+        T* allocate(size_t n)
+        {
+            void* ptr = AImg::allocate(n * sizeof(T));
+            if (ptr == NULL && n != 0)
+                throw std::bad_alloc();
+            return (T*)ptr;
+        }
+
+        void deallocate(T* ptr, size_t)
+        {
+            AImg::deallocate(ptr);
+        }
+    };
+
+    template <typename T, typename U> bool operator==(const Allocator<T>&, const Allocator<U>&) { return true; }
+    template <typename T, typename U> bool operator!=(const Allocator<T>&, const Allocator<U>&) { return false; }
+
+    template <typename T> using Vector = std::vector<T, Allocator<T> >;
+
+    // Gives a class operator new and delete that go through the allocator, for objects the library creates for each image
+    struct Allocated
+    {
+        static void* operator new(size_t size)
+        {
+            void* ptr = AImg::allocate(size);
+            if (ptr == NULL)
+                throw std::bad_alloc();
+            return ptr;
+        }
+
+        static void operator delete(void* ptr)
+        {
+            AImg::deallocate(ptr);
+        }
+    };
+}
+
+#endif // ARTOMATIX_ALLOCATOR_H
@@ -0,0 +1,71 @@
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+#include "AIL.h"
+#include "threadpool.h"
+
+namespace AImg
+{
+    // Shared by the queued decode and the AImgFuture the caller holds, whichever is done with it last frees it
+    struct DecodeFuture
+    {
+        std::mutex mutex;
+        std::condition_variable finished;
+        bool done = false;
+        int32_t error = AImgErrorCode::AIMG_SUCCESS;
+    };
+}
+
+int32_t AImgDecodeImageAsync(AImgHandle img, void* destBuffer, int32_t forceImageFormat, AImgDecodeCompleteCallback completionCallback,
+    void* userData, AImgFuture* future)
+{
+    if (img == NULL || destBuffer == NULL)
+        return AImgErrorCode::AIMG_INVALID_ARGS;
+
+    std::shared_ptr<AImg::DecodeFuture> decodeFuture = std::make_shared<AImg::DecodeFuture>();
+
+    if (future != NULL)
+        *future = new std::shared_ptr<AImg::DecodeFuture>(decodeFuture);
+
+    AImg::getThreadPool()->submit([=]()
+    {
+        int32_t err = AImgDecodeImage(img, destBuffer, forceImageFormat);
+
+        if (completionCallback != NULL)
+            completionCallback(userData, img, err);
+
+        {
+            std::lock_guard<std::mutex> lock(decodeFuture->mutex);
+            decodeFuture->done = true;
+            decodeFuture->error = err;
+        }
+
+        decodeFuture->finished.notify_all();
+    });
+
+    return AImgErrorCode::AIMG_SUCCESS;
+}
+
+int32_t AImgFutureWait(AImgFuture future, int32_t timeoutMs)
+{
+    if (future == NULL)
+        return AImgErrorCode::AIMG_INVALID_ARGS;
+
+    AImg::DecodeFuture& decodeFuture = **(std::shared_ptr<AImg::DecodeFuture>*)future;
+
+    std::unique_lock<std::mutex> lock(decodeFuture.mutex);
+
+    if (timeoutMs < 0)
+        decodeFuture.finished.wait(lock, [&decodeFuture]() { return decodeFuture.done; });
+    else
+        decodeFuture.finished.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&decodeFuture]() { return decodeFuture.done; });
+
+    return decodeFuture.done ? decodeFuture.error : AImgErrorCode::AIMG_NOT_READY;
+}
+
+void AImgFutureRelease(AImgFuture future)
+{
+    delete (std::shared_ptr<AImg::DecodeFuture>*)future;
+}
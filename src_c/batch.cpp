@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "AIL.h"
+#include "AIL_internal.h"
+#include "ImageLoaderBase.h"
+#include "threadpool.h"
+
+namespace AImg
+{
+    // Images that come to at least two bands of roughly this many decoded bytes are split, if the format allows it
+    const int64_t BATCH_BAND_BYTES = 4 * 1024 * 1024;
+
+    struct BatchJobState
+    {
+        AImgHandle img = NULL;
+        size_t rowSize = 0;
+        int64_t startPos = 0;
+
+        // only set for jobs that are split, which need their input in memory so each band can have its own handle
+        const uint8_t* inMemoryData = nullptr;
+        int64_t inMemorySize = 0;
+
+        int32_t bandRows = 0;
+        int32_t numBands = 0;
+
+        // the first error from any of this job's bands
+        std::atomic<int32_t> error;
+
+        BatchJobState() : error(AImgErrorCode::AIMG_SUCCESS) {}
+
+        void setError(int32_t err)
+        {
+            int32_t expected = AImgErrorCode::AIMG_SUCCESS;
+            error.compare_exchange_strong(expected, err);
+        }
+    };
+
+    struct BatchTask
+    {
+        int32_t job;
+        int32_t band;
+    };
+
+    // Opens the job's image, allocates its destination and works out how many bands to split it into
+    void openBatchJob(AImgDecodeJob& job, BatchJobState& state, int32_t openFlags)
+    {
+        if (job.readCallback == NULL || job.tellCallback == NULL || job.seekCallback == NULL || job.allocateCallback == NULL)
+        {
+            state.setError(AImgErrorCode::AIMG_INVALID_ARGS);
+            return;
+        }
+
+        state.startPos = job.tellCallback(job.callbackData);
+
+        int32_t err = AImgOpenWithFlags64(job.readCallback, job.tellCallback, job.seekCallback, job.callbackData, &state.img, NULL, openFlags);
+        if (err != AImgErrorCode::AIMG_SUCCESS)
+        {
+            state.setError(err);
+            return;
+        }
+
+        AImgBase* img = (AImgBase*)state.img;
+
+        int32_t width, height, numChannels, bytesPerChannel, floatOrInt, decodedImgFormat;
+        err = img->getImageInfo(&width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &decodedImgFormat, NULL);
+        if (err != AImgErrorCode::AIMG_SUCCESS)
+        {
+            state.setError(err);
+            return;
+        }
+
+        int32_t format = job.forceImageFormat == AImgFormat::INVALID_FORMAT ? decodedImgFormat : job.forceImageFormat;
+        AIGetFormatDetails(format, &numChannels, &bytesPerChannel, &floatOrInt);
+        if (numChannels <= 0)
+        {
+            state.setError(AImgErrorCode::AIMG_INVALID_ARGS);
+            return;
+        }
+
+        job.width = width;
+        job.height = height;
+        job.format = format;
+
+        state.rowSize = (size_t)width * numChannels * bytesPerChannel;
+        int64_t size = (int64_t)state.rowSize * height;
+
+        job.destBuffer = job.allocateCallback(job.allocatorData, width, height, format, size);
+        if (job.destBuffer == NULL)
+        {
+            state.setError(AImgErrorCode::AIMG_INVALID_ARGS);
+            return;
+        }
+
+        state.bandRows = height;
+        state.numBands = 1;
+
+        int32_t blockRows = img->getRowBlockSize();
+        if (blockRows > 0 && size >= 2 * BATCH_BAND_BYTES && getInMemoryData(job.readCallback, job.callbackData, &state.inMemoryData, &state.inMemorySize))
+        {
+            // whole blocks only, so no block gets decoded by two bands
+            int64_t bandRows = std::max(BATCH_BAND_BYTES / (int64_t)state.rowSize / blockRows, (int64_t)1) * blockRows;
+
+            if (bandRows < height)
+            {
+                state.bandRows = (int32_t)bandRows;
+                state.numBands = (int32_t)((height + bandRows - 1) / bandRows);
+            }
+        }
+    }
+
+    void decodeBatchBand(AImgDecodeJob& job, BatchJobState& state, int32_t band)
+    {
+        // another band of this job already failed
+        if (state.error.load() != AImgErrorCode::AIMG_SUCCESS)
+            return;
+
+        int32_t err;
+
+        if (state.numBands == 1)
+        {
+            err = AImgDecodeImage(state.img, job.destBuffer, job.format);
+        }
+        else
+        {
+            int32_t firstRow = band * state.bandRows;
+            int32_t numRows = std::min(state.bandRows, job.height - firstRow);
+            uint8_t* dest = (uint8_t*)job.destBuffer + firstRow * state.rowSize;
+
+            if (band == 0)
+            {
+                err = AImgDecodeRows(state.img, dest, firstRow, numRows, 0, job.format);
+            }
+            else
+            {
+                // the job's own callbacks can only be used from one thread, so the other bands read the memory directly
+                ReadCallback64 readCallback = NULL;
+                WriteCallback64 writeCallback = NULL;
+                TellCallback64 tellCallback = NULL;
+                SeekCallback64 seekCallback = NULL;
+                void* callbackData = NULL;
+
+                AIGetSimpleMemoryBufferCallbacks64(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, (void*)state.inMemoryData, state.inMemorySize);
+                seekCallback(callbackData, state.startPos);
+
+                AImgHandle bandImg = NULL;
+                err = AImgOpen64(readCallback, tellCallback, seekCallback, callbackData, &bandImg, NULL);
+
+                if (err == AImgErrorCode::AIMG_SUCCESS)
+                    err = AImgDecodeRows(bandImg, dest, firstRow, numRows, 0, job.format);
+
+                AImgClose(bandImg);
+                AIDestroySimpleMemoryBufferCallbacks64(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+            }
+        }
+
+        if (err != AImgErrorCode::AIMG_SUCCESS)
+            state.setError(err);
+    }
+}
+
+int32_t AImgDecodeBatch(AImgDecodeJob* jobs, int32_t count, int32_t openFlags)
+{
+    if (count < 0 || (count > 0 && jobs == NULL))
+        return AImgErrorCode::AIMG_INVALID_ARGS;
+
+    for (int32_t i = 0; i < count; i++)
+    {
+        jobs[i].destBuffer = NULL;
+        jobs[i].width = 0;
+        jobs[i].height = 0;
+        jobs[i].format = AImgFormat::INVALID_FORMAT;
+    }
+
+    std::vector<AImg::BatchJobState> states(count);
+    std::shared_ptr<AImg::ThreadPool> pool = AImg::getThreadPool();
+
+    pool->parallelFor(count, [&](size_t i) { AImg::openBatchJob(jobs[i], states[i], openFlags); });
+
+    // Biggest images first, so a large one isn't started last and left running on one thread after everything else is done.
+    // Idle threads claim the next task as they finish, so bands of a split image spread over whichever threads are free.
+    std::vector<int32_t> order;
+    for (int32_t i = 0; i < count; i++)
+    {
+        if (states[i].error.load() == AImgErrorCode::AIMG_SUCCESS)
+            order.push_back(i);
+    }
+
+    std::stable_sort(order.begin(), order.end(), [&](int32_t a, int32_t b)
+    {
+        return states[a].rowSize * jobs[a].height > states[b].rowSize * jobs[b].height;
+    });
+
+    std::vector<AImg::BatchTask> tasks;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        for (int32_t band = 0; band < states[order[i]].numBands; band++)
+            tasks.push_back({ order[i], band });
+    }
+
+    pool->parallelFor(tasks.size(), [&](size_t i) { AImg::decodeBatchBand(jobs[tasks[i].job], states[tasks[i].job], tasks[i].band); });
+
+    int32_t result = AImgErrorCode::AIMG_SUCCESS;
+    for (int32_t i = 0; i < count; i++)
+    {
+        AImgClose(states[i].img);
+
+        jobs[i].error = states[i].error.load();
+        if (result == AImgErrorCode::AIMG_SUCCESS)
+            result = jobs[i].error;
+    }
+
+    return result;
+}
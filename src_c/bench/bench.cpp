@@ -0,0 +1,20 @@
+#include "benchCommon.h"
+
+// Run with --benchmark_out=<file> --benchmark_out_format=json to save the results, or use the bench target which does that
+int main(int argc, char** argv)
+{
+    AImgInitialise();
+
+    registerCodecBenchmarks();
+    registerConvertBenchmarks();
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+
+    benchmark::RunSpecifiedBenchmarks();
+
+    AImgCleanUp();
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+#include "benchCommon.h"
+
+#include <cmath>
+#include <stdio.h>
+
+std::vector<uint8_t> readFile(const std::string& path)
+{
+    std::vector<uint8_t> retval;
+
+    FILE* f = fopen(path.c_str(), "rb");
+    if (f == NULL)
+        return retval;
+
+    fseek(f, 0, SEEK_END);
+    size_t size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    retval.resize(size);
+    if (fread(&retval[0], 1, size, f) != size)
+        retval.clear();
+
+    fclose(f);
+    return retval;
+}
+
+std::string getFormatName(int32_t format)
+{
+    switch (format)
+    {
+        case AImgFormat::R8U: return "R8U";
+        case AImgFormat::RG8U: return "RG8U";
+        case AImgFormat::RGB8U: return "RGB8U";
+        case AImgFormat::RGBA8U: return "RGBA8U";
+        case AImgFormat::R16U: return "R16U";
+        case AImgFormat::RG16U: return "RG16U";
+        case AImgFormat::RGB16U: return "RGB16U";
+        case AImgFormat::RGBA16U: return "RGBA16U";
+        case AImgFormat::R16F: return "R16F";
+        case AImgFormat::RG16F: return "RG16F";
+        case AImgFormat::RGB16F: return "RGB16F";
+        case AImgFormat::RGBA16F: return "RGBA16F";
+        case AImgFormat::R32F: return "R32F";
+        case AImgFormat::RG32F: return "RG32F";
+        case AImgFormat::RGB32F: return "RGB32F";
+        case AImgFormat::RGBA32F: return "RGBA32F";
+        default: return "INVALID";
+    }
+}
+
+std::string getFileFormatName(int32_t fileFormat)
+{
+    switch (fileFormat)
+    {
+        case AImgFileFormat::EXR_IMAGE_FORMAT: return "EXR";
+        case AImgFileFormat::PNG_IMAGE_FORMAT: return "PNG";
+        case AImgFileFormat::JPEG_IMAGE_FORMAT: return "JPEG";
+        case AImgFileFormat::TGA_IMAGE_FORMAT: return "TGA";
+        case AImgFileFormat::TIFF_IMAGE_FORMAT: return "TIFF";
+        case AImgFileFormat::HDR_IMAGE_FORMAT: return "HDR";
+        default: return "UNKNOWN";
+    }
+}
+
+const std::vector<int32_t>& getAllFormats()
+{
+    static const std::vector<int32_t> formats =
+    {
+        AImgFormat::R8U, AImgFormat::RG8U, AImgFormat::RGB8U, AImgFormat::RGBA8U,
+        AImgFormat::R16U, AImgFormat::RG16U, AImgFormat::RGB16U, AImgFormat::RGBA16U,
+        AImgFormat::R16F, AImgFormat::RG16F, AImgFormat::RGB16F, AImgFormat::RGBA16F,
+        AImgFormat::R32F, AImgFormat::RG32F, AImgFormat::RGB32F, AImgFormat::RGBA32F
+    };
+
+    return formats;
+}
+
+std::vector<uint8_t> makeSyntheticImage(int32_t width, int32_t height, int32_t format)
+{
+    std::vector<float> rgba((size_t)width * height * 4);
+    uint32_t seed = 12345;
+
+    for (int32_t y = 0; y < height; y++)
+    {
+        for (int32_t x = 0; x < width; x++)
+        {
+            float u = (float)x / width;
+            float v = (float)y / height;
+
+            // xorshift, so the noise is the same on every platform
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            float noise = (float)(seed & 0xFF) / 255.0f * 0.05f;
+
+            float* px = &rgba[((size_t)y * width + x) * 4];
+            px[0] = u * 0.95f + noise;
+            px[1] = v * 0.95f + noise;
+            px[2] = 0.5f + 0.45f * std::sin(u * 12.0f + v * 7.0f);
+            px[3] = 1.0f - u * v;
+        }
+    }
+
+    int32_t numChannels, bytesPerChannel, floatOrInt;
+    AIGetFormatDetails(format, &numChannels, &bytesPerChannel, &floatOrInt);
+
+    std::vector<uint8_t> retval((size_t)width * height * numChannels * bytesPerChannel);
+    AImgConvertFormat(&rgba[0], &retval[0], width, height, AImgFormat::RGBA32F, format);
+
+    return retval;
+}
+
+std::vector<uint8_t> encodeImage(const std::vector<uint8_t>& pixels, int32_t width, int32_t height, int32_t inputFormat, int32_t fileFormat,
+    void* encodingOptions)
+{
+    std::vector<uint8_t> encoded(1);
+
+    ReadCallback readCallback = NULL;
+    WriteCallback writeCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+
+    AIGetResizableMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &encoded);
+
+    AImgHandle img = AImgGetAImg(fileFormat);
+    int32_t outputFormat = AImgGetWhatFormatWillBeWrittenForData(fileFormat, inputFormat, AImgFormat::INVALID_FORMAT);
+
+    int32_t err = AImgWriteImage(img, (void*)&pixels[0], width, height, inputFormat, outputFormat, NULL, NULL, 0,
+        writeCallback, tellCallback, seekCallback, callbackData, encodingOptions);
+
+    AImgClose(img);
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+    if (err != AImgErrorCode::AIMG_SUCCESS)
+        encoded.clear();
+
+    return encoded;
+}
+
+void setThroughput(benchmark::State& state, int32_t width, int32_t height, int32_t format)
+{
+    int32_t numChannels, bytesPerChannel, floatOrInt;
+    AIGetFormatDetails(format, &numChannels, &bytesPerChannel, &floatOrInt);
+
+    int64_t pixels = (int64_t)width * height;
+
+    state.SetBytesProcessed((int64_t)state.iterations() * pixels * numChannels * bytesPerChannel);
+    state.counters["pixels"] = benchmark::Counter((double)state.iterations() * pixels, benchmark::Counter::kIsRate);
+}
@@ -0,0 +1,44 @@
+#ifndef AIL_BENCH
+#define AIL_BENCH
+
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "../AIL.h"
+
+inline std::string getImagesDir()
+{
+    std::string thisFile = __FILE__;
+
+    char dirSep = '/';
+#ifdef WIN32
+    dirSep = '\\';
+#endif
+    size_t pos = thisFile.find_last_of(dirSep);
+
+    return thisFile.substr(0, pos) + "/../../test_images";
+}
+
+std::vector<uint8_t> readFile(const std::string& path);
+
+std::string getFormatName(int32_t format);
+std::string getFileFormatName(int32_t fileFormat);
+
+// Every pixel format, for the conversion benchmarks
+const std::vector<int32_t>& getAllFormats();
+
+// A width x height image in format with smooth gradients and a little noise, so the compressors see something closer
+// to a real image than a flat colour or pure noise. The same arguments always give the same pixels.
+std::vector<uint8_t> makeSyntheticImage(int32_t width, int32_t height, int32_t format);
+
+// Encodes the image into memory, with encodingOptions if they're given, returns an empty vector on failure
+std::vector<uint8_t> encodeImage(const std::vector<uint8_t>& pixels, int32_t width, int32_t height, int32_t inputFormat, int32_t fileFormat,
+    void* encodingOptions = NULL);
+
+// Sets the bytes and items processed and a pixels per second counter, from how many times the loop ran
+void setThroughput(benchmark::State& state, int32_t width, int32_t height, int32_t format);
+
+void registerCodecBenchmarks();
+void registerConvertBenchmarks();
+
+#endif
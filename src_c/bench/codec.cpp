@@ -0,0 +1,433 @@
+#include "benchCommon.h"
+
+#include <algorithm>
+#include <map>
+
+namespace
+{
+    struct TestFile
+    {
+        int32_t fileFormat;
+        const char* path;
+    };
+
+    const TestFile testFiles[] =
+    {
+#ifdef HAVE_PNG
+        { AImgFileFormat::PNG_IMAGE_FORMAT, "/png/8-bit.png" },
+        { AImgFileFormat::PNG_IMAGE_FORMAT, "/png/16-bit.png" },
+        { AImgFileFormat::PNG_IMAGE_FORMAT, "/png/alpha.png" },
+        { AImgFileFormat::PNG_IMAGE_FORMAT, "/png/indextest_indexed.png" },
+#endif
+#ifdef HAVE_JPEG
+        { AImgFileFormat::JPEG_IMAGE_FORMAT, "/jpeg/test.jpeg" },
+        { AImgFileFormat::JPEG_IMAGE_FORMAT, "/jpeg/karl.jpeg" },
+        { AImgFileFormat::JPEG_IMAGE_FORMAT, "/jpeg/greyscale.jpeg" },
+#endif
+#ifdef HAVE_TGA
+        { AImgFileFormat::TGA_IMAGE_FORMAT, "/tga/test.tga" },
+        { AImgFileFormat::TGA_IMAGE_FORMAT, "/tga/4channel.tga" },
+        { AImgFileFormat::TGA_IMAGE_FORMAT, "/tga/indexed.tga" },
+#endif
+#ifdef HAVE_TIFF
+        { AImgFileFormat::TIFF_IMAGE_FORMAT, "/tiff/8_bit_int.tif" },
+        { AImgFileFormat::TIFF_IMAGE_FORMAT, "/tiff/16_bit_int_separate_chans.tif" },
+        { AImgFileFormat::TIFF_IMAGE_FORMAT, "/tiff/32_bit_float.tif" },
+        { AImgFileFormat::TIFF_IMAGE_FORMAT, "/tiff/8_bit_int_separate_chans.tif" },
+#endif
+#ifdef HAVE_EXR
+        { AImgFileFormat::EXR_IMAGE_FORMAT, "/exr/grad_32.exr" },
+        { AImgFileFormat::EXR_IMAGE_FORMAT, "/exr/neal_half.exr" },
+#endif
+#ifdef HAVE_HDR
+        { AImgFileFormat::HDR_IMAGE_FORMAT, "/hdr/test-env.hdr" },
+#endif
+        { AImgFileFormat::UNKNOWN_IMAGE_FORMAT, NULL }
+    };
+
+    // The synthetic images are big enough that the per image overhead doesn't matter, each written in a format the
+    // file format stores natively so the encode and decode numbers aren't mostly conversion. HDR has no writer, so it
+    // only has the test file.
+    const int32_t SYNTHETIC_SIZE = 2048;
+
+    struct SyntheticImage
+    {
+        int32_t fileFormat;
+        int32_t format;
+    };
+
+    const SyntheticImage syntheticImages[] =
+    {
+#ifdef HAVE_PNG
+        { AImgFileFormat::PNG_IMAGE_FORMAT, AImgFormat::RGBA8U },
+        { AImgFileFormat::PNG_IMAGE_FORMAT, AImgFormat::RGBA16U },
+#endif
+#ifdef HAVE_JPEG
+        { AImgFileFormat::JPEG_IMAGE_FORMAT, AImgFormat::RGB8U },
+#endif
+#ifdef HAVE_TGA
+        { AImgFileFormat::TGA_IMAGE_FORMAT, AImgFormat::RGB8U },
+#endif
+#ifdef HAVE_TIFF
+        { AImgFileFormat::TIFF_IMAGE_FORMAT, AImgFormat::RGBA8U },
+        { AImgFileFormat::TIFF_IMAGE_FORMAT, AImgFormat::RGBA16U },
+        { AImgFileFormat::TIFF_IMAGE_FORMAT, AImgFormat::RGBA32F },
+#endif
+#ifdef HAVE_EXR
+        { AImgFileFormat::EXR_IMAGE_FORMAT, AImgFormat::RGBA16F },
+        { AImgFileFormat::EXR_IMAGE_FORMAT, AImgFormat::RGBA32F },
+#endif
+        { AImgFileFormat::UNKNOWN_IMAGE_FORMAT, AImgFormat::INVALID_FORMAT }
+    };
+
+    // Google Benchmark runs each function several times while it works out the iteration count, so the inputs are
+    // only built the first time they're asked for
+    const std::vector<uint8_t>& getSyntheticPixels(int32_t format)
+    {
+        static std::map<int32_t, std::vector<uint8_t> > cache;
+
+        auto it = cache.find(format);
+        if (it == cache.end())
+            it = cache.insert(std::make_pair(format, makeSyntheticImage(SYNTHETIC_SIZE, SYNTHETIC_SIZE, format))).first;
+
+        return it->second;
+    }
+
+    const std::vector<uint8_t>& getSyntheticFile(int32_t fileFormat, int32_t format)
+    {
+        static std::map<std::pair<int32_t, int32_t>, std::vector<uint8_t> > cache;
+
+        auto key = std::make_pair(fileFormat, format);
+        auto it = cache.find(key);
+        if (it == cache.end())
+            it = cache.insert(std::make_pair(key, encodeImage(getSyntheticPixels(format), SYNTHETIC_SIZE, SYNTHETIC_SIZE, format, fileFormat))).first;
+
+        return it->second;
+    }
+
+    // scaleDenom goes to AImgSetDecodeScale and decodingOptions to AImgSetDecodingOptions, and the throughput is counted in
+    // output pixels
+    void decodeBenchmark(benchmark::State& state, std::vector<uint8_t> data, int32_t scaleDenom = 1, void* decodingOptions = NULL)
+    {
+        if (data.empty())
+        {
+            state.SkipWithError("couldn't read or encode the input");
+            return;
+        }
+
+        ReadCallback readCallback = NULL;
+        WriteCallback writeCallback = NULL;
+        TellCallback tellCallback = NULL;
+        SeekCallback seekCallback = NULL;
+        void* callbackData = NULL;
+
+        AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &data[0], (int32_t)data.size());
+
+        int32_t width = 0, height = 0, format = AImgFormat::INVALID_FORMAT;
+        std::vector<uint8_t> decoded;
+
+        for (auto _ : state)
+        {
+            seekCallback(callbackData, 0);
+
+            AImgHandle img = NULL;
+            int32_t err = AImgOpen(readCallback, tellCallback, seekCallback, callbackData, &img, NULL);
+
+            if (err == AImgErrorCode::AIMG_SUCCESS && scaleDenom != 1)
+                err = AImgSetDecodeScale(img, scaleDenom);
+
+            if (err == AImgErrorCode::AIMG_SUCCESS && decodingOptions != NULL)
+                err = AImgSetDecodingOptions(img, decodingOptions);
+
+            int32_t numChannels, bytesPerChannel, floatOrInt;
+            if (err == AImgErrorCode::AIMG_SUCCESS)
+                err = AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &format, NULL);
+
+            if (err == AImgErrorCode::AIMG_SUCCESS)
+            {
+                decoded.resize((size_t)width * height * numChannels * bytesPerChannel);
+                err = AImgDecodeImage(img, &decoded[0], AImgFormat::INVALID_FORMAT);
+            }
+
+            AImgClose(img);
+
+            if (err != AImgErrorCode::AIMG_SUCCESS)
+            {
+                state.SkipWithError("decode failed");
+                break;
+            }
+
+            benchmark::DoNotOptimize(decoded.data());
+        }
+
+        AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+        if (format != AImgFormat::INVALID_FORMAT)
+            setThroughput(state, width, height, format);
+    }
+
+    void BM_DecodeFile(benchmark::State& state, const char* path)
+    {
+        decodeBenchmark(state, readFile(getImagesDir() + path));
+    }
+
+    void BM_DecodeSynthetic(benchmark::State& state, int32_t fileFormat, int32_t format)
+    {
+        decodeBenchmark(state, getSyntheticFile(fileFormat, format));
+    }
+
+    void BM_DecodeSyntheticScaled(benchmark::State& state, int32_t fileFormat, int32_t format, int32_t scaleDenom)
+    {
+        decodeBenchmark(state, getSyntheticFile(fileFormat, format), scaleDenom);
+    }
+
+    // The fastest JPEG decoding options, for when exact output doesn't matter
+    void BM_DecodeSyntheticFast(benchmark::State& state, int32_t fileFormat, int32_t format)
+    {
+        JpegDecodingOptions options;
+        options.type = AImgFileFormat::JPEG_IMAGE_FORMAT;
+        options.dctMethod = AIL_JPEG_DCT_IFAST;
+        options.fancyUpsampling = 0;
+        options.blockSmoothing = 0;
+        options.colourSpace = AIL_JPEG_COLOURSPACE_DEFAULT;
+
+        decodeBenchmark(state, getSyntheticFile(fileFormat, format), 1, &options);
+    }
+
+    // The whole image through AImgDecodeRows, bandRows at a time. Comparing with Decode shows what each call costs the
+    // decoder, a band of 1 is one jpeg_read_scanlines call per row.
+    void BM_DecodeRowsSynthetic(benchmark::State& state, int32_t fileFormat, int32_t format, int32_t bandRows)
+    {
+        std::vector<uint8_t> data = getSyntheticFile(fileFormat, format);
+        if (data.empty())
+        {
+            state.SkipWithError("couldn't encode the input");
+            return;
+        }
+
+        ReadCallback readCallback = NULL;
+        WriteCallback writeCallback = NULL;
+        TellCallback tellCallback = NULL;
+        SeekCallback seekCallback = NULL;
+        void* callbackData = NULL;
+
+        AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &data[0], (int32_t)data.size());
+
+        int32_t width = 0, height = 0, decodedFormat = AImgFormat::INVALID_FORMAT;
+        std::vector<uint8_t> decoded;
+
+        for (auto _ : state)
+        {
+            seekCallback(callbackData, 0);
+
+            AImgHandle img = NULL;
+            int32_t err = AImgOpen(readCallback, tellCallback, seekCallback, callbackData, &img, NULL);
+
+            int32_t numChannels, bytesPerChannel, floatOrInt;
+            if (err == AImgErrorCode::AIMG_SUCCESS)
+                err = AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &decodedFormat, NULL);
+
+            int32_t rowSize = width * numChannels * bytesPerChannel;
+            decoded.resize((size_t)rowSize * height);
+
+            for (int32_t y = 0; err == AImgErrorCode::AIMG_SUCCESS && y < height; y += bandRows)
+                err = AImgDecodeRows(img, &decoded[(size_t)y * rowSize], y, std::min(bandRows, height - y), rowSize, AImgFormat::INVALID_FORMAT);
+
+            AImgClose(img);
+
+            if (err != AImgErrorCode::AIMG_SUCCESS)
+            {
+                state.SkipWithError("decode failed");
+                break;
+            }
+
+            benchmark::DoNotOptimize(decoded.data());
+        }
+
+        AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+        if (decodedFormat != AImgFormat::INVALID_FORMAT)
+            setThroughput(state, width, height, decodedFormat);
+    }
+
+    // A synthetic JPEG with a restart marker after every MCU row, decoded with the pool at threadCount threads. With
+    // more than one thread it's split into bands at the markers.
+    void BM_DecodeRestartJPEG(benchmark::State& state, int32_t format, int32_t threadCount)
+    {
+        static std::vector<uint8_t> file;
+        if (file.empty())
+        {
+            JpegEncodingOptions options;
+            options.type = AImgFileFormat::JPEG_IMAGE_FORMAT;
+            options.quality = 90;
+            options.subsampling = AIL_JPEG_SUBSAMPLING_420;
+            options.progressive = 0;
+            options.optimizeCoding = 0;
+            options.restartInterval = SYNTHETIC_SIZE / 16;
+
+            file = encodeImage(getSyntheticPixels(format), SYNTHETIC_SIZE, SYNTHETIC_SIZE, format, AImgFileFormat::JPEG_IMAGE_FORMAT, &options);
+        }
+
+        AImgSetThreadCount(threadCount);
+        decodeBenchmark(state, file);
+        AImgSetThreadCount(0);
+    }
+
+    void BM_EncodeSynthetic(benchmark::State& state, int32_t fileFormat, int32_t format)
+    {
+        const std::vector<uint8_t>& pixels = getSyntheticPixels(format);
+        int32_t outputFormat = AImgGetWhatFormatWillBeWrittenForData(fileFormat, format, AImgFormat::INVALID_FORMAT);
+
+        // kept between iterations so after the first one the callbacks aren't growing it
+        std::vector<uint8_t> encoded(1);
+
+        for (auto _ : state)
+        {
+            ReadCallback readCallback = NULL;
+            WriteCallback writeCallback = NULL;
+            TellCallback tellCallback = NULL;
+            SeekCallback seekCallback = NULL;
+            void* callbackData = NULL;
+
+            AIGetResizableMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &encoded);
+
+            AImgHandle img = AImgGetAImg(fileFormat);
+            int32_t err = AImgWriteImage(img, (void*)&pixels[0], SYNTHETIC_SIZE, SYNTHETIC_SIZE, format, outputFormat, NULL, NULL, 0,
+                writeCallback, tellCallback, seekCallback, callbackData, NULL);
+
+            AImgClose(img);
+            AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+            if (err != AImgErrorCode::AIMG_SUCCESS)
+            {
+                state.SkipWithError("write failed");
+                break;
+            }
+        }
+
+        setThroughput(state, SYNTHETIC_SIZE, SYNTHETIC_SIZE, format);
+    }
+
+    // Just AImgOpen and AImgClose, which is format detection plus reading the header
+    void BM_Open(benchmark::State& state, const char* path)
+    {
+        std::vector<uint8_t> data = readFile(getImagesDir() + path);
+        if (data.empty())
+        {
+            state.SkipWithError("couldn't read the input");
+            return;
+        }
+
+        ReadCallback readCallback = NULL;
+        WriteCallback writeCallback = NULL;
+        TellCallback tellCallback = NULL;
+        SeekCallback seekCallback = NULL;
+        void* callbackData = NULL;
+
+        AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &data[0], (int32_t)data.size());
+
+        for (auto _ : state)
+        {
+            seekCallback(callbackData, 0);
+
+            AImgHandle img = NULL;
+            int32_t detectedFileFormat = AImgFileFormat::UNKNOWN_IMAGE_FORMAT;
+            int32_t err = AImgOpen(readCallback, tellCallback, seekCallback, callbackData, &img, &detectedFileFormat);
+            AImgClose(img);
+
+            if (err != AImgErrorCode::AIMG_SUCCESS)
+            {
+                state.SkipWithError("open failed");
+                break;
+            }
+
+            benchmark::DoNotOptimize(detectedFileFormat);
+        }
+
+        AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    // AImgProbe, to compare with BM_Open
+    void BM_Probe(benchmark::State& state, const char* path)
+    {
+        std::vector<uint8_t> data = readFile(getImagesDir() + path);
+        if (data.empty())
+        {
+            state.SkipWithError("couldn't read the input");
+            return;
+        }
+
+        ReadCallback readCallback = NULL;
+        WriteCallback writeCallback = NULL;
+        TellCallback tellCallback = NULL;
+        SeekCallback seekCallback = NULL;
+        void* callbackData = NULL;
+
+        AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &data[0], (int32_t)data.size());
+
+        for (auto _ : state)
+        {
+            AImgProbeInfo info;
+            if (AImgProbe(readCallback, tellCallback, seekCallback, callbackData, &info) != AImgErrorCode::AIMG_SUCCESS)
+            {
+                state.SkipWithError("probe failed");
+                break;
+            }
+
+            benchmark::DoNotOptimize(info);
+        }
+
+        AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+        state.SetItemsProcessed(state.iterations());
+    }
+}
+
+void registerCodecBenchmarks()
+{
+    for (const TestFile* file = testFiles; file->path != NULL; file++)
+    {
+        std::string name = getFileFormatName(file->fileFormat) + file->path;
+
+        benchmark::RegisterBenchmark(("Decode/" + name).c_str(), &BM_DecodeFile, file->path)->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark(("Open/" + name).c_str(), &BM_Open, file->path)->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark(("Probe/" + name).c_str(), &BM_Probe, file->path)->Unit(benchmark::kMicrosecond);
+    }
+
+    for (const SyntheticImage* image = syntheticImages; image->format != AImgFormat::INVALID_FORMAT; image++)
+    {
+        std::string name = getFileFormatName(image->fileFormat) + "/synthetic_" + getFormatName(image->format);
+
+        benchmark::RegisterBenchmark(("Decode/" + name).c_str(), &BM_DecodeSynthetic, image->fileFormat, image->format)->Unit(benchmark::kMillisecond);
+        benchmark::RegisterBenchmark(("Encode/" + name).c_str(), &BM_EncodeSynthetic, image->fileFormat, image->format)->Unit(benchmark::kMillisecond);
+
+        // only JPEG can decode straight to a smaller size, has decoding options, or splits its decode at restart markers
+        if (image->fileFormat == AImgFileFormat::JPEG_IMAGE_FORMAT)
+        {
+            for (int32_t scaleDenom = 2; scaleDenom <= 8; scaleDenom *= 2)
+            {
+                benchmark::RegisterBenchmark(("DecodeScaled/" + name + "/" + std::to_string(scaleDenom)).c_str(), &BM_DecodeSyntheticScaled,
+                    image->fileFormat, image->format, scaleDenom)->Unit(benchmark::kMillisecond);
+            }
+
+            benchmark::RegisterBenchmark(("DecodeFast/" + name).c_str(), &BM_DecodeSyntheticFast, image->fileFormat, image->format)->Unit(benchmark::kMillisecond);
+
+            const int32_t threadCounts[] = { 1, 4, 0 };
+            for (int32_t i = 0; i < 3; i++)
+            {
+                std::string threads = threadCounts[i] != 0 ? std::to_string(threadCounts[i]) : "all";
+                benchmark::RegisterBenchmark(("DecodeRestart/" + name + "/threads:" + threads).c_str(), &BM_DecodeRestartJPEG, image->format, threadCounts[i])
+                    ->Unit(benchmark::kMillisecond)->UseRealTime();
+            }
+
+            const int32_t bandRows[] = { 1, 16 };
+            for (int32_t i = 0; i < 2; i++)
+            {
+                benchmark::RegisterBenchmark(("DecodeRows/" + name + "/" + std::to_string(bandRows[i])).c_str(), &BM_DecodeRowsSynthetic,
+                    image->fileFormat, image->format, bandRows[i])->Unit(benchmark::kMillisecond);
+            }
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#include "benchCommon.h"
+
+namespace
+{
+    const int32_t CONVERT_SIZE = 1024;
+
+    void BM_Convert(benchmark::State& state, int32_t inFormat, int32_t outFormat)
+    {
+        std::vector<uint8_t> src = makeSyntheticImage(CONVERT_SIZE, CONVERT_SIZE, inFormat);
+
+        int32_t numChannels, bytesPerChannel, floatOrInt;
+        AIGetFormatDetails(outFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+        std::vector<uint8_t> dest((size_t)CONVERT_SIZE * CONVERT_SIZE * numChannels * bytesPerChannel);
+
+        for (auto _ : state)
+        {
+            if (AImgConvertFormat(&src[0], &dest[0], CONVERT_SIZE, CONVERT_SIZE, inFormat, outFormat) != AImgErrorCode::AIMG_SUCCESS)
+            {
+                state.SkipWithError("AImgConvertFormat failed");
+                break;
+            }
+
+            benchmark::ClobberMemory();
+        }
+
+        // counted in source pixels, so every pair with the same source is comparable
+        setThroughput(state, CONVERT_SIZE, CONVERT_SIZE, inFormat);
+    }
+}
+
+void registerConvertBenchmarks()
+{
+    const std::vector<int32_t>& formats = getAllFormats();
+
+    for (size_t i = 0; i < formats.size(); i++)
+    {
+        for (size_t j = 0; j < formats.size(); j++)
+        {
+            if (i == j)
+                continue;
+
+            std::string name = "Convert/" + getFormatName(formats[i]) + "_to_" + getFormatName(formats[j]);
+            benchmark::RegisterBenchmark(name.c_str(), &BM_Convert, formats[i], formats[j])->Unit(benchmark::kMillisecond);
+        }
+    }
+}
@@ -0,0 +1,1282 @@
+#include <algorithm>
+#include <cstring>
+
+#include "AIL.h"
+#include "convert.h"
+#include "threadpool.h"
+
+#ifdef HAVE_EXR
+#include <half.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define AIL_CONVERT_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// vdivq_f32 is only available on aarch64, 32-bit arm just uses the scalar path
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define AIL_CONVERT_NEON
+#include <arm_neon.h>
+#endif
+
+// gcc and clang need to be told they're allowed to emit instructions beyond the baseline target for these functions,
+// msvc lets you use any intrinsic anywhere
+#if defined(__GNUC__)
+#define AIL_TARGET_SSE2 __attribute__((target("sse2")))
+#define AIL_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define AIL_TARGET_SSE2
+#define AIL_TARGET_AVX2
+#endif
+
+namespace AImg
+{
+    //////////////////////////////
+    // Scalar reference version //
+    //////////////////////////////
+
+    void convertToRGBA32F(const void* src, float* dest, size_t i, int32_t inFormat)
+    {
+        switch (inFormat)
+        {
+        case AImgFormat::R8U:
+        {
+            const uint8_t* srcF = ((const uint8_t*)src) + (i * 1);
+
+            dest[0] = ((float)srcF[0]) / 255.0f;
+            dest[1] = ((float)srcF[0]) / 255.0f;
+            dest[2] = ((float)srcF[0]) / 255.0f;
+            dest[3] = 1;
+
+            break;
+        }
+
+        case AImgFormat::RG8U:
+        {
+            const uint8_t* srcF = ((const uint8_t*)src) + (i * 2);
+
+            dest[0] = ((float)srcF[0]) / 255.0f;
+            dest[1] = ((float)srcF[1]) / 255.0f;
+            dest[2] = 0;
+            dest[3] = 1;
+
+            break;
+        }
+
+        case AImgFormat::RGB8U:
+        {
+            const uint8_t* srcF = ((const uint8_t*)src) + (i * 3);
+
+            dest[0] = ((float)srcF[0]) / 255.0f;
+            dest[1] = ((float)srcF[1]) / 255.0f;
+            dest[2] = ((float)srcF[2]) / 255.0f;
+            dest[3] = 1;
+
+            break;
+        }
+
+        case AImgFormat::RGBA8U:
+        {
+            const uint8_t* srcF = ((const uint8_t*)src) + (i * 4);
+
+            dest[0] = ((float)srcF[0]) / 255.0f;
+            dest[1] = ((float)srcF[1]) / 255.0f;
+            dest[2] = ((float)srcF[2]) / 255.0f;
+            dest[3] = ((float)srcF[3]) / 255.0f;
+
+            break;
+        }
+
+    #ifdef HAVE_EXR
+        case AImgFormat::R16F:
+        {
+            const half* srcF = ((const half*)src) + (i * 1);
+
+            dest[0] = (float)srcF[0];
+            dest[1] = (float)srcF[0];
+            dest[2] = (float)srcF[0];
+            dest[3] = 1;
+
+            break;
+        }
+
+        case AImgFormat::RG16F:
+        {
+            const half* srcF = ((const half*)src) + (i * 2);
+
+            dest[0] = (float)srcF[0];
+            dest[1] = (float)srcF[1];
+            dest[2] = 0;
+            dest[3] = 1;
+
+            break;
+        }
+
+        case AImgFormat::RGB16F:
+        {
+            const half* srcF = ((const half*)src) + (i * 3);
+
+            dest[0] = (float)srcF[0];
+            dest[1] = (float)srcF[1];
+            dest[2] = (float)srcF[2];
+            dest[3] = 1;
+
+            break;
+        }
+
+        case AImgFormat::RGBA16F:
+        {
+            const half* srcF = ((const half*)src) + (i * 4);
+
+            dest[0] = (float)srcF[0];
+            dest[1] = (float)srcF[1];
+            dest[2] = (float)srcF[2];
+            dest[3] = (float)srcF[3];
+
+            break;
+        }
+    #endif
+
+        case AImgFormat::R16U:
+        {
+            const uint16_t* srcF = ((const uint16_t*)src) + (i * 1);
+
+            dest[0] = ((float)srcF[0]) / 65535.0f;
+            dest[1] = ((float)srcF[0]) / 65535.0f;
+            dest[2] = ((float)srcF[0]) / 65535.0f;
+            dest[3] = 1;
+
+            break;
+        }
+
+        case AImgFormat::RG16U:
+        {
+            const uint16_t* srcF = ((const uint16_t*)src) + (i * 2);
+
+            dest[0] = ((float)srcF[0]) / 65535.0f;
+            dest[1] = ((float)srcF[1]) / 65535.0f;
+            dest[2] = 0;
+            dest[3] = 1;
+
+            break;
+        }
+
+        case AImgFormat::RGB16U:
+        {
+            const uint16_t* srcF = ((const uint16_t*)src) + (i * 3);
+
+            dest[0] = ((float)srcF[0]) / 65535.0f;
+            dest[1] = ((float)srcF[1]) / 65535.0f;
+            dest[2] = ((float)srcF[2]) / 65535.0f;
+            dest[3] = 1;
+
+            break;
+        }
+
+        case AImgFormat::RGBA16U:
+        {
+            const uint16_t* srcF = ((const uint16_t*)src) + (i * 4);
+
+            dest[0] = ((float)srcF[0]) / 65535.0f;
+            dest[1] = ((float)srcF[1]) / 65535.0f;
+            dest[2] = ((float)srcF[2]) / 65535.0f;
+            dest[3] = ((float)srcF[3]) / 65535.0f;
+
+            break;
+        }
+
+        case AImgFormat::R32F:
+        {
+            const float* srcF = ((const float*)src) + (i * 1);
+
+            dest[0] = srcF[0];
+            dest[1] = srcF[0];
+            dest[2] = srcF[0];
+            dest[3] = 1;
+
+            break;
+        }
+
+        case AImgFormat::RG32F:
+        {
+            const float* srcF = ((const float*)src) + (i * 2);
+
+            dest[0] = srcF[0];
+            dest[1] = srcF[1];
+            dest[2] = 0;
+            dest[3] = 1;
+
+            break;
+        }
+
+        case AImgFormat::RGB32F:
+        {
+            const float* srcF = ((const float*)src) + (i * 3);
+
+            dest[0] = srcF[0];
+            dest[1] = srcF[1];
+            dest[2] = srcF[2];
+            dest[3] = 1;
+
+            break;
+        }
+
+        case AImgFormat::RGBA32F:
+        {
+            const float* srcF = ((const float*)src) + (i * 4);
+
+            dest[0] = srcF[0];
+            dest[1] = srcF[1];
+            dest[2] = srcF[2];
+            dest[3] = srcF[3];
+
+            break;
+        }
+
+        default:
+        {
+            break;
+        }
+        }
+    }
+
+    void convertFromRGBA32F(const float* src, void* dst, size_t i, int32_t outFormat)
+    {
+        switch (outFormat)
+        {
+        case AImgFormat::R8U:
+        {
+            uint8_t* dstF = ((uint8_t*)dst) + (i * 1);
+
+            dstF[0] = (uint8_t)(src[0] * 255.0f);
+
+            break;
+        }
+
+        case AImgFormat::RG8U:
+        {
+            uint8_t* dstF = ((uint8_t*)dst) + (i * 2);
+
+            dstF[0] = (uint8_t)(src[0] * 255.0f);
+            dstF[1] = (uint8_t)(src[1] * 255.0f);
+
+            break;
+        }
+
+        case AImgFormat::RGB8U:
+        {
+            uint8_t* dstF = ((uint8_t*)dst) + (i * 3);
+
+            dstF[0] = (uint8_t)(src[0] * 255.0f);
+            dstF[1] = (uint8_t)(src[1] * 255.0f);
+            dstF[2] = (uint8_t)(src[2] * 255.0f);
+
+            break;
+        }
+
+        case AImgFormat::RGBA8U:
+        {
+            uint8_t* dstF = ((uint8_t*)dst) + (i * 4);
+
+            dstF[0] = (uint8_t)(src[0] * 255.0f);
+            dstF[1] = (uint8_t)(src[1] * 255.0f);
+            dstF[2] = (uint8_t)(src[2] * 255.0f);
+            dstF[3] = (uint8_t)(src[3] * 255.0f);
+
+            break;
+        }
+
+    #ifdef HAVE_EXR
+        case AImgFormat::R16F:
+        {
+            half* dstF = ((half*)dst) + (i * 1);
+
+            dstF[0] = src[0];
+
+            break;
+        }
+
+        case AImgFormat::RG16F:
+        {
+            half* dstF = ((half*)dst) + (i * 2);
+
+            dstF[0] = src[0];
+            dstF[1] = src[1];
+
+            break;
+        }
+
+        case AImgFormat::RGB16F:
+        {
+            half* dstF = ((half*)dst) + (i * 3);
+
+            dstF[0] = src[0];
+            dstF[1] = src[1];
+            dstF[2] = src[2];
+
+            break;
+        }
+
+        case AImgFormat::RGBA16F:
+        {
+            half* dstF = ((half*)dst) + (i * 4);
+
+            dstF[0] = src[0];
+            dstF[1] = src[1];
+            dstF[2] = src[2];
+            dstF[3] = src[3];
+
+            break;
+        }
+    #endif
+
+        case AImgFormat::R16U:
+        {
+            uint16_t* dstF = ((uint16_t*)dst) + (i * 1);
+
+            dstF[0] = (uint16_t)(src[0] * 65535.0f);
+
+            break;
+        }
+
+        case AImgFormat::RG16U:
+        {
+            uint16_t* dstF = ((uint16_t*)dst) + (i * 2);
+
+            dstF[0] = (uint16_t)(src[0] * 65535.0f);
+            dstF[1] = (uint16_t)(src[1] * 65535.0f);
+
+            break;
+        }
+
+        case AImgFormat::RGB16U:
+        {
+            uint16_t* dstF = ((uint16_t*)dst) + (i * 3);
+
+            dstF[0] = (uint16_t)(src[0] * 65535.0f);
+            dstF[1] = (uint16_t)(src[1] * 65535.0f);
+            dstF[2] = (uint16_t)(src[2] * 65535.0f);
+
+            break;
+        }
+
+        case AImgFormat::RGBA16U:
+        {
+            uint16_t* dstF = ((uint16_t*)dst) + (i * 4);
+
+            dstF[0] = (uint16_t)(src[0] * 65535.0f);
+            dstF[1] = (uint16_t)(src[1] * 65535.0f);
+            dstF[2] = (uint16_t)(src[2] * 65535.0f);
+            dstF[3] = (uint16_t)(src[3] * 65535.0f);
+
+            break;
+        }
+
+        case AImgFormat::R32F:
+        {
+            float* dstF = ((float*)dst) + (i * 1);
+
+            dstF[0] = src[0];
+
+            break;
+        }
+
+        case AImgFormat::RG32F:
+        {
+            float* dstF = ((float*)dst) + (i * 2);
+
+            dstF[0] = src[0];
+            dstF[1] = src[1];
+
+            break;
+        }
+
+        case AImgFormat::RGB32F:
+        {
+            float* dstF = ((float*)dst) + (i * 3);
+
+            dstF[0] = src[0];
+            dstF[1] = src[1];
+            dstF[2] = src[2];
+
+            break;
+        }
+
+        case AImgFormat::RGBA32F:
+        {
+            float* dstF = ((float*)dst) + (i * 4);
+
+            dstF[0] = src[0];
+            dstF[1] = src[1];
+            dstF[2] = src[2];
+            dstF[3] = src[3];
+
+            break;
+        }
+
+        default:
+        {
+            break;
+        }
+        }
+    }
+
+    void convertPixelsScalar(const void* src, void* dest, size_t count, int32_t inFormat, int32_t outFormat)
+    {
+        float scratch[4];
+
+        int32_t _, floatOrInt;
+        AIGetFormatDetails(inFormat, &_, &_, &floatOrInt);
+        bool inIsFloat = floatOrInt == AImgFloatOrIntType::FITYPE_FLOAT;
+        AIGetFormatDetails(outFormat, &_, &_, &floatOrInt);
+        bool outIsFloat = floatOrInt == AImgFloatOrIntType::FITYPE_FLOAT;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            convertToRGBA32F(src, scratch, i, inFormat);
+
+            // clamp to 0-1 range
+            if (inIsFloat && !outIsFloat)
+            {
+                scratch[0] = std::min(1.0f, std::max(0.0f, scratch[0]));
+                scratch[1] = std::min(1.0f, std::max(0.0f, scratch[1]));
+                scratch[2] = std::min(1.0f, std::max(0.0f, scratch[2]));
+                scratch[3] = std::min(1.0f, std::max(0.0f, scratch[3]));
+            }
+
+            convertFromRGBA32F(scratch, dest, i, outFormat);
+        }
+    }
+
+    /////////////////////////
+    // Vectorised versions //
+    /////////////////////////
+
+    // The vectorised path works on blocks of pixels. Each block is widened to float (one value per channel, no RGBA expansion),
+    // shuffled into the output channel layout, clamped if needed, then narrowed to the output type.
+    // Only the widen, clamp and narrow steps are arithmetic, so those are the parts with per-instruction-set kernels.
+    // They do exactly the same float operations as the scalar path (divide to normalise, multiply and truncate to
+    // denormalise), so the results are bit-identical.
+
+    struct ConvertKernelSet
+    {
+        void(*u8ToFloat)(const uint8_t* src, float* dest, size_t count);
+        void(*u16ToFloat)(const uint16_t* src, float* dest, size_t count);
+        void(*clamp01)(float* data, size_t count);
+        void(*floatToU8)(const float* src, uint8_t* dest, size_t count);
+        void(*floatToU16)(const float* src, uint16_t* dest, size_t count);
+    };
+
+    namespace ScalarTails
+    {
+        inline void u8ToFloat(const uint8_t* src, float* dest, size_t i, size_t count)
+        {
+            for (; i < count; i++)
+                dest[i] = ((float)src[i]) / 255.0f;
+        }
+
+        inline void u16ToFloat(const uint16_t* src, float* dest, size_t i, size_t count)
+        {
+            for (; i < count; i++)
+                dest[i] = ((float)src[i]) / 65535.0f;
+        }
+
+        inline void clamp01(float* data, size_t i, size_t count)
+        {
+            for (; i < count; i++)
+                data[i] = std::min(1.0f, std::max(0.0f, data[i]));
+        }
+
+        inline void floatToU8(const float* src, uint8_t* dest, size_t i, size_t count)
+        {
+            for (; i < count; i++)
+                dest[i] = (uint8_t)(src[i] * 255.0f);
+        }
+
+        inline void floatToU16(const float* src, uint16_t* dest, size_t i, size_t count)
+        {
+            for (; i < count; i++)
+                dest[i] = (uint16_t)(src[i] * 65535.0f);
+        }
+    }
+
+#ifdef AIL_CONVERT_X86
+    namespace SSE2Kernels
+    {
+        AIL_TARGET_SSE2 void u8ToFloat(const uint8_t* src, float* dest, size_t count)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128 scale = _mm_set1_ps(255.0f);
+
+            size_t i = 0;
+            for (; i + 16 <= count; i += 16)
+            {
+                __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+                __m128i lo = _mm_unpacklo_epi8(v, zero);
+                __m128i hi = _mm_unpackhi_epi8(v, zero);
+
+                _mm_storeu_ps(dest + i + 0, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+                _mm_storeu_ps(dest + i + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+                _mm_storeu_ps(dest + i + 8, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+                _mm_storeu_ps(dest + i + 12, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+            }
+
+            ScalarTails::u8ToFloat(src, dest, i, count);
+        }
+
+        AIL_TARGET_SSE2 void u16ToFloat(const uint16_t* src, float* dest, size_t count)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128 scale = _mm_set1_ps(65535.0f);
+
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+
+                _mm_storeu_ps(dest + i + 0, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), scale));
+                _mm_storeu_ps(dest + i + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)), scale));
+            }
+
+            ScalarTails::u16ToFloat(src, dest, i, count);
+        }
+
+        AIL_TARGET_SSE2 void clamp01(float* data, size_t count)
+        {
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 one = _mm_set1_ps(1.0f);
+
+            // operand order matters here, maxps/minps return the second operand for NaNs and signed zeroes,
+            // which is what std::max(0.0f, x) and std::min(1.0f, x) do as well
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4)
+                _mm_storeu_ps(data + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(data + i), zero), one));
+
+            ScalarTails::clamp01(data, i, count);
+        }
+
+        AIL_TARGET_SSE2 void floatToU8(const float* src, uint8_t* dest, size_t count)
+        {
+            const __m128 scale = _mm_set1_ps(255.0f);
+
+            size_t i = 0;
+            for (; i + 16 <= count; i += 16)
+            {
+                __m128i a = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 0), scale));
+                __m128i b = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale));
+                __m128i c = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 8), scale));
+                __m128i d = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 12), scale));
+
+                _mm_storeu_si128((__m128i*)(dest + i), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+            }
+
+            ScalarTails::floatToU8(src, dest, i, count);
+        }
+
+        AIL_TARGET_SSE2 void floatToU16(const float* src, uint16_t* dest, size_t count)
+        {
+            const __m128 scale = _mm_set1_ps(65535.0f);
+
+            // no unsigned 32->16 pack in sse2, so bias into signed range, pack, and flip the top bit back
+            const __m128i bias32 = _mm_set1_epi32(32768);
+            const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                __m128i a = _mm_sub_epi32(_mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 0), scale)), bias32);
+                __m128i b = _mm_sub_epi32(_mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale)), bias32);
+
+                _mm_storeu_si128((__m128i*)(dest + i), _mm_xor_si128(_mm_packs_epi32(a, b), bias16));
+            }
+
+            ScalarTails::floatToU16(src, dest, i, count);
+        }
+    }
+
+    namespace AVX2Kernels
+    {
+        AIL_TARGET_AVX2 void u8ToFloat(const uint8_t* src, float* dest, size_t count)
+        {
+            const __m256 scale = _mm256_set1_ps(255.0f);
+
+            size_t i = 0;
+            for (; i + 16 <= count; i += 16)
+            {
+                __m256i a = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i + 0)));
+                __m256i b = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i + 8)));
+
+                _mm256_storeu_ps(dest + i + 0, _mm256_div_ps(_mm256_cvtepi32_ps(a), scale));
+                _mm256_storeu_ps(dest + i + 8, _mm256_div_ps(_mm256_cvtepi32_ps(b), scale));
+            }
+
+            ScalarTails::u8ToFloat(src, dest, i, count);
+        }
+
+        AIL_TARGET_AVX2 void u16ToFloat(const uint16_t* src, float* dest, size_t count)
+        {
+            const __m256 scale = _mm256_set1_ps(65535.0f);
+
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                __m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+                _mm256_storeu_ps(dest + i, _mm256_div_ps(_mm256_cvtepi32_ps(v), scale));
+            }
+
+            ScalarTails::u16ToFloat(src, dest, i, count);
+        }
+
+        AIL_TARGET_AVX2 void clamp01(float* data, size_t count)
+        {
+            const __m256 zero = _mm256_setzero_ps();
+            const __m256 one = _mm256_set1_ps(1.0f);
+
+            // see the sse2 version for why the operand order matters
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8)
+                _mm256_storeu_ps(data + i, _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(data + i), zero), one));
+
+            ScalarTails::clamp01(data, i, count);
+        }
+
+        AIL_TARGET_AVX2 void floatToU8(const float* src, uint8_t* dest, size_t count)
+        {
+            const __m256 scale = _mm256_set1_ps(255.0f);
+
+            size_t i = 0;
+            for (; i + 16 <= count; i += 16)
+            {
+                __m256i a = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_loadu_ps(src + i + 0), scale));
+                __m256i b = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_loadu_ps(src + i + 8), scale));
+
+                // the 256-bit packs work per 128-bit lane, so pack the halves with the 128-bit versions to keep the order simple
+                __m128i a16 = _mm_packs_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+                __m128i b16 = _mm_packs_epi32(_mm256_castsi256_si128(b), _mm256_extracti128_si256(b, 1));
+
+                _mm_storeu_si128((__m128i*)(dest + i), _mm_packus_epi16(a16, b16));
+            }
+
+            ScalarTails::floatToU8(src, dest, i, count);
+        }
+
+        AIL_TARGET_AVX2 void floatToU16(const float* src, uint16_t* dest, size_t count)
+        {
+            const __m256 scale = _mm256_set1_ps(65535.0f);
+
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                __m256i v = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_loadu_ps(src + i), scale));
+                _mm_storeu_si128((__m128i*)(dest + i), _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+            }
+
+            ScalarTails::floatToU16(src, dest, i, count);
+        }
+    }
+#endif // AIL_CONVERT_X86
+
+#ifdef AIL_CONVERT_NEON
+    namespace NEONKernels
+    {
+        void u8ToFloat(const uint8_t* src, float* dest, size_t count)
+        {
+            const float32x4_t scale = vdupq_n_f32(255.0f);
+
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                uint16x8_t v = vmovl_u8(vld1_u8(src + i));
+
+                vst1q_f32(dest + i + 0, vdivq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(v))), scale));
+                vst1q_f32(dest + i + 4, vdivq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(v))), scale));
+            }
+
+            ScalarTails::u8ToFloat(src, dest, i, count);
+        }
+
+        void u16ToFloat(const uint16_t* src, float* dest, size_t count)
+        {
+            const float32x4_t scale = vdupq_n_f32(65535.0f);
+
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                uint16x8_t v = vld1q_u16(src + i);
+
+                vst1q_f32(dest + i + 0, vdivq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(v))), scale));
+                vst1q_f32(dest + i + 4, vdivq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(v))), scale));
+            }
+
+            ScalarTails::u16ToFloat(src, dest, i, count);
+        }
+
+        void clamp01(float* data, size_t count)
+        {
+            const float32x4_t zero = vdupq_n_f32(0.0f);
+            const float32x4_t one = vdupq_n_f32(1.0f);
+
+            // vmaxq/vminq propagate NaNs, so use compare+select to match std::max(0.0f, x) and std::min(1.0f, x)
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4)
+            {
+                float32x4_t v = vld1q_f32(data + i);
+                v = vbslq_f32(vcltq_f32(zero, v), v, zero);
+                v = vbslq_f32(vcltq_f32(v, one), v, one);
+                vst1q_f32(data + i, v);
+            }
+
+            ScalarTails::clamp01(data, i, count);
+        }
+
+        void floatToU8(const float* src, uint8_t* dest, size_t count)
+        {
+            const float32x4_t scale = vdupq_n_f32(255.0f);
+
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                uint32x4_t a = vcvtq_u32_f32(vmulq_f32(vld1q_f32(src + i + 0), scale));
+                uint32x4_t b = vcvtq_u32_f32(vmulq_f32(vld1q_f32(src + i + 4), scale));
+
+                vst1_u8(dest + i, vmovn_u16(vcombine_u16(vmovn_u32(a), vmovn_u32(b))));
+            }
+
+            ScalarTails::floatToU8(src, dest, i, count);
+        }
+
+        void floatToU16(const float* src, uint16_t* dest, size_t count)
+        {
+            const float32x4_t scale = vdupq_n_f32(65535.0f);
+
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                uint32x4_t a = vcvtq_u32_f32(vmulq_f32(vld1q_f32(src + i + 0), scale));
+                uint32x4_t b = vcvtq_u32_f32(vmulq_f32(vld1q_f32(src + i + 4), scale));
+
+                vst1q_u16(dest + i, vcombine_u16(vmovn_u32(a), vmovn_u32(b)));
+            }
+
+            ScalarTails::floatToU16(src, dest, i, count);
+        }
+    }
+#endif // AIL_CONVERT_NEON
+
+    bool getConvertKernelSet(ConvertKernelLevel level, ConvertKernelSet& kernels)
+    {
+        switch (level)
+        {
+#ifdef AIL_CONVERT_X86
+        case CONVERT_KERNEL_SSE2:
+        {
+            kernels.u8ToFloat = SSE2Kernels::u8ToFloat;
+            kernels.u16ToFloat = SSE2Kernels::u16ToFloat;
+            kernels.clamp01 = SSE2Kernels::clamp01;
+            kernels.floatToU8 = SSE2Kernels::floatToU8;
+            kernels.floatToU16 = SSE2Kernels::floatToU16;
+            return true;
+        }
+
+        case CONVERT_KERNEL_AVX2:
+        {
+            kernels.u8ToFloat = AVX2Kernels::u8ToFloat;
+            kernels.u16ToFloat = AVX2Kernels::u16ToFloat;
+            kernels.clamp01 = AVX2Kernels::clamp01;
+            kernels.floatToU8 = AVX2Kernels::floatToU8;
+            kernels.floatToU16 = AVX2Kernels::floatToU16;
+            return true;
+        }
+#endif
+
+#ifdef AIL_CONVERT_NEON
+        case CONVERT_KERNEL_NEON:
+        {
+            kernels.u8ToFloat = NEONKernels::u8ToFloat;
+            kernels.u16ToFloat = NEONKernels::u16ToFloat;
+            kernels.clamp01 = NEONKernels::clamp01;
+            kernels.floatToU8 = NEONKernels::floatToU8;
+            kernels.floatToU16 = NEONKernels::floatToU16;
+            return true;
+        }
+#endif
+
+        default:
+            return false;
+        }
+    }
+
+    // Number of pixels converted per block in the vectorised path. Two blocks of RGBA32F fit comfortably in L1.
+    const size_t CONVERT_BLOCK_SIZE = 256;
+
+    void widenToFloat(const ConvertKernelSet& kernels, const void* src, float* dest, size_t valueCount, int32_t bytesPerChannel, bool isFloat)
+    {
+        if (isFloat && bytesPerChannel == 4)
+        {
+            memcpy(dest, src, valueCount * sizeof(float));
+        }
+#ifdef HAVE_EXR
+        else if (isFloat && bytesPerChannel == 2)
+        {
+            const half* srcF = (const half*)src;
+            for (size_t i = 0; i < valueCount; i++)
+                dest[i] = (float)srcF[i];
+        }
+#endif
+        else if (bytesPerChannel == 2)
+        {
+            kernels.u16ToFloat((const uint16_t*)src, dest, valueCount);
+        }
+        else
+        {
+            kernels.u8ToFloat((const uint8_t*)src, dest, valueCount);
+        }
+    }
+
+    void narrowFromFloat(const ConvertKernelSet& kernels, const float* src, void* dest, size_t valueCount, int32_t bytesPerChannel, bool isFloat)
+    {
+        if (isFloat && bytesPerChannel == 4)
+        {
+            memcpy(dest, src, valueCount * sizeof(float));
+        }
+#ifdef HAVE_EXR
+        else if (isFloat && bytesPerChannel == 2)
+        {
+            half* destF = (half*)dest;
+            for (size_t i = 0; i < valueCount; i++)
+                destF[i] = src[i];
+        }
+#endif
+        else if (bytesPerChannel == 2)
+        {
+            kernels.floatToU16(src, (uint16_t*)dest, valueCount);
+        }
+        else
+        {
+            kernels.floatToU8(src, (uint8_t*)dest, valueCount);
+        }
+    }
+
+    // Rearranges widened values from inChannels per pixel to outChannels per pixel, filling in the
+    // same values the scalar path gets from its RGBA intermediate (grey replicated to RGB, blue 0, alpha 1)
+    void shuffleChannels(const float* src, float* dest, size_t count, int32_t inChannels, int32_t outChannels)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            const float* s = src + i * inChannels;
+            float* d = dest + i * outChannels;
+
+            for (int32_t c = 0; c < outChannels; c++)
+            {
+                if (c < inChannels)
+                    d[c] = s[c];
+                else if (c == 3)
+                    d[c] = 1.0f;
+                else if (inChannels == 1)
+                    d[c] = s[0];
+                else
+                    d[c] = 0.0f;
+            }
+        }
+    }
+
+    void convertPixelsVectorised(const ConvertKernelSet& kernels, const void* src, void* dest, size_t count, int32_t inFormat, int32_t outFormat)
+    {
+        int32_t inChannels, inBytesPerChannel, inFloatOrInt;
+        AIGetFormatDetails(inFormat, &inChannels, &inBytesPerChannel, &inFloatOrInt);
+        int32_t outChannels, outBytesPerChannel, outFloatOrInt;
+        AIGetFormatDetails(outFormat, &outChannels, &outBytesPerChannel, &outFloatOrInt);
+
+        bool inIsFloat = inFloatOrInt == AImgFloatOrIntType::FITYPE_FLOAT;
+        bool outIsFloat = outFloatOrInt == AImgFloatOrIntType::FITYPE_FLOAT;
+
+        float widened[CONVERT_BLOCK_SIZE * 4];
+        float shuffled[CONVERT_BLOCK_SIZE * 4];
+
+        const uint8_t* srcPtr = (const uint8_t*)src;
+        uint8_t* destPtr = (uint8_t*)dest;
+
+        for (size_t start = 0; start < count; start += CONVERT_BLOCK_SIZE)
+        {
+            size_t blockCount = std::min(CONVERT_BLOCK_SIZE, count - start);
+
+            widenToFloat(kernels, srcPtr + start * inChannels * inBytesPerChannel, widened, blockCount * inChannels, inBytesPerChannel, inIsFloat);
+
+            float* outValues = widened;
+            if (inChannels != outChannels)
+            {
+                shuffleChannels(widened, shuffled, blockCount, inChannels, outChannels);
+                outValues = shuffled;
+            }
+
+            if (inIsFloat && !outIsFloat)
+                kernels.clamp01(outValues, blockCount * outChannels);
+
+            narrowFromFloat(kernels, outValues, destPtr + start * outChannels * outBytesPerChannel, blockCount * outChannels, outBytesPerChannel, outIsFloat);
+        }
+    }
+
+    ///////////////////////////////
+    // Direct conversion kernels //
+    ///////////////////////////////
+
+    // Conversions that don't need the RGBA32F intermediate at all: integer formats to integer formats, and channel
+    // count changes within the same float type. These are generated from templates, one kernel per (inFormat, outFormat)
+    // pair, and looked up in a table indexed by the format flags.
+    // The integer scaling used here (x * 257 to widen, x / 257 to narrow) is exactly what the float path produces for
+    // every input value, so the output is bit-identical to it.
+
+    namespace DirectConvert
+    {
+        struct U8Tag { typedef uint8_t Storage; };
+        struct U16Tag { typedef uint16_t Storage; };
+        struct F16Tag { typedef uint16_t Storage; }; // half floats are only ever copied here, so the raw bits are enough
+        struct F32Tag { typedef float Storage; };
+
+        // Table index for a format is kind * 4 + (channels - 1), with kinds in this order
+        template <int Kind> struct KindTag;
+        template <> struct KindTag<0> { typedef U8Tag Type; };
+        template <> struct KindTag<1> { typedef U16Tag Type; };
+        template <> struct KindTag<2> { typedef F16Tag Type; };
+        template <> struct KindTag<3> { typedef F32Tag Type; };
+
+        const int FORMAT_COUNT = 16;
+
+        int32_t getFormatIndex(int32_t format)
+        {
+            int32_t numChannels, bytesPerChannel, floatOrInt;
+            AIGetFormatDetails(format, &numChannels, &bytesPerChannel, &floatOrInt);
+
+            if (numChannels < 1)
+                return -1;
+
+            int32_t kind;
+            if (floatOrInt == AImgFloatOrIntType::FITYPE_FLOAT)
+                kind = (format & AImgFormat::_32BITS) ? 3 : 2;
+            else
+                kind = (format & AImgFormat::_16BITS) ? 1 : 0;
+
+            return kind * 4 + (numChannels - 1);
+        }
+
+        // Per-channel value conversion, only defined for the pairs that have a direct path
+        template <typename InTag, typename OutTag> struct ChannelConverter
+        {
+            static const bool Exists = false;
+        };
+
+        template <typename Tag> struct IdentityConverter
+        {
+            static const bool Exists = true;
+            static typename Tag::Storage convert(typename Tag::Storage v) { return v; }
+        };
+
+        template <> struct ChannelConverter<U8Tag, U8Tag> : IdentityConverter<U8Tag> {};
+        template <> struct ChannelConverter<U16Tag, U16Tag> : IdentityConverter<U16Tag> {};
+        template <> struct ChannelConverter<F16Tag, F16Tag> : IdentityConverter<F16Tag> {};
+        template <> struct ChannelConverter<F32Tag, F32Tag> : IdentityConverter<F32Tag> {};
+
+        template <> struct ChannelConverter<U8Tag, U16Tag>
+        {
+            static const bool Exists = true;
+            static uint16_t convert(uint8_t v) { return (uint16_t)(v * 257); }
+        };
+
+        template <> struct ChannelConverter<U16Tag, U8Tag>
+        {
+            static const bool Exists = true;
+            static uint8_t convert(uint16_t v) { return (uint8_t)(v / 257); }
+        };
+
+        // Values for the channels the input doesn't have (blue is 0, alpha is fully opaque)
+        template <typename Tag> struct ChannelDefaults;
+        template <> struct ChannelDefaults<U8Tag> { static uint8_t zero() { return 0; } static uint8_t one() { return 0xFF; } };
+        template <> struct ChannelDefaults<U16Tag> { static uint16_t zero() { return 0; } static uint16_t one() { return 0xFFFF; } };
+        template <> struct ChannelDefaults<F16Tag> { static uint16_t zero() { return 0; } static uint16_t one() { return 0x3C00; } };
+        template <> struct ChannelDefaults<F32Tag> { static float zero() { return 0.0f; } static float one() { return 1.0f; } };
+
+        template <typename InTag, int InChannels, typename OutTag, int OutChannels>
+        void convertKernel(const void* src, void* dest, size_t count)
+        {
+            typedef ChannelConverter<InTag, OutTag> Converter;
+
+            const typename InTag::Storage* s = (const typename InTag::Storage*)src;
+            typename OutTag::Storage* d = (typename OutTag::Storage*)dest;
+
+            for (size_t i = 0; i < count; i++, s += InChannels, d += OutChannels)
+            {
+                // InChannels and OutChannels are constants, so this whole loop unrolls into straight copies
+                for (int c = 0; c < OutChannels; c++)
+                {
+                    if (c < InChannels)
+                        d[c] = Converter::convert(s[c]);
+                    else if (c == 3)
+                        d[c] = ChannelDefaults<OutTag>::one();
+                    else if (InChannels == 1)
+                        d[c] = Converter::convert(s[0]); // greyscale goes to all colour channels
+                    else
+                        d[c] = ChannelDefaults<OutTag>::zero();
+                }
+            }
+        }
+
+        typedef void(*KernelFunc)(const void* src, void* dest, size_t count);
+
+        template <int InIndex, int OutIndex,
+            bool Exists = ChannelConverter<typename KindTag<InIndex / 4>::Type, typename KindTag<OutIndex / 4>::Type>::Exists>
+        struct KernelFor
+        {
+            static KernelFunc get()
+            {
+                return &convertKernel<typename KindTag<InIndex / 4>::Type, (InIndex % 4) + 1, typename KindTag<OutIndex / 4>::Type, (OutIndex % 4) + 1>;
+            }
+        };
+
+        template <int InIndex, int OutIndex>
+        struct KernelFor<InIndex, OutIndex, false>
+        {
+            static KernelFunc get() { return NULL; }
+        };
+
+        template <int N>
+        struct TableFiller
+        {
+            static void fill(KernelFunc* table)
+            {
+                table[N - 1] = KernelFor<(N - 1) / FORMAT_COUNT, (N - 1) % FORMAT_COUNT>::get();
+                TableFiller<N - 1>::fill(table);
+            }
+        };
+
+        template <>
+        struct TableFiller<0>
+        {
+            static void fill(KernelFunc*) {}
+        };
+
+        struct KernelTable
+        {
+            KernelFunc kernels[FORMAT_COUNT * FORMAT_COUNT];
+
+            KernelTable()
+            {
+                TableFiller<FORMAT_COUNT * FORMAT_COUNT>::fill(kernels);
+            }
+        };
+
+        KernelFunc getKernel(int32_t inFormat, int32_t outFormat)
+        {
+            static const KernelTable table;
+
+            int32_t inIndex = getFormatIndex(inFormat);
+            int32_t outIndex = getFormatIndex(outFormat);
+
+            if (inIndex < 0 || outIndex < 0)
+                return NULL;
+
+            return table.kernels[inIndex * FORMAT_COUNT + outIndex];
+        }
+    }
+
+    bool hasDirectConversion(int32_t inFormat, int32_t outFormat)
+    {
+        return DirectConvert::getKernel(inFormat, outFormat) != NULL;
+    }
+
+    bool convertPixelsDirect(const void* src, void* dest, size_t count, int32_t inFormat, int32_t outFormat)
+    {
+        DirectConvert::KernelFunc kernel = DirectConvert::getKernel(inFormat, outFormat);
+        if (kernel == NULL)
+            return false;
+
+        if (inFormat == outFormat)
+        {
+            int32_t numChannels, bytesPerChannel, floatOrInt;
+            AIGetFormatDetails(inFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+            memcpy(dest, src, count * numChannels * bytesPerChannel);
+        }
+        else
+        {
+            kernel(src, dest, count);
+        }
+
+        return true;
+    }
+
+    //////////////////////
+    // Runtime dispatch //
+    //////////////////////
+
+    ConvertKernelLevel detectBestConvertKernelLevel()
+    {
+#if defined(AIL_CONVERT_X86) && defined(__GNUC__)
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx2"))
+            return CONVERT_KERNEL_AVX2;
+        if (__builtin_cpu_supports("sse2"))
+            return CONVERT_KERNEL_SSE2;
+#elif defined(AIL_CONVERT_X86) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        int maxLeaf = info[0];
+
+        __cpuid(info, 1);
+        bool hasSse2 = (info[3] & (1 << 26)) != 0;
+        bool hasOsxsave = (info[2] & (1 << 27)) != 0;
+        bool hasAvx = (info[2] & (1 << 28)) != 0;
+
+        // avx2 also needs the os to save the ymm registers on context switch
+        if (maxLeaf >= 7 && hasOsxsave && hasAvx && (_xgetbv(0) & 6) == 6)
+        {
+            __cpuidex(info, 7, 0);
+            if (info[1] & (1 << 5))
+                return CONVERT_KERNEL_AVX2;
+        }
+
+        if (hasSse2)
+            return CONVERT_KERNEL_SSE2;
+#elif defined(AIL_CONVERT_NEON)
+        // neon is mandatory on aarch64
+        return CONVERT_KERNEL_NEON;
+#endif
+
+        return CONVERT_KERNEL_SCALAR;
+    }
+
+    ConvertKernelLevel getBestConvertKernelLevel()
+    {
+        static const ConvertKernelLevel bestLevel = detectBestConvertKernelLevel();
+        return bestLevel;
+    }
+
+    bool isConvertKernelLevelSupported(ConvertKernelLevel level)
+    {
+        if (level == CONVERT_KERNEL_SCALAR)
+            return true;
+
+        ConvertKernelSet kernels;
+        if (!getConvertKernelSet(level, kernels))
+            return false;
+
+        // levels on the same architecture are ordered, so anything at or below the best one works
+        return level <= getBestConvertKernelLevel();
+    }
+
+    void convertPixels(const void* src, void* dest, size_t count, int32_t inFormat, int32_t outFormat, ConvertKernelLevel level)
+    {
+        int32_t inChannels, outChannels, _;
+        AIGetFormatDetails(inFormat, &inChannels, &_, &_);
+        AIGetFormatDetails(outFormat, &outChannels, &_, &_);
+
+        ConvertKernelSet kernels;
+        if (inChannels > 0 && outChannels > 0 && getConvertKernelSet(level, kernels))
+            convertPixelsVectorised(kernels, src, dest, count, inFormat, outFormat);
+        else
+            convertPixelsScalar(src, dest, count, inFormat, outFormat);
+    }
+
+    // Images smaller than this are converted on the calling thread, as waking up the pool would cost more than it saves
+    const size_t PARALLEL_CONVERT_MIN_PIXELS = 256 * 256;
+
+    // Rough amount of input plus output data in one band, so each band's working set stays in a core's L2 cache
+    const size_t CONVERT_BAND_BYTES = 256 * 1024;
+
+    void convertImage(const void* src, void* dest, int32_t width, int32_t height, int32_t inFormat, int32_t outFormat)
+    {
+        size_t count = (size_t)width * (size_t)height;
+
+        if (count < PARALLEL_CONVERT_MIN_PIXELS)
+        {
+            if (!convertPixelsDirect(src, dest, count, inFormat, outFormat))
+                convertPixels(src, dest, count, inFormat, outFormat, getBestConvertKernelLevel());
+
+            return;
+        }
+
+        int32_t inChannels, inBytesPerChannel, outChannels, outBytesPerChannel, _;
+        AIGetFormatDetails(inFormat, &inChannels, &inBytesPerChannel, &_);
+        AIGetFormatDetails(outFormat, &outChannels, &outBytesPerChannel, &_);
+
+        size_t inRowSize = (size_t)width * inChannels * inBytesPerChannel;
+        size_t outRowSize = (size_t)width * outChannels * outBytesPerChannel;
+
+        size_t rowsPerBand = std::max((size_t)1, CONVERT_BAND_BYTES / (inRowSize + outRowSize));
+        size_t bandCount = (height + rowsPerBand - 1) / rowsPerBand;
+
+        bool direct = hasDirectConversion(inFormat, outFormat);
+        ConvertKernelLevel level = getBestConvertKernelLevel();
+
+        getThreadPool()->parallelFor(bandCount, [&](size_t band)
+        {
+            size_t firstRow = band * rowsPerBand;
+            size_t bandPixels = std::min(rowsPerBand, height - firstRow) * width;
+
+            const uint8_t* bandSrc = (const uint8_t*)src + firstRow * inRowSize;
+            uint8_t* bandDest = (uint8_t*)dest + firstRow * outRowSize;
+
+            if (direct)
+                convertPixelsDirect(bandSrc, bandDest, bandPixels, inFormat, outFormat);
+            else
+                convertPixels(bandSrc, bandDest, bandPixels, inFormat, outFormat, level);
+        });
+    }
+
+    int32_t getDecodeBandRows(int32_t width, int32_t format)
+    {
+        int32_t numChannels, bytesPerChannel, floatOrInt;
+        AIGetFormatDetails(format, &numChannels, &bytesPerChannel, &floatOrInt);
+
+        size_t rowSize = (size_t)width * numChannels * bytesPerChannel;
+        if (rowSize == 0)
+            return 1;
+
+        return (int32_t)std::max((size_t)1, CONVERT_BAND_BYTES / rowSize);
+    }
+
+    int32_t convertRows(const void* src, size_t srcStride, void* dest, size_t destStride, int32_t width, int32_t numRows, int32_t inFormat, int32_t outFormat)
+    {
+        int32_t numChannels, bytesPerChannel, floatOrInt;
+
+        AIGetFormatDetails(inFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+        size_t srcRowSize = (size_t)width * numChannels * bytesPerChannel;
+
+        AIGetFormatDetails(outFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+        size_t destRowSize = (size_t)width * numChannels * bytesPerChannel;
+
+        // packed rows can go in one call, which lets big conversions use the thread pool
+        if (srcStride == srcRowSize && destStride == destRowSize)
+        {
+            if (inFormat == outFormat)
+            {
+                memcpy(dest, src, srcRowSize * numRows);
+                return AImgErrorCode::AIMG_SUCCESS;
+            }
+
+            return AImgConvertFormat((void*)src, dest, width, numRows, inFormat, outFormat);
+        }
+
+        for (int32_t y = 0; y < numRows; y++)
+        {
+            const uint8_t* srcRow = (const uint8_t*)src + y * srcStride;
+            uint8_t* destRow = (uint8_t*)dest + y * destStride;
+
+            if (inFormat == outFormat)
+            {
+                memcpy(destRow, srcRow, srcRowSize);
+            }
+            else
+            {
+                int32_t err = AImgConvertFormat((void*)srcRow, destRow, width, 1, inFormat, outFormat);
+                if (err != AImgErrorCode::AIMG_SUCCESS)
+                    return err;
+            }
+        }
+
+        return AImgErrorCode::AIMG_SUCCESS;
+    }
+}
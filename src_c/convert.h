@@ -0,0 +1,46 @@
+#ifndef ARTOMATIX_CONVERT_H
+#define ARTOMATIX_CONVERT_H
+
+#include <stddef.h>
+
+#include "AIL.h"
+
+namespace AImg
+{
+    // Instruction set used for a run of pixel format conversions.
+    // CONVERT_KERNEL_SCALAR is the reference implementation, the others must produce bit-identical output to it.
+    enum ConvertKernelLevel
+    {
+        CONVERT_KERNEL_SCALAR = 0,
+        CONVERT_KERNEL_SSE2 = 1,
+        CONVERT_KERNEL_AVX2 = 2,
+        CONVERT_KERNEL_NEON = 3
+    };
+
+    // Best level the cpu we are running on supports, detected once on first call
+    EXPORT_FUNC ConvertKernelLevel getBestConvertKernelLevel();
+    EXPORT_FUNC bool isConvertKernelLevelSupported(ConvertKernelLevel level);
+
+    // Converts count contiguous pixels (a row, or a block of tightly packed rows) from inFormat to outFormat.
+    // Both formats must be valid, and the 16F formats are only available when compiled with EXR support.
+    EXPORT_FUNC void convertPixels(const void* src, void* dest, size_t count, int32_t inFormat, int32_t outFormat, ConvertKernelLevel level);
+
+    // Some conversions (integer to integer, or float to the same float type with a different channel count) can be done
+    // without going through float at all. convertPixelsDirect returns false without touching dest if there is no direct
+    // path for this pair, otherwise it converts and gives the same result as convertPixels.
+    EXPORT_FUNC bool hasDirectConversion(int32_t inFormat, int32_t outFormat);
+    EXPORT_FUNC bool convertPixelsDirect(const void* src, void* dest, size_t count, int32_t inFormat, int32_t outFormat);
+
+    // Converts a whole image with the best available path, split into row bands across the library thread pool
+    void convertImage(const void* src, void* dest, int32_t width, int32_t height, int32_t inFormat, int32_t outFormat);
+
+    // How many rows of the given width and format a decoder should stage at a time when it converts to a forced format
+    // as it goes, rather than decoding the whole image into a temporary buffer first. Always at least 1.
+    int32_t getDecodeBandRows(int32_t width, int32_t format);
+
+    // Copies or converts numRows rows between two buffers whose rows may be padded, as given by the strides in bytes.
+    // Returns an AImgErrorCode, as AImgConvertFormat does.
+    int32_t convertRows(const void* src, size_t srcStride, void* dest, size_t destStride, int32_t width, int32_t numRows, int32_t inFormat, int32_t outFormat);
+}
+
+#endif // ARTOMATIX_CONVERT_H
@@ -3,8 +3,10 @@
 #include <ImfInputFile.h>
 #include <ImfOutputFile.h>
 #include <ImfChannelList.h>
+#include <ImfCompression.h>
 #include <ImathBox.h>
 #include <ImfIO.h>
+#include <Iex.h>
 
 #include <stdint.h>
 #include <vector>
@@ -14,6 +16,10 @@
 
 #include "AIL.h"
 #include "AIL_internal.h"
+#include "convert.h"
+#include "probe.h"
+#include "scratch.h"
+#include "trace.h"
 #include "exr.h"
 
 namespace AImg
@@ -21,12 +27,21 @@ namespace AImg
     class CallbackIStream : public Imf::IStream
     {
     public:
-        CallbackIStream(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData) : IStream("")
+        CallbackIStream(ReadCallback64 readCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void *callbackData) : IStream("")
         {
             mReadCallback = readCallback;
             mTellCallback = tellCallback;
             mSeekCallback = seekCallback;
             mCallbackData = callbackData;
+            mStartPos = tellCallback(callbackData);
+
+            const uint8_t *inMemoryData = nullptr;
+            int64_t inMemorySize = 0;
+            if (getInMemoryData(readCallback, callbackData, &inMemoryData, &inMemorySize))
+            {
+                mInMemoryData = (char *)inMemoryData;
+                mInMemorySize = inMemorySize;
+            }
         }
 
         virtual bool read(char c[], int n)
@@ -34,35 +49,59 @@ namespace AImg
             return mReadCallback(mCallbackData, (uint8_t *)c, n) == n;
         }
 
+        // When the input is already in memory, OpenEXR reads pixel data through readMemoryMapped instead of copying it out with read
+        virtual bool isMemoryMapped() const
+        {
+            return mInMemoryData != nullptr;
+        }
+
+        virtual char *readMemoryMapped(int n)
+        {
+            int64_t pos = mTellCallback(mCallbackData);
+
+            if (mInMemoryData == nullptr || n < 0 || pos < 0 || pos > mInMemorySize - n)
+                throw Iex::InputExc("[AImg::CallbackIStream::readMemoryMapped] read past the end of the input");
+
+            mSeekCallback(mCallbackData, pos + n);
+
+            return mInMemoryData + pos;
+        }
+
+        // OpenEXR's offsets are from the start of the file, which needn't be the start of the stream
         virtual uint64_t tellg()
         {
-            return mTellCallback(mCallbackData);
+            return mTellCallback(mCallbackData) - mStartPos;
         }
 
         virtual void seekg(uint64_t pos)
         {
-            mSeekCallback(mCallbackData, (int32_t)pos);
+            mSeekCallback(mCallbackData, (int64_t)pos + mStartPos);
         }
 
         virtual void clear()
         {
         }
 
-        ReadCallback mReadCallback;
-        TellCallback mTellCallback;
-        SeekCallback mSeekCallback;
+        ReadCallback64 mReadCallback;
+        TellCallback64 mTellCallback;
+        SeekCallback64 mSeekCallback;
         void *mCallbackData;
+        int64_t mStartPos;
+
+        char *mInMemoryData = nullptr;
+        int64_t mInMemorySize = 0;
     };
 
     class CallbackOStream : public Imf::OStream
     {
     public:
-        CallbackOStream(WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData) : OStream("")
+        CallbackOStream(WriteCallback64 writeCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void *callbackData) : OStream("")
         {
             mWriteCallback = writeCallback;
             mTellCallback = tellCallback;
             mSeekCallback = seekCallback;
             mCallbackData = callbackData;
+            mStartPos = tellCallback(callbackData);
         }
 
         virtual void write(const char c[], int n)
@@ -72,22 +111,23 @@ namespace AImg
 
         virtual uint64_t tellp()
         {
-            return mTellCallback(mCallbackData);
+            return mTellCallback(mCallbackData) - mStartPos;
         }
 
         virtual void seekp(uint64_t pos)
         {
-            mSeekCallback(mCallbackData, (int32_t)pos);
+            mSeekCallback(mCallbackData, (int64_t)pos + mStartPos);
         }
 
         virtual void clear()
         {
         }
 
-        WriteCallback mWriteCallback;
-        TellCallback mTellCallback;
-        SeekCallback mSeekCallback;
+        WriteCallback64 mWriteCallback;
+        TellCallback64 mTellCallback;
+        SeekCallback64 mSeekCallback;
         void *mCallbackData;
+        int64_t mStartPos;
     };
 
     int32_t ExrImageLoader::initialise()
@@ -104,16 +144,9 @@ namespace AImg
         }
     }
 
-    bool ExrImageLoader::canLoadImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData)
+    bool ExrImageLoader::canLoadImage(const uint8_t *header, int32_t headerSize)
     {
-        int32_t startingPos = tellCallback(callbackData);
-
-        std::vector<uint8_t> header(4);
-        readCallback(callbackData, &header[0], 4);
-
-        seekCallback(callbackData, startingPos);
-
-        return header[0] == 0x76 && header[1] == 0x2f && header[2] == 0x31 && header[3] == 0x01;
+        return headerSize >= 4 && header[0] == 0x76 && header[1] == 0x2f && header[2] == 0x31 && header[3] == 0x01;
     }
 
     std::string ExrImageLoader::getFileExtension()
@@ -126,6 +159,108 @@ namespace AImg
         return EXR_IMAGE_FORMAT;
     }
 
+    // Attribute, type and channel names are null terminated, and at most 255 chars
+    static bool readExrName(ProbeReader& reader, int64_t* offset, char name[256])
+    {
+        for (int32_t length = 0; length < 256; length++)
+        {
+            uint8_t c;
+            if (!reader.readU8(*offset + length, &c))
+                return false;
+
+            name[length] = (char)c;
+            if (c == '\0')
+            {
+                *offset += length + 1;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    int32_t ExrImageLoader::probeImage(ProbeReader& reader, AImgProbeInfo* info)
+    {
+        // the header attributes start after the magic number and version, and the list ends with an empty name.
+        // Multi-part files start with the first part's header, which is the one Imf::InputFile reads.
+        int64_t offset = 8;
+        char name[256], type[256];
+
+        int32_t numChannels = 0;
+        bool allChannelsSame = true, allChannelsHalf = true;
+        uint32_t channelType = 0;
+        bool hasDisplayWindow = false;
+
+        while (numChannels == 0 || !hasDisplayWindow)
+        {
+            uint32_t size;
+            if (!readExrName(reader, &offset, name) || name[0] == '\0' || !readExrName(reader, &offset, type) || !reader.readU32LE(offset, &size))
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+            offset += 4;
+
+            if (strcmp(name, "channels") == 0 && strcmp(type, "chlist") == 0)
+            {
+                // name, then int pixel type, uchar pLinear, 3 reserved bytes, and int x and y sampling
+                int64_t channelOffset = offset;
+                for (;;)
+                {
+                    if (!readExrName(reader, &channelOffset, name))
+                        return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+                    if (name[0] == '\0')
+                        break;
+
+                    uint32_t pixelType;
+                    if (!reader.readU32LE(channelOffset, &pixelType) || pixelType > Imf::FLOAT)
+                        return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+                    channelOffset += 16;
+
+                    if (numChannels > 0 && pixelType != channelType)
+                        allChannelsSame = false;
+                    if (pixelType != Imf::HALF)
+                        allChannelsHalf = false;
+
+                    channelType = pixelType;
+                    numChannels++;
+                }
+
+                if (numChannels == 0)
+                    return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+            }
+            else if (strcmp(name, "displayWindow") == 0 && strcmp(type, "box2i") == 0)
+            {
+                uint32_t xMin, yMin, xMax, yMax;
+                if (!reader.readU32LE(offset, &xMin) || !reader.readU32LE(offset + 4, &yMin) ||
+                    !reader.readU32LE(offset + 8, &xMax) || !reader.readU32LE(offset + 12, &yMax))
+                    return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+
+                info->width = (int32_t)xMax - (int32_t)xMin + 1;
+                info->height = (int32_t)yMax - (int32_t)yMin + 1;
+                hasDisplayWindow = true;
+            }
+
+            offset += size;
+        }
+
+        // the same as ExrFile::getImageInfo and getDecodeFormat
+        info->numChannels = numChannels;
+
+        if (!allChannelsSame)
+        {
+            info->bytesPerChannel = -1;
+            info->floatOrInt = AImgFloatOrIntType::FITYPE_UNKNOWN;
+        }
+        else
+        {
+            info->bytesPerChannel = channelType == Imf::HALF ? 2 : 4;
+            info->floatOrInt = channelType == Imf::UINT ? AImgFloatOrIntType::FITYPE_INT : AImgFloatOrIntType::FITYPE_FLOAT;
+        }
+
+        info->decodedImgFormat = (allChannelsHalf ? AImgFormat::_16BITS : AImgFormat::_32BITS) | AImgFormat::FLOAT_FORMAT |
+            (AImgFormat::R << (std::min(numChannels, 4) - 1));
+
+        return AImgErrorCode::AIMG_SUCCESS;
+    }
+
     bool isFormatSupportedByExr(int32_t format)
     {
         int32_t flags = format & AImgFormat::_16BITS;
@@ -285,6 +420,106 @@ namespace AImg
             return AImgErrorCode::AIMG_SUCCESS;
         }
 
+        // Picks which channels we load and in what order, RGBA order for rgba images and otherwise the first 4 channels in the file
+        std::vector<std::string> getUsedChannelNames()
+        {
+            std::vector<std::string> allChannelNames;
+            bool isRgba = true;
+
+            const Imf::ChannelList &channels = file->header().channels();
+            for (Imf::ChannelList::ConstIterator it = channels.begin(); it != channels.end(); ++it)
+            {
+                std::string name = it.name();
+                allChannelNames.push_back(it.name());
+                if (name != "R" && name != "G" && name != "B" && name != "A")
+                    isRgba = false;
+            }
+
+            std::vector<std::string> usedChannelNames;
+
+            // ensure RGBA byte order, when loading an rgba image
+            if (isRgba)
+            {
+                if (std::find(allChannelNames.begin(), allChannelNames.end(), "R") != allChannelNames.end())
+                    usedChannelNames.push_back("R");
+                if (std::find(allChannelNames.begin(), allChannelNames.end(), "G") != allChannelNames.end())
+                    usedChannelNames.push_back("G");
+                if (std::find(allChannelNames.begin(), allChannelNames.end(), "B") != allChannelNames.end())
+                    usedChannelNames.push_back("B");
+                if (std::find(allChannelNames.begin(), allChannelNames.end(), "A") != allChannelNames.end())
+                    usedChannelNames.push_back("A");
+            }
+            // otherwise just whack em in in order
+            else
+            {
+                for (uint32_t i = 0; i < allChannelNames.size(); i++)
+                {
+                    if (usedChannelNames.size() >= 4)
+                        break;
+
+                    if (std::find(usedChannelNames.begin(), usedChannelNames.end(), allChannelNames[i]) == usedChannelNames.end())
+                        usedChannelNames.push_back(allChannelNames[i]);
+                }
+            }
+
+            return usedChannelNames;
+        }
+
+        // Points the file's frame buffer at interleaved pixels in the decode format. base is where pixel (0, 0) would be,
+        // it doesn't need to point inside the buffer as long as the lines that get read do.
+        void setFrameBuffer(char *base, size_t rowStride, int32_t decodeFormatBytesPerChannel)
+        {
+            std::vector<std::string> usedChannelNames = getUsedChannelNames();
+
+            Imf::FrameBuffer frameBuffer;
+
+            auto channelType = decodeFormatBytesPerChannel == 4 ? Imf::FLOAT : Imf::HALF;
+            for (uint32_t i = 0; i < usedChannelNames.size(); i++)
+            {
+                auto slice = Imf::Slice(channelType,
+                    base + i * decodeFormatBytesPerChannel,
+                    usedChannelNames.size() * decodeFormatBytesPerChannel,
+                    rowStride,
+                    1,
+                    1,
+                    0.0);
+
+                frameBuffer.insert(usedChannelNames[i], slice);
+            }
+
+            file->setFrameBuffer(frameBuffer);
+        }
+
+        // Our rows only match up with the file's lines if the data window is the whole image
+        bool canDecodeRows()
+        {
+            return file->header().dataWindow() == dw && dw.min.x == 0 && dw.min.y == 0;
+        }
+
+        virtual int32_t getRowBlockSize()
+        {
+            if (!canDecodeRows())
+                return 0;
+
+            // lines per compressed block, see the OpenEXR file layout docs
+            switch (file->header().compression())
+            {
+            case Imf::NO_COMPRESSION:
+            case Imf::RLE_COMPRESSION:
+            case Imf::ZIPS_COMPRESSION:
+                return 1;
+            case Imf::ZIP_COMPRESSION:
+            case Imf::PXR24_COMPRESSION:
+                return 16;
+            case Imf::PIZ_COMPRESSION:
+            case Imf::B44_COMPRESSION:
+            case Imf::B44A_COMPRESSION:
+                return 32;
+            default:
+                return 0;
+            }
+        }
+
         virtual int32_t decodeImage(void *realDestBuffer, int32_t forceImageFormat)
         {
             try
@@ -303,78 +538,39 @@ namespace AImg
                     return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
                 }
 
-                char *destBuffer = (char *)realDestBuffer;
+                bool needsConvert = forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != decodeFormat;
 
-                std::vector<uint8_t> convertTmpBuffer(0);
-                if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != decodeFormat)
+                // decodeRows reads a band of lines at a time and converts each band straight into realDestBuffer.
+                // Anything it can't handle still goes through a full size temporary buffer.
+                if (canDecodeRows())
                 {
-                    convertTmpBuffer.resize(width * height * decodeFormatBytesPerChannel * decodeFormatNumChannels);
-                    destBuffer = (char *)convertTmpBuffer.data();
-                }
+                    if (!needsConvert)
+                        forceImageFormat = decodeFormat;
 
-                std::vector<std::string> allChannelNames;
-                bool isRgba = true;
+                    int32_t numChannels, bytesPerChannel, floatOrInt;
+                    AIGetFormatDetails(forceImageFormat, &numChannels, &bytesPerChannel, &floatOrInt);
 
-                const Imf::ChannelList &channels = file->header().channels();
-                for (Imf::ChannelList::ConstIterator it = channels.begin(); it != channels.end(); ++it)
-                {
-                    std::string name = it.name();
-                    allChannelNames.push_back(it.name());
-                    if (name != "R" && name != "G" && name != "B" && name != "A")
-                        isRgba = false;
+                    return decodeRows(realDestBuffer, 0, height, (size_t)width * numChannels * bytesPerChannel, forceImageFormat);
                 }
 
-                std::vector<std::string> usedChannelNames;
+                char *destBuffer = (char *)realDestBuffer;
 
-                // ensure RGBA byte order, when loading an rgba image
-                if (isRgba)
+                ScratchBuffer convertTmpBuffer(mScratch, Scratch::CONVERT);
+                if (needsConvert)
                 {
-                    if (std::find(allChannelNames.begin(), allChannelNames.end(), "R") != allChannelNames.end())
-                        usedChannelNames.push_back("R");
-                    if (std::find(allChannelNames.begin(), allChannelNames.end(), "G") != allChannelNames.end())
-                        usedChannelNames.push_back("G");
-                    if (std::find(allChannelNames.begin(), allChannelNames.end(), "B") != allChannelNames.end())
-                        usedChannelNames.push_back("B");
-                    if (std::find(allChannelNames.begin(), allChannelNames.end(), "A") != allChannelNames.end())
-                        usedChannelNames.push_back("A");
-                }
-                // otherwise just whack em in in order
-                else
-                {
-                    for (uint32_t i = 0; i < allChannelNames.size(); i++)
-                    {
-                        if (usedChannelNames.size() >= 4)
-                            break;
-
-                        if (std::find(usedChannelNames.begin(), usedChannelNames.end(), allChannelNames[i]) == usedChannelNames.end())
-                            usedChannelNames.push_back(allChannelNames[i]);
-                    }
+                    destBuffer = (char *)convertTmpBuffer.resize((size_t)width * height * decodeFormatBytesPerChannel * decodeFormatNumChannels);
                 }
 
-                Imf::FrameBuffer frameBuffer;
                 auto displayWindow = file->header().displayWindow();
 
                 auto fbMaxW = std::max(dw.max.x, displayWindow.max.x) + 1;
 
-                auto channelType = decodeFormatBytesPerChannel == 4 ? Imf::FLOAT : Imf::HALF;
-                for (uint32_t i = 0; i < usedChannelNames.size(); i++)
-                {
-                    auto slice = Imf::Slice(channelType,
-                        destBuffer + i * decodeFormatBytesPerChannel,
-                        usedChannelNames.size() * decodeFormatBytesPerChannel,
-                        fbMaxW * usedChannelNames.size() * decodeFormatBytesPerChannel,
-                        1,
-                        1,
-                        0.0);
-
-                    frameBuffer.insert(usedChannelNames[i], slice);
-                }
+                setFrameBuffer(destBuffer, fbMaxW * getUsedChannelNames().size() * decodeFormatBytesPerChannel, decodeFormatBytesPerChannel);
 
-                file->setFrameBuffer(frameBuffer);
                 auto dataWindow = file->header().dataWindow();
                 file->readPixels(dataWindow.min.y, dataWindow.max.y);
 
-                if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != decodeFormat)
+                if (needsConvert)
                 {
                     int32_t err = AImgConvertFormat(destBuffer, realDestBuffer, width, height, decodeFormat, forceImageFormat);
                     if (err != AImgErrorCode::AIMG_SUCCESS)
@@ -390,7 +586,67 @@ namespace AImg
             }
         }
 
-        virtual int32_t openImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData)
+        virtual int32_t decodeRows(void *destBuffer, int32_t firstRow, int32_t numRows, size_t destStride, int32_t forceImageFormat)
+        {
+            if (!canDecodeRows())
+                return AImgBase::decodeRows(destBuffer, firstRow, numRows, destStride, forceImageFormat);
+
+            try
+            {
+                int32_t width = dw.max.x - dw.min.x + 1;
+
+                int32_t decodeFormat = getDecodeFormat();
+
+                int32_t decodeFormatNumChannels, decodeFormatBytesPerChannel, decodeFormatFloatOrInt;
+                AIGetFormatDetails(decodeFormat, &decodeFormatNumChannels, &decodeFormatBytesPerChannel, &decodeFormatFloatOrInt);
+
+                if (decodeFormatBytesPerChannel != 2 && decodeFormatBytesPerChannel != 4)
+                {
+                    mErrorDetails = "[AImg::EXRImageLoader::EXRFile::] invalid decodeFormatBytesPerChannel";
+                    return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+                }
+
+                int32_t lastRow = firstRow + numRows - 1;
+
+                // no conversion needed, so OpenEXR can write straight into destBuffer
+                if (forceImageFormat == decodeFormat)
+                {
+                    setFrameBuffer((char *)destBuffer - firstRow * destStride, destStride, decodeFormatBytesPerChannel);
+                    file->readPixels(firstRow, lastRow);
+
+                    return AImgErrorCode::AIMG_SUCCESS;
+                }
+
+                size_t decodeRowSize = (size_t)width * decodeFormatNumChannels * decodeFormatBytesPerChannel;
+
+                int32_t bandRows = std::min(AImg::getDecodeBandRows(width, decodeFormat), numRows);
+                ScratchBuffer bandScratch(mScratch, Scratch::BAND);
+                char *bandBuffer = (char *)bandScratch.resize(bandRows * decodeRowSize);
+
+                for (int32_t y = firstRow; y <= lastRow; y += bandRows)
+                {
+                    AImg::TraceScope trace(AImg::TRACE_DECODE_BLOCK);
+                    int32_t bandLastRow = std::min(y + bandRows - 1, lastRow);
+
+                    setFrameBuffer(bandBuffer - y * decodeRowSize, decodeRowSize, decodeFormatBytesPerChannel);
+                    file->readPixels(y, bandLastRow);
+
+                    int32_t err = AImg::convertRows(bandBuffer, decodeRowSize, (char *)destBuffer + (y - firstRow) * destStride, destStride,
+                        width, bandLastRow - y + 1, decodeFormat, forceImageFormat);
+                    if (err != AImgErrorCode::AIMG_SUCCESS)
+                        return err;
+                }
+
+                return AImgErrorCode::AIMG_SUCCESS;
+            }
+            catch (const std::exception &e)
+            {
+                mErrorDetails = std::string("[AImg::EXRImageLoader::EXRFile::] ") + e.what();
+                return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+            }
+        }
+
+        virtual int32_t openImage(ReadCallback64 readCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void *callbackData)
         {
             try
             {
@@ -409,13 +665,13 @@ namespace AImg
         }
 
         int32_t writeImage(void *data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat, const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
-            WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData, void *encodingOptions)
+            WriteCallback64 writeCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void *callbackData, void *encodingOptions)
         {
             AIL_UNUSED_PARAM(encodingOptions);
 
             try
             {
-                std::vector<uint8_t> reformattedDataTmp(0);
+                ScratchBuffer reformattedDataTmp(mScratch, Scratch::CONVERT);
 
                 void *inputBuf = data;
                 AImgFormat inputBufFormat = getWriteFormatExr(inputFormat, outputFormat);
@@ -428,10 +684,9 @@ namespace AImg
                     // resize reformattedDataTmp to fit the converted image data
                     int32_t bytesPerChannelTmp, numChannelsTmp, floatOrIntTmp;
                     AIGetFormatDetails(inputBufFormat, &numChannelsTmp, &bytesPerChannelTmp, &floatOrIntTmp);
-                    reformattedDataTmp.resize(numChannelsTmp * bytesPerChannelTmp * width * height);
+                    inputBuf = reformattedDataTmp.resize((size_t)numChannelsTmp * bytesPerChannelTmp * width * height);
 
-                    AImgConvertFormat(data, &reformattedDataTmp[0], width, height, inputFormat, inputBufFormat);
-                    inputBuf = &reformattedDataTmp[0];
+                    AImgConvertFormat(data, inputBuf, width, height, inputFormat, inputBufFormat);
                 }
 
                 int32_t bytesPerChannel, numChannels, floatOrInt;
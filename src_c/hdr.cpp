@@ -1,111 +1,173 @@
 #include "hdr.h"
 #include "AIL_internal.h"
-
-#define STBI_ONLY_HDR
-
-#include "extern/stb_image.h"
+#include "convert.h"
+#include "probe.h"
+#include "scratch.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <cstring>
+#include <string>
+#include <vector>
 
 namespace AImg
 {
-    namespace STBIHDRCallbacks
-    {
-        int readCallback(void * user, char * data, int size)
-        {
-            CallbackData * callbackFunctions = (CallbackData *)user;
-            return callbackFunctions->readCallback(callbackFunctions->callbackData, (uint8_t *)data, size);
-        }
-
-        void seekCallback(void * user, int num_bytes)
-        {
-            CallbackData * callbackFunctions = (CallbackData *)user;
-            callbackFunctions->seekCallback(callbackFunctions->callbackData, num_bytes);
-        }
-
-        int eofCallback(void * user)
-        {
-            CallbackData * callbackFunctions = (CallbackData *)user;
-
-            int startPos = callbackFunctions->tellCallback(callbackFunctions->callbackData);
-            callbackFunctions->seekCallback(callbackFunctions->callbackData, startPos + 1);
-
-            int newPos = callbackFunctions->tellCallback(callbackFunctions->callbackData);
-
-            callbackFunctions->seekCallback(callbackFunctions->callbackData, startPos);
-
-            return (startPos - newPos) != 0 ? 1 : 0;
-        }
-    }
-
+    // Radiance RGBE decoder. All state lives in the HDRFile, so any number of files can be decoded at once
+    // from different threads.
     class HDRFile : public AImgBase
     {
     public:
 
-        virtual int32_t openImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData)
+        virtual int32_t openImage(ReadCallback64 readCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void *callbackData)
         {
             data.readCallback = readCallback;
             data.tellCallback = tellCallback;
             data.seekCallback = seekCallback;
             data.callbackData = callbackData;
 
-            stbi_io_callbacks callback;
-            callback.read = STBIHDRCallbacks::readCallback;
-            callback.skip = STBIHDRCallbacks::seekCallback;
-            callback.eof = STBIHDRCallbacks::eofCallback;
+            startPos = tellCallback(callbackData);
 
-            int startingPosition = tellCallback(callbackData);
-            stbi_hdr_to_ldr_gamma(1.0f);
-            stbi_ldr_to_hdr_gamma(1.0f);
+            const uint8_t *memory = nullptr;
+            int64_t memorySize = 0;
+            if (getInMemoryData(readCallback, callbackData, &memory, &memorySize) && startPos <= memorySize)
+            {
+                inMemoryData = memory + startPos;
+                inMemorySize = memorySize - startPos;
+            }
+            else
+            {
+                readBuffer.resize(READ_BLOCK_SIZE);
+            }
+            rewind(0);
 
-            stbi_info_from_callbacks(&callback, &data, &width, &height, &numChannels);
-            seekCallback(callbackData, startingPosition);
+            std::string line = readLine();
+            if (line != "#?RADIANCE" && line != "#?RGBE")
+            {
+                mErrorDetails = "[AImg::HDRImageLoader::HDRFile::openImage] Not a Radiance HDR file";
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+            }
 
-            return AImgErrorCode::AIMG_SUCCESS;
-        }
+            bool validFormat = false;
+            for (line = readLine(); !line.empty(); line = readLine())
+            {
+                if (line == "FORMAT=32-bit_rle_rgbe")
+                    validFormat = true;
+            }
 
-        virtual int32_t decodeImage(void *realDestBuffer, int32_t forceImageFormat)
-        {
-            stbi_io_callbacks callbacks;
+            if (!validFormat)
+            {
+                mErrorDetails = "[AImg::HDRImageLoader::HDRFile::openImage] Unsupported HDR pixel format, only 32-bit_rle_rgbe is supported";
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+            }
 
-            callbacks.read = STBIHDRCallbacks::readCallback;
-            callbacks.skip = STBIHDRCallbacks::seekCallback;
-            callbacks.eof = STBIHDRCallbacks::eofCallback;
-            float * loadedData = stbi_loadf_from_callbacks(&callbacks, &data, &width, &height, &numChannels, numChannels);
+            // only the standard top to bottom, left to right layout is supported
+            line = readLine();
+            const char *token = line.c_str();
+            char *tokenEnd = nullptr;
+            if (strncmp(token, "-Y ", 3) != 0)
+            {
+                mErrorDetails = "[AImg::HDRImageLoader::HDRFile::openImage] Unsupported HDR data layout";
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+            }
+            long fileHeight = strtol(token + 3, &tokenEnd, 10);
 
-            if (!loadedData)
+            token = tokenEnd;
+            while (*token == ' ')
+                token++;
+            if (strncmp(token, "+X ", 3) != 0)
             {
-                mErrorDetails = "[AImg::HDRImageLoader::HDRFile::decodeImage] stbi_loadf_from_callbacks failed!";
+                mErrorDetails = "[AImg::HDRImageLoader::HDRFile::openImage] Unsupported HDR data layout";
                 return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
             }
+            long fileWidth = strtol(token + 3, nullptr, 10);
+
+            if (fileWidth <= 0 || fileHeight <= 0 || fileWidth > MAX_DIMENSION || fileHeight > MAX_DIMENSION)
+            {
+                mErrorDetails = "[AImg::HDRImageLoader::HDRFile::openImage] Invalid HDR image dimensions";
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+            }
+
+            width = (int32_t)fileWidth;
+            height = (int32_t)fileHeight;
+            numChannels = 3;
+            pixelDataOffset = currentOffset();
+            nextRow = 0;
+
+            return AImgErrorCode::AIMG_SUCCESS;
+        }
+
+        virtual int32_t decodeImage(void *realDestBuffer, int32_t forceImageFormat)
+        {
+            if (forceImageFormat == AImgFormat::INVALID_FORMAT)
+                forceImageFormat = AImgFormat::RGB32F;
 
-            int32_t decodeFormat = AImgFormat::RGB32F;
             int32_t numChannels, bytesPerChannel, floatOrInt;
-            AIGetFormatDetails(decodeFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+            AIGetFormatDetails(forceImageFormat, &numChannels, &bytesPerChannel, &floatOrInt);
 
-            void* destBuffer = realDestBuffer;
+            return decodeRows(realDestBuffer, 0, height, (size_t)width * numChannels * bytesPerChannel, forceImageFormat);
+        }
 
-            std::vector<uint8_t> convertTmpBuffer(0);
-            if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != decodeFormat)
+        virtual int32_t decodeRows(void *destBuffer, int32_t firstRow, int32_t numRows, size_t destStride, int32_t forceImageFormat)
+        {
+            // scanlines are variable length, so going back means starting again from the first one
+            if (firstRow < nextRow)
             {
-                convertTmpBuffer.resize(width * height * bytesPerChannel * numChannels);
-                destBuffer = convertTmpBuffer.data();
+                rewind(pixelDataOffset);
+                nextRow = 0;
             }
 
-            memcpy(destBuffer, loadedData, width * height * bytesPerChannel * numChannels);
-            stbi_image_free(loadedData);
+            size_t rowSize = (size_t)width * 3 * sizeof(float);
+            scanline.resize((size_t)width * 4);
 
-            if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != decodeFormat)
+            while (nextRow < firstRow)
             {
-                int32_t err = AImgConvertFormat(destBuffer, realDestBuffer, width, height, decodeFormat, forceImageFormat);
-                if (err != AImgErrorCode::AIMG_SUCCESS)
-                    return err;
+                if (!readScanline())
+                    return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+                nextRow++;
+            }
+
+            if (forceImageFormat == AImgFormat::RGB32F)
+            {
+                for (int32_t y = 0; y < numRows; y++)
+                {
+                    if (!readScanline())
+                        return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+                    convertScanline((float *)((uint8_t *)destBuffer + y * destStride));
+                    nextRow++;
+                }
+            }
+            else
+            {
+                int32_t bandRows = std::min(AImg::getDecodeBandRows(width, AImgFormat::RGB32F), numRows);
+                ScratchBuffer bandScratch(mScratch, Scratch::BAND);
+                float *bandBuffer = (float *)bandScratch.resize((size_t)bandRows * rowSize);
+
+                for (int32_t y = 0; y < numRows; y += bandRows)
+                {
+                    AImg::TraceScope trace(AImg::TRACE_DECODE_BLOCK);
+                    int32_t rows = std::min(bandRows, numRows - y);
+
+                    for (int32_t i = 0; i < rows; i++)
+                    {
+                        if (!readScanline())
+                            return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+                        convertScanline(&bandBuffer[(size_t)i * width * 3]);
+                        nextRow++;
+                    }
+
+                    int32_t err = AImg::convertRows(bandBuffer, rowSize, (uint8_t *)destBuffer + y * destStride, destStride, width, rows, AImgFormat::RGB32F, forceImageFormat);
+                    if (err != AImgErrorCode::AIMG_SUCCESS)
+                        return err;
+                }
             }
 
             return AImgErrorCode::AIMG_SUCCESS;
         }
 
         virtual int32_t writeImage(void *data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat, const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
-            WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData, void* encodingOptions)
+            WriteCallback64 writeCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void *callbackData, void* encodingOptions)
         {
             return AImgErrorCode::AIMG_WRITE_NOT_SUPPORTED_FOR_FORMAT;
         }
@@ -140,9 +202,208 @@ namespace AImg
             return AImgErrorCode::AIMG_SUCCESS;
         }
 
+        // HDRImageLoader::probeImage follows these too
+        static const int32_t MAX_LINE_LENGTH = 1023;
+        static const long MAX_DIMENSION = 1 << 24;
+
     private:
+        static const int32_t READ_BLOCK_SIZE = 64 * 1024;
+
+        // Moves the reader to an offset from the start of the file
+        void rewind(int64_t offset)
+        {
+            if (inMemoryData != nullptr)
+            {
+                bufferBase = inMemoryData;
+                bufferOffset = 0;
+                cur = inMemoryData + std::min(offset, inMemorySize);
+                end = inMemoryData + inMemorySize;
+            }
+            else
+            {
+                data.seekCallback(data.callbackData, startPos + offset);
+                bufferBase = cur = end = readBuffer.data();
+                bufferOffset = offset;
+            }
+        }
+
+        int64_t currentOffset()
+        {
+            return bufferOffset + (cur - bufferBase);
+        }
+
+        bool fillBuffer()
+        {
+            if (inMemoryData != nullptr)
+                return false;
+
+            bufferOffset += end - bufferBase;
+            int64_t bytesRead = data.readCallback(data.callbackData, readBuffer.data(), (int64_t)readBuffer.size());
+
+            bufferBase = cur = readBuffer.data();
+            end = cur + std::max(bytesRead, (int64_t)0);
+            return cur != end;
+        }
+
+        // Returns -1 at the end of the file
+        int readByte()
+        {
+            if (cur == end && !fillBuffer())
+                return -1;
+            return *cur++;
+        }
+
+        // Reads one header line without its newline. Overlong lines are cut short, as they are in Radiance.
+        std::string readLine()
+        {
+            std::string line;
+            int c = readByte();
+            while (c != -1 && c != '\n')
+            {
+                if ((int32_t)line.size() < MAX_LINE_LENGTH)
+                    line.push_back((char)c);
+                c = readByte();
+            }
+            return line;
+        }
+
+        bool truncated()
+        {
+            mErrorDetails = "[AImg::HDRImageLoader::HDRFile::decodeRows] Unexpected end of HDR pixel data";
+            return false;
+        }
+
+        // Reads the next scanline into the RGBE scanline buffer
+        bool readScanline()
+        {
+            uint8_t *out = scanline.data();
+            int32_t start = 0;
+
+            // widths outside this range can't be run length encoded, and anything without the 2, 2 marker is flat RGBE too
+            if (width >= 8 && width < 32768)
+            {
+                int c1 = readByte(), c2 = readByte(), c3 = readByte();
+                if (c3 == -1)
+                    return truncated();
+
+                if (c1 == 2 && c2 == 2 && !(c3 & 0x80))
+                {
+                    int c4 = readByte();
+                    if (c4 == -1)
+                        return truncated();
+
+                    if (((c3 << 8) | c4) != width)
+                    {
+                        mErrorDetails = "[AImg::HDRImageLoader::HDRFile::decodeRows] Invalid HDR scanline length";
+                        return false;
+                    }
+
+                    for (int32_t k = 0; k < 4; k++)
+                    {
+                        int32_t i = 0;
+                        while (i < width)
+                        {
+                            int count = readByte();
+                            if (count == -1)
+                                return truncated();
+
+                            bool run = count > 128;
+                            if (run)
+                                count -= 128;
+
+                            if (count == 0 || count > width - i)
+                            {
+                                mErrorDetails = "[AImg::HDRImageLoader::HDRFile::decodeRows] Corrupt HDR run length";
+                                return false;
+                            }
+
+                            if (run)
+                            {
+                                int value = readByte();
+                                if (value == -1)
+                                    return truncated();
+                                for (int z = 0; z < count; z++)
+                                    out[(i++) * 4 + k] = (uint8_t)value;
+                            }
+                            else
+                            {
+                                for (int z = 0; z < count; z++)
+                                {
+                                    int value = readByte();
+                                    if (value == -1)
+                                        return truncated();
+                                    out[(i++) * 4 + k] = (uint8_t)value;
+                                }
+                            }
+                        }
+                    }
+
+                    return true;
+                }
+
+                // the bytes we read are the first pixel
+                out[0] = (uint8_t)c1;
+                out[1] = (uint8_t)c2;
+                out[2] = (uint8_t)c3;
+                int e = readByte();
+                if (e == -1)
+                    return truncated();
+                out[3] = (uint8_t)e;
+                start = 1;
+            }
+
+            size_t needed = (size_t)(width - start) * 4;
+            uint8_t *dest = out + start * 4;
+            while (needed > 0)
+            {
+                if (cur == end && !fillBuffer())
+                    return truncated();
+
+                size_t count = std::min(needed, (size_t)(end - cur));
+                memcpy(dest, cur, count);
+                cur += count;
+                dest += count;
+                needed -= count;
+            }
+
+            return true;
+        }
+
+        void convertScanline(float *dest)
+        {
+            const uint8_t *rgbe = scanline.data();
+            for (int32_t x = 0; x < width; x++, rgbe += 4, dest += 3)
+            {
+                if (rgbe[3] != 0)
+                {
+                    float f1 = (float)ldexp(1.0f, rgbe[3] - (128 + 8));
+                    dest[0] = rgbe[0] * f1;
+                    dest[1] = rgbe[1] * f1;
+                    dest[2] = rgbe[2] * f1;
+                }
+                else
+                {
+                    dest[0] = dest[1] = dest[2] = 0.0f;
+                }
+            }
+        }
+
         CallbackData data;
-        int32_t numChannels, width, height;
+        int32_t numChannels = 0, width = 0, height = 0;
+
+        int64_t startPos = 0;
+        int64_t pixelDataOffset = 0;
+        int32_t nextRow = 0;
+        Vector<uint8_t> scanline;
+
+        // Reads are served from [cur, end). bufferBase is at bufferOffset bytes from the start of the file, and is either
+        // readBuffer or, when the input is already in memory, the input itself so nothing gets copied.
+        Vector<uint8_t> readBuffer;
+        const uint8_t *bufferBase = nullptr, *cur = nullptr, *end = nullptr;
+        int64_t bufferOffset = 0;
+
+        const uint8_t *inMemoryData = nullptr;
+        int64_t inMemorySize = 0;
     };
 
     AImgBase * HDRImageLoader::getAImg()
@@ -150,20 +411,14 @@ namespace AImg
         return new HDRFile();
     }
 
-    bool HDRImageLoader::canLoadImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData)
+    bool HDRImageLoader::canLoadImage(const uint8_t* header, int32_t headerSize)
     {
-        int startingPosition = tellCallback(callbackData);
-
-        std::vector<uint8_t> magic = { 0x23, 0x3f, 0x52, 0x41, 0x44, 0x49, 0x41, 0x4e, 0x43, 0x45, 0x0a };
-
-        std::vector<uint8_t> readBackData;
-        readBackData.resize(magic.size());
+        // "#?RADIANCE\n", or "#?RGBE\n" which some writers use instead
+        std::vector<uint8_t> radianceMagic = { 0x23, 0x3f, 0x52, 0x41, 0x44, 0x49, 0x41, 0x4e, 0x43, 0x45, 0x0a };
+        std::vector<uint8_t> rgbeMagic = { 0x23, 0x3f, 0x52, 0x47, 0x42, 0x45, 0x0a };
 
-        readCallback(callbackData, readBackData.data(), (int32_t)magic.size());
-
-        seekCallback(callbackData, startingPosition);
-
-        return memcmp(magic.data(), readBackData.data(), magic.size()) == 0;
+        return (headerSize >= (int32_t)radianceMagic.size() && memcmp(radianceMagic.data(), header, radianceMagic.size()) == 0) ||
+            (headerSize >= (int32_t)rgbeMagic.size() && memcmp(rgbeMagic.data(), header, rgbeMagic.size()) == 0);
     }
 
     std::string HDRImageLoader::getFileExtension()
@@ -176,7 +431,54 @@ namespace AImg
         return HDR_IMAGE_FORMAT;
     }
 
-    int32_t HDRImageLoader::initialise() { return AImgErrorCode::AIMG_SUCCESS; }
+    int32_t HDRImageLoader::probeImage(ProbeReader& reader, AImgProbeInfo* info)
+    {
+        char line[HDRFile::MAX_LINE_LENGTH + 1];
+        int64_t offset = 0;
+
+        // the same header checks as HDRFile::openImage
+        if (!reader.readLine(&offset, line, HDRFile::MAX_LINE_LENGTH) || (strcmp(line, "#?RADIANCE") != 0 && strcmp(line, "#?RGBE") != 0))
+            return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+
+        bool validFormat = false;
+        for (;;)
+        {
+            if (!reader.readLine(&offset, line, HDRFile::MAX_LINE_LENGTH))
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+            if (line[0] == '\0')
+                break;
+            if (strcmp(line, "FORMAT=32-bit_rle_rgbe") == 0)
+                validFormat = true;
+        }
+
+        if (!validFormat || !reader.readLine(&offset, line, HDRFile::MAX_LINE_LENGTH) || strncmp(line, "-Y ", 3) != 0)
+            return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+
+        char *token = nullptr;
+        long fileHeight = strtol(line + 3, &token, 10);
+        while (*token == ' ')
+            token++;
+        if (strncmp(token, "+X ", 3) != 0)
+            return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+        long fileWidth = strtol(token + 3, nullptr, 10);
+
+        if (fileWidth <= 0 || fileHeight <= 0 || fileWidth > HDRFile::MAX_DIMENSION || fileHeight > HDRFile::MAX_DIMENSION)
+            return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+
+        info->width = (int32_t)fileWidth;
+        info->height = (int32_t)fileHeight;
+        info->numChannels = 3;
+        info->bytesPerChannel = 4;
+        info->floatOrInt = AImgFloatOrIntType::FITYPE_FLOAT;
+        info->decodedImgFormat = AImgFormat::RGB32F;
+
+        return AImgErrorCode::AIMG_SUCCESS;
+    }
+
+    int32_t HDRImageLoader::initialise()
+    {
+        return AImgErrorCode::AIMG_SUCCESS;
+    }
 
     bool HDRImageLoader::isFormatSupported(int32_t format) { return format == AImgFormat::RGB32F; }
 
@@ -13,9 +13,10 @@ namespace AImg
         virtual AImgBase * getAImg();
         virtual int32_t initialise();
 
-        virtual bool canLoadImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData);
+        virtual bool canLoadImage(const uint8_t* header, int32_t headerSize);
         virtual std::string getFileExtension();
         virtual int32_t getAImgFileFormatValue();
+        virtual int32_t probeImage(ProbeReader& reader, AImgProbeInfo* info);
 
         virtual bool isFormatSupported(int32_t format);
 
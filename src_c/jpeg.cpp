@@ -1,7 +1,14 @@
 #include "AIL.h"
 #include "jpeg.h"
 #include "AIL_internal.h"
+#include "convert.h"
+#include "probe.h"
+#include "scratch.h"
+#include "threadpool.h"
+#include "trace.h"
 #include <vector>
+#include <algorithm>
+#include <atomic>
 #include <string.h>
 #include <cstring>
 #include <setjmp.h>
@@ -34,7 +41,12 @@ namespace AImg
     {
         // Buffer size used in libjpeg
         const size_t BUFFER_SIZE = 4096;
-        const int Quality = 99;
+        // Used when no JpegEncodingOptions are given
+        const int DefaultQuality = 99;
+
+        // Images with restart markers and at least this many pixels are decoded in bands on the thread pool, below it
+        // the extra decompressors and the pass over the file to find the markers cost more than they save
+        const size_t PARALLEL_DECODE_MIN_PIXELS = 1024 * 1024;
     }
 
     namespace JPEGCallbackFunctions
@@ -162,18 +174,11 @@ namespace AImg
         return AImgErrorCode::AIMG_SUCCESS;
     }
 
-    bool JPEGImageLoader::canLoadImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData)
+    bool JPEGImageLoader::canLoadImage(const uint8_t *header, int32_t headerSize)
     {
-        AIL_UNUSED_PARAM(tellCallback);
         uint8_t magic[] = { 0xFF, 0xD8, 0xFF };
 
-        int startingPosition = tellCallback(callbackData);
-        std::vector<uint8_t> header(4);
-        readCallback(callbackData, &header[0], 4);
-
-        seekCallback(callbackData, startingPosition);
-
-        return ((int32_t)memcmp(&header[0], magic, 3)) == 0;
+        return headerSize >= 3 && ((int32_t)memcmp(header, magic, 3)) == 0;
     }
 
     std::string JPEGImageLoader::getFileExtension()
@@ -186,12 +191,181 @@ namespace AImg
         return JPEG_IMAGE_FORMAT;
     }
 
+    int32_t JPEGImageLoader::probeImage(ProbeReader& reader, AImgProbeInfo* info)
+    {
+        // skip marker segments after the SOI until the start of frame, which has the size and component count
+        int64_t offset = 2;
+        for (;;)
+        {
+            uint8_t marker;
+            if (!reader.readU8(offset, &marker) || marker != 0xFF)
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+
+            // any number of 0xFF fill bytes can come before the marker code
+            while (marker == 0xFF)
+            {
+                offset++;
+                if (!reader.readU8(offset, &marker))
+                    return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+            }
+            offset++;
+
+            // standalone markers, with no length
+            if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8))
+                continue;
+
+            // image data or the end of the file before any frame header
+            if (marker == 0xD9 || marker == 0xDA)
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+
+            uint16_t length;
+            if (!reader.readU16BE(offset, &length) || length < 2)
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+
+            // SOF0 to SOF15, apart from DHT, JPG and DAC which share the range
+            if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+            {
+                const uint8_t* frame = reader.get(offset + 2, 6);
+                if (frame == NULL || frame[5] < 1 || frame[5] > 4)
+                    return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+
+                info->height = (frame[1] << 8) | frame[2];
+                info->width = (frame[3] << 8) | frame[4];
+                info->numChannels = frame[5];
+                info->bytesPerChannel = 1;
+                info->floatOrInt = AImgFloatOrIntType::FITYPE_INT;
+                info->decodedImgFormat = AImgFormat::_8BITS | AImgFormat::R << (info->numChannels - 1);
+
+                return AImgErrorCode::AIMG_SUCCESS;
+            }
+
+            offset += length;
+        }
+    }
+
+    // Where things are in a single scan sequential Huffman JPEG, for splitting its scan at the restart markers
+    struct JPEGScanLayout
+    {
+        size_t sofHeightOffset; // the image height in the start of frame
+        size_t scanStart; // just past the start of scan, everything before is the header
+        size_t scanEnd; // the EOI marker
+        Vector<size_t> restartMarkers; // every RSTn marker in the scan, in order
+    };
+
+    uint32_t gcd(uint32_t a, uint32_t b)
+    {
+        while (b != 0)
+        {
+            uint32_t t = a % b;
+            a = b;
+            b = t;
+        }
+
+        return a;
+    }
+
+    // Fills in layout from a whole JPEG file in memory. Fails for anything it can't split, which is progressive,
+    // lossless and arithmetic coded files, scans that don't hold every component, and files with more than one scan.
+    bool findJPEGScanLayout(const uint8_t* data, size_t size, int32_t numComponents, JPEGScanLayout* layout)
+    {
+        layout->sofHeightOffset = 0;
+
+        size_t offset = 2;
+        for (;;)
+        {
+            if (offset + 4 > size || data[offset] != 0xFF)
+                return false;
+
+            while (offset + 4 <= size && data[offset + 1] == 0xFF)
+                offset++;
+
+            uint8_t marker = data[offset + 1];
+
+            // standalone markers, with no length
+            if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+            {
+                offset += 2;
+                continue;
+            }
+
+            size_t length = (data[offset + 2] << 8) | data[offset + 3];
+            if (length < 2 || offset + 2 + length > size)
+                return false;
+
+            // only baseline and extended sequential Huffman frames
+            if (marker == 0xC0 || marker == 0xC1)
+                layout->sofHeightOffset = offset + 5;
+            else if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+                return false;
+
+            if (marker == 0xDA)
+            {
+                if (layout->sofHeightOffset == 0 || data[offset + 4] != numComponents)
+                    return false;
+
+                layout->scanStart = offset + 2 + length;
+                break;
+            }
+
+            if (marker == 0xD9)
+                return false;
+
+            offset += 2 + length;
+        }
+
+        // in entropy coded data every 0xFF is followed by a stuffed 0x00, a restart marker or the marker that ends the scan
+        layout->restartMarkers.clear();
+        for (offset = layout->scanStart; ; )
+        {
+            const uint8_t* ff = (const uint8_t*)memchr(data + offset, 0xFF, size - offset);
+            if (ff == NULL || ff + 1 >= data + size)
+                return false;
+
+            offset = ff - data;
+            uint8_t marker = data[offset + 1];
+
+            if (marker == 0x00)
+            {
+                offset += 2;
+            }
+            else if (marker == 0xFF)
+            {
+                offset++;
+            }
+            else if (marker >= 0xD0 && marker <= 0xD7)
+            {
+                layout->restartMarkers.push_back(offset);
+                offset += 2;
+            }
+            else if (marker == 0xD9)
+            {
+                layout->scanEnd = offset;
+                return true;
+            }
+            else
+            {
+                return false;
+            }
+        }
+    }
+
     class JPEGFile : public AImgBase
     {
     public:
         jpeg_decompress_struct jpeg_read_struct;
         ArtomatixErrorStruct err_mgr;
 
+        // State for decoding a band of rows at a time, libjpeg only lets us read scanlines in order
+        bool decompressStarted = false;
+        uint32_t nextRow = 0;
+
+        // what jpeg_read_header picked, for when the decoding options are reset
+        J_COLOR_SPACE defaultColourSpace = JCS_UNKNOWN;
+
+        // for reading the whole file again when decoding in parallel
+        CallbackData callbacks;
+        int64_t startPos = 0;
+
         JPEGFile()
         {
             jpeg_create_decompress(&jpeg_read_struct);
@@ -202,7 +376,7 @@ namespace AImg
             jpeg_destroy_decompress(&jpeg_read_struct);
         }
 
-        int32_t openImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData)
+        int32_t openImage(ReadCallback64 readCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void *callbackData)
         {
             CallbackData data;
             data.callbackData = callbackData;
@@ -210,6 +384,9 @@ namespace AImg
             data.tellCallback = tellCallback;
             data.seekCallback = seekCallback;
 
+            callbacks = data;
+            startPos = tellCallback(callbackData);
+
             setArtomatixSourceMGR(&jpeg_read_struct, data);
             jpeg_read_struct.err = jpeg_std_error(&err_mgr.pub);
 
@@ -229,18 +406,114 @@ namespace AImg
             jpeg_read_struct.err->emit_message = JPEGCallbackFunctions::lessAnnoyingEmitMessage;
             jpeg_read_struct.err->error_exit = JPEGCallbackFunctions::handleFatalError;
             jpeg_read_header(&jpeg_read_struct, TRUE);
+            defaultColourSpace = jpeg_read_struct.out_color_space;
+
+            // fills in output_width and output_height, which change if a scale is set
+            jpeg_calc_output_dimensions(&jpeg_read_struct);
+
+            return AImgErrorCode::AIMG_SUCCESS;
+        }
+
+        virtual int32_t setDecodeScale(int32_t scaleDenom)
+        {
+            if (decompressStarted)
+            {
+                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::setDecodeScale] Can't change the scale once decoding has started";
+                return AImgErrorCode::AIMG_INVALID_ARGS;
+            }
+
+            jpeg_read_struct.err = jpeg_std_error(&err_mgr.pub);
+            jpeg_read_struct.err->emit_message = JPEGCallbackFunctions::lessAnnoyingEmitMessage;
+            jpeg_read_struct.err->error_exit = JPEGCallbackFunctions::handleFatalError;
+
+            if (setjmp(err_mgr.buf))
+            {
+                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::setDecodeScale] jpeg_calc_output_dimensions failed!";
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+            }
+
+            // libjpeg scales in the DCT domain, decoding each 8x8 block straight to a smaller one
+            jpeg_read_struct.scale_num = 1;
+            jpeg_read_struct.scale_denom = scaleDenom;
+            jpeg_calc_output_dimensions(&jpeg_read_struct);
+
+            return AImgErrorCode::AIMG_SUCCESS;
+        }
+
+        virtual int32_t setDecodingOptions(void* decodingOptions)
+        {
+            if (decompressStarted)
+            {
+                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::setDecodingOptions] Can't change the decoding options once decoding has started";
+                return AImgErrorCode::AIMG_INVALID_ARGS;
+            }
+
+            // libjpeg's defaults, as set up by jpeg_read_header
+            JpegDecodingOptions options;
+            options.type = JPEG_IMAGE_FORMAT;
+            options.dctMethod = AIL_JPEG_DCT_ISLOW;
+            options.fancyUpsampling = 1;
+            options.blockSmoothing = 1;
+            options.colourSpace = AIL_JPEG_COLOURSPACE_DEFAULT;
+
+            if (decodingOptions != NULL)
+                options = *((JpegDecodingOptions*)decodingOptions);
+
+            if (options.type != JPEG_IMAGE_FORMAT)
+            {
+                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::setDecodingOptions] options struct is not a JpegDecodingOptions";
+                return AImgErrorCode::AIMG_INVALID_ARGS;
+            }
+
+            if (options.dctMethod != AIL_JPEG_DCT_ISLOW && options.dctMethod != AIL_JPEG_DCT_IFAST && options.dctMethod != AIL_JPEG_DCT_FLOAT)
+            {
+                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::setDecodingOptions] Invalid dctMethod";
+                return AImgErrorCode::AIMG_INVALID_ARGS;
+            }
+
+            if (options.colourSpace < AIL_JPEG_COLOURSPACE_DEFAULT || options.colourSpace > AIL_JPEG_COLOURSPACE_YCBCR)
+            {
+                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::setDecodingOptions] Invalid colourSpace";
+                return AImgErrorCode::AIMG_INVALID_ARGS;
+            }
+
+            // libjpeg can't take CMYK images to any of the others
+            if (options.colourSpace != AIL_JPEG_COLOURSPACE_DEFAULT && (jpeg_read_struct.jpeg_color_space == JCS_CMYK || jpeg_read_struct.jpeg_color_space == JCS_YCCK))
+            {
+                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::setDecodingOptions] CMYK images can only be decoded in their default colour space";
+                return AImgErrorCode::AIMG_INVALID_ARGS;
+            }
+
+            jpeg_read_struct.err = jpeg_std_error(&err_mgr.pub);
+            jpeg_read_struct.err->emit_message = JPEGCallbackFunctions::lessAnnoyingEmitMessage;
+            jpeg_read_struct.err->error_exit = JPEGCallbackFunctions::handleFatalError;
+
+            if (setjmp(err_mgr.buf))
+            {
+                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::setDecodingOptions] jpeg_calc_output_dimensions failed!";
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+            }
+
+            // the AIL_JPEG_ defines have libjpeg's values
+            jpeg_read_struct.dct_method = (J_DCT_METHOD)options.dctMethod;
+            jpeg_read_struct.do_fancy_upsampling = options.fancyUpsampling ? TRUE : FALSE;
+            jpeg_read_struct.do_block_smoothing = options.blockSmoothing ? TRUE : FALSE;
+            jpeg_read_struct.out_color_space = options.colourSpace == AIL_JPEG_COLOURSPACE_DEFAULT ? defaultColourSpace : (J_COLOR_SPACE)options.colourSpace;
+
+            // the colour space sets output_components
+            jpeg_calc_output_dimensions(&jpeg_read_struct);
 
             return AImgErrorCode::AIMG_SUCCESS;
         }
 
         virtual int32_t getImageInfo(int32_t *width, int32_t *height, int32_t *numChannels, int32_t *bytesPerChannel, int32_t *floatOrInt, int32_t *decodedImgFormat, uint32_t *colourProfileLen)
         {
-            *width = jpeg_read_struct.image_width;
-            *height = jpeg_read_struct.image_height;
+            *width = jpeg_read_struct.output_width;
+            *height = jpeg_read_struct.output_height;
             *bytesPerChannel = 1;
-            *numChannels = jpeg_read_struct.num_components;
+            *numChannels = jpeg_read_struct.output_components;
             *floatOrInt = AImgFloatOrIntType::FITYPE_INT;
-            *decodedImgFormat = AImgFormat::_8BITS | AImgFormat::R << (jpeg_read_struct.num_components - 1);
+            *decodedImgFormat = getDecodeFormat();
             if (colourProfileLen != NULL)
             {
                 *colourProfileLen = 0;
@@ -262,83 +535,394 @@ namespace AImg
             return AImgErrorCode::AIMG_SUCCESS;
         }
 
+        int32_t getDecodeFormat()
+        {
+            return AImgFormat::_8BITS | AImgFormat::R << (jpeg_read_struct.output_components - 1);
+        }
+
         virtual int32_t decodeImage(void *realDestBuffer, int32_t forceImageFormat)
         {
-            void* destBuffer = realDestBuffer;
+            if (forceImageFormat == AImgFormat::INVALID_FORMAT)
+                forceImageFormat = getDecodeFormat();
+
+            int32_t numChannels, bytesPerChannel, floatOrInt;
+            AIGetFormatDetails(forceImageFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+
+            size_t destStride = (size_t)jpeg_read_struct.output_width * numChannels * bytesPerChannel;
+
+            if (!decompressStarted && decodeImageParallel(realDestBuffer, destStride, forceImageFormat))
+            {
+                // the bands had their own decompressors, this one is left unstarted and there's nothing more to read
+                decompressStarted = true;
+                nextRow = jpeg_read_struct.output_height;
+                return AImgErrorCode::AIMG_SUCCESS;
+            }
+
+            return decodeRows(realDestBuffer, 0, jpeg_read_struct.output_height, destStride, forceImageFormat);
+        }
+
+        // Decodes the whole image on the thread pool, if it has restart markers and is big enough to be worth it. The scan
+        // is cut at restarts that fall on MCU row boundaries, and each band is decoded by its own decompressor from a copy
+        // of the header with the band's height, the band's part of the scan and an EOI. Returns false if the image can't
+        // be split, so it's decoded the normal way instead. Also returns false if a band fails, but by then other bands
+        // may have written their rows, so the caller re-decodes the whole image over any partial output.
+        bool decodeImageParallel(void* destBuffer, size_t destStride, int32_t forceImageFormat)
+        {
+            uint32_t restartInterval = jpeg_read_struct.restart_interval;
+            if (restartInterval == 0 || (size_t)jpeg_read_struct.image_width * jpeg_read_struct.image_height < JPEGConsts::PARALLEL_DECODE_MIN_PIXELS)
+                return false;
+
+            std::shared_ptr<ThreadPool> pool = getThreadPool();
+            if (pool->getThreadCount() < 2)
+                return false;
 
-            std::vector<uint8_t> convertTmpBuffer(0);
-            if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != AImgFormat::RGB8U)
+            const uint8_t* data = NULL;
+            int64_t size = 0;
+            Vector<uint8_t> fileData;
+
+            if (getInMemoryData(callbacks.readCallback, callbacks.callbackData, &data, &size) && startPos <= size)
+            {
+                data += startPos;
+                size -= startPos;
+            }
+            else
             {
-                int32_t numChannels, bytesPerChannel, floatOrInt;
-                AIGetFormatDetails(AImgFormat::RGB8U, &numChannels, &bytesPerChannel, &floatOrInt);
+                // the compressed file is small next to the decoded image, so it's cheaper to read it all again than to
+                // share the stream between the bands
+                int64_t pos = callbacks.tellCallback(callbacks.callbackData);
+                callbacks.seekCallback(callbacks.callbackData, startPos);
+
+                for (;;)
+                {
+                    size_t filled = fileData.size();
+                    fileData.resize(filled + JPEGConsts::BUFFER_SIZE * 16);
+
+                    int64_t bytesRead = callbacks.readCallback(callbacks.callbackData, &fileData[filled], JPEGConsts::BUFFER_SIZE * 16);
+                    fileData.resize(filled + std::max(bytesRead, (int64_t)0));
 
-                convertTmpBuffer.resize(jpeg_read_struct.image_width * jpeg_read_struct.image_height * bytesPerChannel * numChannels);
-                destBuffer = &convertTmpBuffer[0];
+                    if (bytesRead < (int64_t)JPEGConsts::BUFFER_SIZE * 16)
+                        break;
+                }
+
+                callbacks.seekCallback(callbacks.callbackData, pos);
+
+                data = fileData.data();
+                size = fileData.size();
             }
 
+            JPEGScanLayout layout;
+            if (!findJPEGScanLayout(data, (size_t)size, jpeg_read_struct.num_components, &layout))
+                return false;
+
+            // single component scans aren't interleaved, their MCU is one block
+            uint32_t mcuWidth = DCTSIZE, mcuHeight = DCTSIZE;
+            bool verticalChroma = false;
+            if (jpeg_read_struct.num_components > 1)
+            {
+                int maxH = 1, maxV = 1;
+                for (int i = 0; i < jpeg_read_struct.num_components; i++)
+                {
+                    maxH = std::max(maxH, jpeg_read_struct.comp_info[i].h_samp_factor);
+                    maxV = std::max(maxV, jpeg_read_struct.comp_info[i].v_samp_factor);
+                }
+
+                for (int i = 0; i < jpeg_read_struct.num_components; i++)
+                    verticalChroma |= jpeg_read_struct.comp_info[i].v_samp_factor != maxV;
+
+                mcuWidth *= maxH;
+                mcuHeight *= maxV;
+            }
+
+            uint32_t mcusPerRow = (jpeg_read_struct.image_width + mcuWidth - 1) / mcuWidth;
+            uint32_t mcuRows = (jpeg_read_struct.image_height + mcuHeight - 1) / mcuHeight;
+            size_t numIntervals = ((size_t)mcusPerRow * mcuRows + restartInterval - 1) / restartInterval;
+            if (layout.restartMarkers.size() != numIntervals - 1)
+                return false;
+
+            // Bands can only start at a restart that's also the start of an MCU row. The smallest run of whole intervals
+            // and whole rows is a step, and bands are made of whole steps.
+            size_t stepIntervals = mcusPerRow / gcd(restartInterval, mcusPerRow);
+            size_t stepRows = stepIntervals * restartInterval / mcusPerRow;
+            size_t numSteps = (mcuRows + stepRows - 1) / stepRows;
+
+            size_t numBands = std::min((size_t)pool->getThreadCount(), numSteps);
+            if (numBands < 2)
+                return false;
+
+            // Fancy upsampling of vertically subsampled chroma blends in the chroma rows above and below, so then each
+            // band also decodes a step either side of its rows and throws them away, to give the same pixels as
+            // decoding the image in one go
+            size_t overlapSteps = jpeg_read_struct.do_fancy_upsampling && verticalChroma ? 1 : 0;
+
+            uint32_t scaleDenom = jpeg_read_struct.scale_denom;
+            uint32_t imageHeight = jpeg_read_struct.image_height;
+            int32_t decodeFormat = getDecodeFormat();
+            std::atomic<bool> failed(false);
+
+            pool->parallelFor(numBands, [&](size_t band)
+            {
+                AImg::TraceScope trace(AImg::TRACE_DECODE_BLOCK);
+
+                size_t firstStep = band * numSteps / numBands;
+                size_t endStep = (band + 1) * numSteps / numBands;
+                size_t decodeFirstStep = firstStep - std::min(firstStep, overlapSteps);
+                size_t decodeEndStep = std::min(endStep + overlapSteps, numSteps);
+
+                // in image rows
+                uint32_t decodeFirst = (uint32_t)(decodeFirstStep * stepRows * mcuHeight);
+                uint32_t decodeEnd = (uint32_t)std::min<size_t>(decodeEndStep * stepRows * mcuHeight, imageHeight);
+                uint32_t keepFirst = (uint32_t)(firstStep * stepRows * mcuHeight);
+                uint32_t keepEnd = (uint32_t)std::min<size_t>(endStep * stepRows * mcuHeight, imageHeight);
+
+                size_t firstInterval = decodeFirstStep * stepIntervals;
+                size_t endInterval = std::min(decodeEndStep * stepIntervals, numIntervals);
+                size_t scanFrom = firstInterval == 0 ? layout.scanStart : layout.restartMarkers[firstInterval - 1] + 2;
+                size_t scanTo = endInterval == numIntervals ? layout.scanEnd : layout.restartMarkers[endInterval - 1];
+
+                Vector<uint8_t> bandData;
+                bandData.reserve(layout.scanStart + (scanTo - scanFrom) + 2);
+                bandData.insert(bandData.end(), data, data + layout.scanStart);
+                bandData.insert(bandData.end(), data + scanFrom, data + scanTo);
+                bandData.push_back(0xFF);
+                bandData.push_back(0xD9);
+
+                uint32_t bandHeight = decodeEnd - decodeFirst;
+                bandData[layout.sofHeightOffset] = (uint8_t)(bandHeight >> 8);
+                bandData[layout.sofHeightOffset + 1] = (uint8_t)bandHeight;
+
+                // the decoder expects the band's restart markers to count up from RST0
+                for (size_t i = firstInterval; i + 1 < endInterval; i++)
+                    bandData[layout.restartMarkers[i] - scanFrom + layout.scanStart + 1] = (uint8_t)(0xD0 + ((i - firstInterval) & 7));
+
+                // rows of the band's output, which is scaled like the whole image's. Band edges are multiples of 8
+                // rows, so they scale exactly.
+                uint32_t outFirst = (keepFirst - decodeFirst) / scaleDenom;
+                uint32_t outEnd = (keepEnd - decodeFirst + scaleDenom - 1) / scaleDenom;
+                uint8_t* bandDest = (uint8_t*)destBuffer + (size_t)(keepFirst / scaleDenom) * destStride;
+
+                if (!decodeRestartBand(bandData, outFirst, outEnd, bandDest, destStride, decodeFormat, forceImageFormat))
+                    failed = true;
+            });
+
+            return !failed;
+        }
+
+        // Decodes output rows [firstRow, endRow) of a band made by decodeImageParallel into destBuffer, with the same
+        // settings as the image's own decompressor
+        bool decodeRestartBand(Vector<uint8_t>& bandData, uint32_t firstRow, uint32_t endRow, uint8_t* destBuffer, size_t destStride,
+            int32_t decodeFormat, int32_t forceImageFormat)
+        {
+            jpeg_decompress_struct cinfo;
             ArtomatixErrorStruct jerr;
-            jpeg_read_struct.err = jpeg_std_error(&jerr.pub);
+            cinfo.err = jpeg_std_error(&jerr.pub);
+            cinfo.err->emit_message = JPEGCallbackFunctions::lessAnnoyingEmitMessage;
+            cinfo.err->error_exit = JPEGCallbackFunctions::handleFatalError;
+            jpeg_create_decompress(&cinfo);
+
+            Vector<uint8_t> rows;
+            Vector<JSAMPROW> ptrs;
+
+            if (setjmp(jerr.buf))
+            {
+                jpeg_destroy_decompress(&cinfo);
+                return false;
+            }
+
+            jpeg_mem_src(&cinfo, (unsigned char *)bandData.data(), (unsigned long)bandData.size());
+            jpeg_read_header(&cinfo, TRUE);
+
+            cinfo.scale_num = jpeg_read_struct.scale_num;
+            cinfo.scale_denom = jpeg_read_struct.scale_denom;
+            cinfo.dct_method = jpeg_read_struct.dct_method;
+            cinfo.do_fancy_upsampling = jpeg_read_struct.do_fancy_upsampling;
+            cinfo.do_block_smoothing = jpeg_read_struct.do_block_smoothing;
+            cinfo.out_color_space = jpeg_read_struct.out_color_space;
+
+            jpeg_start_decompress(&cinfo);
+
+            size_t rowStride = (size_t)cinfo.output_components * cinfo.output_width;
+            bool direct = forceImageFormat == decodeFormat;
+
+            // rows outside the band are read into one throwaway row, and when converting the kept rows go through a
+            // small buffer a few at a time
+            uint32_t chunkRows = direct ? endRow - firstRow : std::min((uint32_t)AImg::getDecodeBandRows(cinfo.output_width, decodeFormat), endRow - firstRow);
+            rows.resize(rowStride * (direct ? 1 : chunkRows));
+            ptrs.resize(std::max(chunkRows, (uint32_t)cinfo.rec_outbuf_height));
+
+            while (cinfo.output_scanline < firstRow)
+            {
+                uint32_t count = std::min((uint32_t)ptrs.size(), firstRow - cinfo.output_scanline);
+                for (uint32_t i = 0; i < count; i++)
+                    ptrs[i] = (JSAMPROW)rows.data();
+
+                jpeg_read_scanlines(&cinfo, ptrs.data(), count);
+            }
+
+            for (uint32_t y = firstRow; y < endRow; y += chunkRows)
+            {
+                uint32_t count = std::min(chunkRows, endRow - y);
+                for (uint32_t i = 0; i < count; i++)
+                    ptrs[i] = direct ? (JSAMPROW)(destBuffer + (size_t)(y - firstRow + i) * destStride) : (JSAMPROW)(rows.data() + i * rowStride);
+
+                for (uint32_t done = 0; done < count; )
+                    done += jpeg_read_scanlines(&cinfo, ptrs.data() + done, count - done);
+
+                if (!direct && AImg::convertRows(rows.data(), rowStride, destBuffer + (size_t)(y - firstRow) * destStride, destStride, cinfo.output_width, count,
+                    decodeFormat, forceImageFormat) != AImgErrorCode::AIMG_SUCCESS)
+                {
+                    jpeg_destroy_decompress(&cinfo);
+                    return false;
+                }
+            }
+
+            // the rows under the band are only there for upsampling, there's no need to decode them
+            jpeg_destroy_decompress(&cinfo);
+            return true;
+        }
+
+        // Reads the next count scanlines into rows, as many at a time as libjpeg will give. Must be called under a setjmp
+        // on err_mgr.
+        bool readScanlines(JSAMPARRAY rows, uint32_t count)
+        {
+            for (uint32_t done = 0; done < count; )
+            {
+                JDIMENSION read = jpeg_read_scanlines(&jpeg_read_struct, rows + done, count - done);
+
+                // our source only suspends when the stream runs out
+                if (read == 0)
+                {
+                    mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::readScanlines] Unexpected end of file";
+                    return false;
+                }
+
+                done += read;
+                nextRow += read;
+            }
+
+            return true;
+        }
+
+        virtual int32_t decodeRows(void *destBuffer, int32_t firstRow, int32_t numRows, size_t destStride, int32_t forceImageFormat)
+        {
+            if ((uint32_t)firstRow < nextRow)
+            {
+                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::decodeRows] Rows must be decoded from the top down, can't go back to an earlier row";
+                return AImgErrorCode::AIMG_INVALID_ARGS;
+            }
+
+            // the error handler has to outlive this call, as the decompressor is used again for the next band
+            jpeg_read_struct.err = jpeg_std_error(&err_mgr.pub);
             jpeg_read_struct.err->emit_message = JPEGCallbackFunctions::lessAnnoyingEmitMessage;
             jpeg_read_struct.err->error_exit = JPEGCallbackFunctions::handleFatalError;
 
-            ArtomatixErrorStruct * err_ptr = (ArtomatixErrorStruct *)jpeg_read_struct.err;
-
-            if (setjmp(err_ptr->buf))
+            if (setjmp(err_mgr.buf))
             {
-                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::decodeImage] jpeg_start_decompress failed!";
+                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::decodeRows] jpeg_start_decompress failed!";
                 return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
             }
 
-            jpeg_start_decompress(&jpeg_read_struct);
-
-            int row_stride = jpeg_read_struct.output_components * jpeg_read_struct.output_width;
+            if (!decompressStarted)
+            {
+                jpeg_start_decompress(&jpeg_read_struct);
+                decompressStarted = true;
+            }
 
-            JSAMPROW buffer[1];
+            int32_t decodeFormat = getDecodeFormat();
+            size_t row_stride = jpeg_read_struct.output_components * jpeg_read_struct.output_width;
 
-            buffer[0] = (JSAMPROW)destBuffer;
+            ScratchBuffer bandBuffer(mScratch, Scratch::BAND);
+            ScratchBuffer ptrsBuffer(mScratch, Scratch::ROW_POINTERS);
 
-            if (setjmp(err_ptr->buf))
+            if (setjmp(err_mgr.buf))
             {
-                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::decodeImage] jpeg_read_scanlines failed!";
+                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::decodeRows] jpeg_read_scanlines failed!";
                 return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
             }
 
-            while (jpeg_read_struct.output_scanline < jpeg_read_struct.output_height)
+            // skipped rows still have to be decoded, libjpeg can only go forwards. They go into a throwaway band of
+            // rec_outbuf_height rows, the most libjpeg gives back from one jpeg_read_scanlines call.
+            if (nextRow < (uint32_t)firstRow)
             {
-                jpeg_read_scanlines(&jpeg_read_struct, buffer, 1);
-                buffer[0] = (uint8_t *)buffer[0] + row_stride;
+                uint32_t skipRows = std::min((uint32_t)std::max(jpeg_read_struct.rec_outbuf_height, 1), (uint32_t)firstRow - nextRow);
+                bandBuffer.resize(skipRows * row_stride);
+                JSAMPROW *ptrs = (JSAMPROW *)ptrsBuffer.resize(skipRows * sizeof(JSAMPROW));
+
+                for (uint32_t i = 0; i < skipRows; i++)
+                    ptrs[i] = (JSAMPROW)(bandBuffer.data() + i * row_stride);
+
+                while (nextRow < (uint32_t)firstRow)
+                {
+                    if (!readScanlines(ptrs, std::min(skipRows, (uint32_t)firstRow - nextRow)))
+                        return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+                }
             }
 
-            jpeg_finish_decompress(&jpeg_read_struct);
+            if (forceImageFormat == decodeFormat)
+            {
+                // Every row is handed over in one go, so libjpeg can write whole iMCU rows straight into the destination
+                JSAMPROW *ptrs = (JSAMPROW *)ptrsBuffer.resize(numRows * sizeof(JSAMPROW));
+                for (int32_t y = 0; y < numRows; y++)
+                    ptrs[y] = (JSAMPROW)destBuffer + y * destStride;
 
-            if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != AImgFormat::RGB8U)
+                if (!readScanlines(ptrs, numRows))
+                    return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+            }
+            else
             {
-                int32_t err = AImgConvertFormat(destBuffer, realDestBuffer, jpeg_read_struct.image_width, jpeg_read_struct.image_height, AImgFormat::RGB8U, forceImageFormat);
-                if (err != AImgErrorCode::AIMG_SUCCESS)
-                    return err;
+                // When converting, scanlines are decoded a band at a time into a small buffer and each band is converted
+                // straight into the destination, so we never hold a second copy of the whole image
+                uint32_t bandRows = std::min((uint32_t)AImg::getDecodeBandRows(jpeg_read_struct.output_width, decodeFormat), (uint32_t)numRows);
+                bandBuffer.resize(bandRows * row_stride);
+                JSAMPROW *ptrs = (JSAMPROW *)ptrsBuffer.resize(bandRows * sizeof(JSAMPROW));
+
+                for (uint32_t i = 0; i < bandRows; i++)
+                    ptrs[i] = (JSAMPROW)(bandBuffer.data() + i * row_stride);
+
+                for (uint32_t y = 0; y < (uint32_t)numRows; y += bandRows)
+                {
+                    AImg::TraceScope trace(AImg::TRACE_DECODE_BLOCK);
+                    uint32_t rows = std::min(bandRows, numRows - y);
+
+                    if (!readScanlines(ptrs, rows))
+                        return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+
+                    int32_t err = AImg::convertRows(bandBuffer.data(), row_stride, (uint8_t *)destBuffer + y * destStride, destStride, jpeg_read_struct.output_width, rows, decodeFormat, forceImageFormat);
+                    if (err != AImgErrorCode::AIMG_SUCCESS)
+                        return err;
+                }
             }
 
+            if (nextRow == jpeg_read_struct.output_height)
+                jpeg_finish_decompress(&jpeg_read_struct);
+
             return AImgErrorCode::AIMG_SUCCESS;
         }
 
         int32_t writeImage(void *data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat, const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
-            WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData, void* encodingOptions)
+            WriteCallback64 writeCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void *callbackData, void* encodingOptions)
         {
-            AIL_UNUSED_PARAM(encodingOptions);
             AIL_UNUSED_PARAM(outputFormat);
 
-            std::vector<uint8_t> convertBuffer(0);
+            ScratchBuffer convertBuffer(mScratch, Scratch::CONVERT);
             if (inputFormat != AImgFormat::RGB8U)
             {
-                convertBuffer.resize(width * height * 3);
+                convertBuffer.resize((size_t)width * height * 3);
 
-                int32_t convertError = AImgConvertFormat(data, &convertBuffer[0], width, height, inputFormat, AImgFormat::RGB8U);
+                int32_t convertError = AImgConvertFormat(data, convertBuffer.data(), width, height, inputFormat, AImgFormat::RGB8U);
 
                 if (convertError != AImgErrorCode::AIMG_SUCCESS)
                     return convertError;
-                data = &convertBuffer[0];
+                data = convertBuffer.data();
             }
 
+            // RGB8U rows, set up before the setjmps below so a longjmp can't clobber them
+            size_t row_stride = (size_t)width * 3;
+
+            ScratchBuffer ptrsBuffer(mScratch, Scratch::ROW_POINTERS);
+            JSAMPROW *ptrs = (JSAMPROW *)ptrsBuffer.resize(height * sizeof(JSAMPROW));
+            for (int32_t y = 0; y < height; y++)
+                ptrs[y] = (JSAMPROW)data + y * row_stride;
+
             CallbackData dataStruct;
             dataStruct.writeCallback = writeCallback;
             dataStruct.tellCallback = tellCallback;
@@ -361,7 +945,27 @@ namespace AImg
 
             jpeg_set_defaults(&cinfo);
 
-            jpeg_set_quality(&cinfo, JPEGConsts::Quality, TRUE);
+            if (encodingOptions != NULL)
+            {
+                // already checked by verifyEncodeOptions
+                JpegEncodingOptions* options = (JpegEncodingOptions*)encodingOptions;
+
+                jpeg_set_quality(&cinfo, options->quality, TRUE);
+
+                // the chroma components are always 1x1, so luma's factors are how much more detail it keeps
+                cinfo.comp_info[0].h_samp_factor = options->subsampling == AIL_JPEG_SUBSAMPLING_444 ? 1 : 2;
+                cinfo.comp_info[0].v_samp_factor = options->subsampling == AIL_JPEG_SUBSAMPLING_420 ? 2 : 1;
+
+                if (options->progressive)
+                    jpeg_simple_progression(&cinfo);
+
+                cinfo.optimize_coding = options->optimizeCoding ? TRUE : FALSE;
+                cinfo.restart_interval = options->restartInterval;
+            }
+            else
+            {
+                jpeg_set_quality(&cinfo, JPEGConsts::DefaultQuality, TRUE);
+            }
 
             if (setjmp(jerr.buf))
             {
@@ -370,27 +974,55 @@ namespace AImg
             }
             jpeg_start_compress(&cinfo, TRUE);
 
-            int row_stride = width * cinfo.input_components;
-
-            JSAMPROW row_pointer[1];
-
             if (setjmp(jerr.buf))
             {
                 mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::writeImage] jpeg_write_scanlines failed!";
                 return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
             }
 
+            // the whole image at once, libjpeg takes as many rows from it as it can per pass
             while (cinfo.next_scanline < cinfo.image_height)
-            {
-                row_pointer[0] = (uint8_t *)data + row_stride * cinfo.next_scanline;
-                jpeg_write_scanlines(&cinfo, row_pointer, 1);
-            }
+                jpeg_write_scanlines(&cinfo, ptrs + cinfo.next_scanline, cinfo.image_height - cinfo.next_scanline);
 
             jpeg_finish_compress(&cinfo);
             jpeg_destroy_compress(&cinfo);
 
             return AImgErrorCode::AIMG_SUCCESS;
         }
+
+        int32_t verifyEncodeOptions(void* encodeOptions)
+        {
+            if (encodeOptions != NULL)
+            {
+                if (*((int*)encodeOptions) != AImgFileFormat::JPEG_IMAGE_FORMAT)
+                {
+                    mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::verifyEncodeOptions] Args for another format encoder type passed to jpeg encoder, or incorrectly initialised args struct passed.";
+                    return AImgErrorCode::AIMG_INVALID_ENCODE_ARGS;
+                }
+
+                auto options = (JpegEncodingOptions*)encodeOptions;
+
+                if (options->quality < 1 || options->quality > 100)
+                {
+                    mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::verifyEncodeOptions] Invalid quality specified, must be in inclusive range (1-100)";
+                    return AImgErrorCode::AIMG_INVALID_ENCODE_ARGS;
+                }
+
+                if (options->subsampling != AIL_JPEG_SUBSAMPLING_444 && options->subsampling != AIL_JPEG_SUBSAMPLING_422 && options->subsampling != AIL_JPEG_SUBSAMPLING_420)
+                {
+                    mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::verifyEncodeOptions] Invalid subsampling specified";
+                    return AImgErrorCode::AIMG_INVALID_ENCODE_ARGS;
+                }
+
+                if (options->restartInterval < 0 || options->restartInterval > 65535)
+                {
+                    mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::verifyEncodeOptions] Invalid restart interval specified, must be in inclusive range (0-65535)";
+                    return AImgErrorCode::AIMG_INVALID_ENCODE_ARGS;
+                }
+            }
+
+            return AImgErrorCode::AIMG_SUCCESS;
+        }
     };
 
     AImgFormat JPEGImageLoader::getWhatFormatWillBeWrittenForData(int32_t inputFormat, int32_t outputFormat)
@@ -3,10 +3,15 @@
 #include "AIL.h"
 #include "png.h"
 #include "AIL_internal.h"
+#include "convert.h"
+#include "probe.h"
+#include "scratch.h"
+#include "trace.h"
 #include <vector>
 #include <png.h>
 #include <string.h>
 #include <cstring>
+#include <algorithm>
 #include <iostream>
 
 namespace AImg
@@ -16,31 +21,38 @@ namespace AImg
         return AImgErrorCode::AIMG_SUCCESS;
     }
 
-    bool PNGImageLoader::canLoadImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData)
+    bool PNGImageLoader::canLoadImage(const uint8_t *header, int32_t headerSize)
     {
-        int32_t startingPosition = tellCallback(callbackData);
-        std::vector<uint8_t> header(8);
-        readCallback(callbackData, &header[0], 8);
-
-        seekCallback(callbackData, startingPosition);
-
         uint8_t png_signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
 
-        return ((int32_t)(memcmp(&header[0], &png_signature[0], 8))) == 0;
+        return headerSize >= 8 && ((int32_t)(memcmp(header, &png_signature[0], 8))) == 0;
     }
 
     void png_custom_read_data(png_struct* png_ptr, png_byte* data, png_size_t length)
     {
         CallbackData callbackData = *((CallbackData *)png_get_io_ptr(png_ptr));
 
-        callbackData.readCallback(callbackData.callbackData, data, (int32_t)length);
+        callbackData.readCallback(callbackData.callbackData, data, (int64_t)length);
     }
 
     void png_custom_write_data(png_struct* png_ptr, png_byte* data, png_size_t length)
     {
         CallbackData callbackData = *((CallbackData *)png_get_io_ptr(png_ptr));
 
-        callbackData.writeCallback(callbackData.callbackData, data, (int32_t)length);
+        callbackData.writeCallback(callbackData.callbackData, data, (int64_t)length);
+    }
+
+    // libpng's allocations go through the AImgSetAllocator allocator too
+    png_voidp png_custom_malloc(png_struct* png_ptr, png_alloc_size_t size)
+    {
+        AIL_UNUSED_PARAM(png_ptr);
+        return AImg::allocate(size);
+    }
+
+    void png_custom_free(png_struct* png_ptr, png_voidp ptr)
+    {
+        AIL_UNUSED_PARAM(png_ptr);
+        AImg::deallocate(ptr);
     }
 
     std::string PNGImageLoader::getFileExtension()
@@ -53,6 +65,80 @@ namespace AImg
         return PNG_IMAGE_FORMAT;
     }
 
+    int32_t PNGImageLoader::probeImage(ProbeReader& reader, AImgProbeInfo* info)
+    {
+        // the signature, then IHDR, which has to be the first chunk
+        const uint8_t* ihdr = reader.get(8, 8 + 13);
+        if (ihdr == NULL || memcmp(ihdr + 4, "IHDR", 4) != 0)
+            return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+
+        info->width = (int32_t)((ihdr[8] << 24) | (ihdr[9] << 16) | (ihdr[10] << 8) | ihdr[11]);
+        info->height = (int32_t)((ihdr[12] << 24) | (ihdr[13] << 16) | (ihdr[14] << 8) | ihdr[15]);
+        int32_t bitDepth = ihdr[16];
+        int32_t colourType = ihdr[17];
+
+        // tRNS has to come before the image data, so walk the chunk headers up to the first IDAT looking for it
+        bool hasTransparency = false;
+        for (int64_t offset = 8 + 8 + 13 + 4; ; )
+        {
+            uint32_t length;
+            const uint8_t* type;
+            if (!reader.readU32BE(offset, &length) || (type = reader.get(offset + 4, 4)) == NULL)
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+
+            if (memcmp(type, "IDAT", 4) == 0 || memcmp(type, "IEND", 4) == 0)
+                break;
+            if (memcmp(type, "tRNS", 4) == 0)
+                hasTransparency = true;
+
+            offset += 4 + 4 + (int64_t)length + 4;
+        }
+
+        // the same expansions PNGFile::openImage asks libpng for
+        switch (colourType)
+        {
+        case PNG_COLOR_TYPE_GRAY:
+            info->numChannels = 1;
+            break;
+        case PNG_COLOR_TYPE_RGB:
+            info->numChannels = 3;
+            break;
+        case PNG_COLOR_TYPE_PALETTE:
+            info->numChannels = 3;
+            bitDepth = 8;
+            break;
+        case PNG_COLOR_TYPE_GRAY_ALPHA:
+            info->numChannels = 2;
+            break;
+        case PNG_COLOR_TYPE_RGB_ALPHA:
+            info->numChannels = 4;
+            break;
+        default:
+            return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+        }
+
+        if (colourType == PNG_COLOR_TYPE_GRAY && bitDepth < 8)
+            bitDepth = 8;
+
+        if (hasTransparency)
+            info->numChannels++;
+
+        if ((hasTransparency && colourType == PNG_COLOR_TYPE_GRAY) || colourType == PNG_COLOR_TYPE_GRAY_ALPHA)
+            info->numChannels = 4;
+
+        info->bytesPerChannel = bitDepth / 8 == 0 ? -1 : bitDepth / 8;
+        info->floatOrInt = AImgFloatOrIntType::FITYPE_INT;
+
+        if (bitDepth == 8)
+            info->decodedImgFormat = AImgFormat::_8BITS | (AImgFormat::R << (info->numChannels - 1));
+        else if (bitDepth == 16)
+            info->decodedImgFormat = AImgFormat::_16BITS | (AImgFormat::R << (info->numChannels - 1));
+        else
+            info->decodedImgFormat = AImgFormat::INVALID_FORMAT;
+
+        return AImgErrorCode::AIMG_SUCCESS;
+    }
+
     void flush_data_noop_func(png_struct* png_ptr)
     {
         AIL_UNUSED_PARAM(png_ptr);
@@ -125,6 +211,10 @@ namespace AImg
             uint8_t * compressedProfile = NULL;
             uint32_t compressedProfileLen = 0;
 
+            // State for decoding a band of rows at a time, libpng only lets us read rows in order
+            bool rowsStarted = false;
+            uint32_t nextRow = 0;
+
             PNGFile()
             {
                 data = new CallbackData();
@@ -142,14 +232,14 @@ namespace AImg
                 }
             }
 
-            int32_t openImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData)
+            int32_t openImage(ReadCallback64 readCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void *callbackData)
             {
                 data->readCallback = readCallback;
                 data->tellCallback = tellCallback;
                 data->seekCallback = seekCallback;
                 data->callbackData = callbackData;
 
-                png_read_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+                png_read_ptr = png_create_read_struct_2(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL, NULL, png_custom_malloc, png_custom_free);
                 png_set_option(png_read_ptr, PNG_SKIP_sRGB_CHECK_PROFILE, PNG_OPTION_OFF);
                 png_info_ptr = png_create_info_struct(png_read_ptr);
 
@@ -286,46 +376,145 @@ namespace AImg
 
             virtual int32_t decodeImage(void *realDestBuffer, int32_t forceImageFormat)
             {
+                int32_t decodeFormat = getDecodeFormat();
+                bool needsConvert = forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != decodeFormat;
+
+                // Non-interlaced images are read a band at a time, which means converting doesn't need a second full size buffer
+                if (png_get_interlace_type(png_read_ptr, png_info_ptr) == PNG_INTERLACE_NONE)
+                {
+                    int32_t rowsFormat = needsConvert ? forceImageFormat : decodeFormat;
+
+                    int32_t numChannels, bytesPerChannel, floatOrInt;
+                    AIGetFormatDetails(rowsFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+
+                    return decodeRows(realDestBuffer, 0, height, (size_t)width * numChannels * bytesPerChannel, rowsFormat);
+                }
 
                 #if AIL_BYTEORDER == AIL_LIL_ENDIAN
                 if (bit_depth > 8)
                    png_set_swap(png_read_ptr);
                 #endif
 
+                void* destBuffer = realDestBuffer;
+
+                // Interlaced images only come together once the last pass is read, so they still need a full size buffer to convert from
+                ScratchBuffer convertTmpBuffer(mScratch, Scratch::CONVERT);
+                if (needsConvert)
+                {
+                    int32_t numChannels, bytesPerChannel, floatOrInt;
+                    AIGetFormatDetails(decodeFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+
+                    destBuffer = convertTmpBuffer.resize((size_t)width * height * bytesPerChannel * numChannels);
+                }
+
+                ScratchBuffer ptrsBuffer(mScratch, Scratch::ROW_POINTERS);
+                void **ptrs = (void **)ptrsBuffer.resize(height * sizeof(void *));
+
+                for (uint32_t y = 0; y < height; y++)
+                    ptrs[y] = (void *)((size_t)destBuffer + (y*width * (bit_depth/8) * numChannels));
+
                 // This sets a restore point for libpng if reading fails internally
                 // Crazy old C exceptions without exceptions
+                // It's set after the buffers are made, so jumping back doesn't skip their destructors
                 if (setjmp(png_jmpbuf(png_read_ptr)))
                 {
                     mErrorDetails = "[PNGImageLoader::PNGFile::decodeImage] Failed to read file";
                     return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
                 }
 
-                void* destBuffer = realDestBuffer;
+                png_read_image(png_read_ptr, (png_bytepp)ptrs);
+
+                if (needsConvert)
+                {
+                    int32_t err = AImgConvertFormat(destBuffer, realDestBuffer, width, height, decodeFormat, forceImageFormat);
+                    if(err != AImgErrorCode::AIMG_SUCCESS)
+                        return err;
+                }
+
+                return AImgErrorCode::AIMG_SUCCESS;
+            }
+
+            virtual int32_t decodeRows(void* destBuffer, int32_t firstRow, int32_t numRows, size_t destStride, int32_t forceImageFormat)
+            {
+                // interlaced rows aren't finished until the last pass, so for those we have to decode the whole image
+                if (png_get_interlace_type(png_read_ptr, png_info_ptr) != PNG_INTERLACE_NONE)
+                    return AImgBase::decodeRows(destBuffer, firstRow, numRows, destStride, forceImageFormat);
+
+                if ((uint32_t)firstRow < nextRow)
+                {
+                    mErrorDetails = "[PNGImageLoader::PNGFile::decodeRows] Rows must be decoded from the top down, can't go back to an earlier row";
+                    return AImgErrorCode::AIMG_INVALID_ARGS;
+                }
+
+                if (setjmp(png_jmpbuf(png_read_ptr)))
+                {
+                    mErrorDetails = "[PNGImageLoader::PNGFile::decodeRows] Failed to read file";
+                    return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+                }
+
+                if (!rowsStarted)
+                {
+                    #if AIL_BYTEORDER == AIL_LIL_ENDIAN
+                    if (bit_depth > 8)
+                       png_set_swap(png_read_ptr);
+                    #endif
+
+                    png_start_read_image(png_read_ptr);
+                    rowsStarted = true;
+                }
+
+                ScratchBuffer bandScratch(mScratch, Scratch::BAND);
+                ScratchBuffer ptrsBuffer(mScratch, Scratch::ROW_POINTERS);
+
+                // set again now the buffers exist, so jumping back doesn't skip their destructors
+                if (setjmp(png_jmpbuf(png_read_ptr)))
+                {
+                    mErrorDetails = "[PNGImageLoader::PNGFile::decodeRows] Failed to read file";
+                    return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+                }
 
                 int32_t decodeFormat = getDecodeFormat();
+                size_t decodeRowSize = (size_t)width * (bit_depth/8) * numChannels;
 
+                uint8_t *bandBuffer = bandScratch.resize(decodeRowSize);
 
-                std::vector<uint8_t> convertTmpBuffer(0);
-                if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != decodeFormat)
+                // libpng can't seek, so skipped rows still have to be decoded
+                while (nextRow < (uint32_t)firstRow)
                 {
-                    int32_t numChannels, bytesPerChannel, floatOrInt;
-                    AIGetFormatDetails(decodeFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+                    png_read_row(png_read_ptr, bandBuffer, NULL);
+                    nextRow++;
+                }
+
+                if (forceImageFormat == decodeFormat)
+                {
+                    for (int32_t y = 0; y < numRows; y++)
+                    {
+                        png_read_row(png_read_ptr, (png_bytep)destBuffer + y * destStride, NULL);
+                        nextRow++;
+                    }
 
-                    convertTmpBuffer.resize(width * height * bytesPerChannel * numChannels);
-                    destBuffer = &convertTmpBuffer[0];
+                    return AImgErrorCode::AIMG_SUCCESS;
                 }
 
-                std::vector<void*> ptrs(height);
+                // Read a band of rows at a time into a small buffer, and convert each band straight into destBuffer
+                uint32_t bandRows = std::min((uint32_t)AImg::getDecodeBandRows(width, decodeFormat), (uint32_t)numRows);
 
-                for (uint32_t y = 0; y < height; y++)
-                    ptrs[y] = (void *)((size_t)destBuffer + (y*width * (bit_depth/8) * numChannels));
+                bandBuffer = bandScratch.resize(bandRows * decodeRowSize);
 
+                png_bytep *ptrs = (png_bytep *)ptrsBuffer.resize(bandRows * sizeof(png_bytep));
 
-                png_read_image(png_read_ptr, (png_bytepp)&ptrs[0]);
+                for (uint32_t y = 0; y < bandRows; y++)
+                    ptrs[y] = &bandBuffer[y * decodeRowSize];
 
-                if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != decodeFormat)
+                for (uint32_t y = 0; y < (uint32_t)numRows; y += bandRows)
                 {
-                    int32_t err = AImgConvertFormat(destBuffer, realDestBuffer, width, height, decodeFormat, forceImageFormat);
+                    AImg::TraceScope trace(AImg::TRACE_DECODE_BLOCK);
+                    uint32_t rows = std::min(bandRows, numRows - y);
+
+                    png_read_rows(png_read_ptr, ptrs, NULL, rows);
+                    nextRow += rows;
+
+                    int32_t err = AImg::convertRows(bandBuffer, decodeRowSize, (uint8_t*)destBuffer + y * destStride, destStride, width, rows, decodeFormat, forceImageFormat);
                     if(err != AImgErrorCode::AIMG_SUCCESS)
                         return err;
                 }
@@ -335,12 +524,12 @@ namespace AImg
 
             int32_t writeImage(void *data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat,
                 const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
-                WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData, void* encodingOptions)
+                WriteCallback64 writeCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void *callbackData, void* encodingOptions)
             {
                 AIL_UNUSED_PARAM(tellCallback);
                 AIL_UNUSED_PARAM(seekCallback);
 
-                png_struct * png_write_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+                png_struct * png_write_ptr = png_create_write_struct_2(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL, NULL, png_custom_malloc, png_custom_free);
                 png_set_option(png_write_ptr, PNG_SKIP_sRGB_CHECK_PROFILE, PNG_OPTION_OFF);
                 png_info * png_info_ptr = png_create_info_struct(png_write_ptr);
 
@@ -361,19 +550,19 @@ namespace AImg
 
                 int32_t writeFormat = getWhatFormatWillBeWrittenForDataPNG(inputFormat, outputFormat);
 
-                std::vector<uint8_t> convertBuffer(0);
+                ScratchBuffer convertBuffer(mScratch, Scratch::CONVERT);
 
                 if (writeFormat != inputFormat)
                 {
                     int32_t numChannels, bytesPerChannel, floatOrInt;
                     AIGetFormatDetails(writeFormat, &numChannels, &bytesPerChannel, &floatOrInt) ;
-                    convertBuffer.resize(width * height * numChannels * bytesPerChannel);
+                    convertBuffer.resize((size_t)width * height * numChannels * bytesPerChannel);
 
-                    int32_t convertError = AImgConvertFormat(data, &convertBuffer[0], width, height, inputFormat, writeFormat);
+                    int32_t convertError = AImgConvertFormat(data, convertBuffer.data(), width, height, inputFormat, writeFormat);
 
                     if (convertError != AImgErrorCode::AIMG_SUCCESS)
                         return convertError;
-                    data = &convertBuffer[0];
+                    data = convertBuffer.data();
 
                     int outChannels = numChannels;
                     AIGetFormatDetails(inputFormat, &numChannels, &bytesPerChannel, &floatOrInt);
@@ -437,7 +626,8 @@ namespace AImg
 
                 size_t step = width * numChannels * bytesPerChannel;
 
-                png_bytepp ptrs = (png_bytepp)malloc(sizeof(png_bytep) * height);
+                ScratchBuffer ptrsBuffer(mScratch, Scratch::ROW_POINTERS);
+                png_bytep *ptrs = (png_bytep *)ptrsBuffer.resize(height * sizeof(png_bytep));
 
                 ptrs[0] = (png_bytep)data;
                 for (int32_t y = 1; y < height; y++)
@@ -463,7 +653,7 @@ namespace AImg
                     mErrorDetails = "[AImg::PNGImageLoader::PNGFile::writeImage] Failed to write file";
                     return AImgErrorCode::AIMG_WRITE_FAILED_EXTERNAL;
                 }
-                png_write_image(png_write_ptr, (png_bytepp)ptrs);
+                png_write_image(png_write_ptr, ptrs);
 
                 if (setjmp(png_jmpbuf(png_write_ptr)))
                 {
@@ -473,7 +663,6 @@ namespace AImg
 
                 png_write_end(png_write_ptr, png_info_ptr);
 
-                free(ptrs);
                 png_destroy_write_struct(&png_write_ptr, &png_info_ptr);
                 png_destroy_info_struct(png_write_ptr, &png_info_ptr);
                 delete callbackDataStruct;
@@ -0,0 +1,168 @@
+#include "probe.h"
+#include "AIL_internal.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace AImg
+{
+    ProbeReader::ProbeReader(ReadCallback64 readCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void* callbackData)
+        : mReadCallback(readCallback), mSeekCallback(seekCallback), mCallbackData(callbackData), mStartPos(tellCallback(callbackData)), mStreamPos(0),
+          mInMemoryData(NULL), mInMemorySize(0), mBlockStart(0), mBlockFilled(0)
+    {
+        const uint8_t* inMemoryData = NULL;
+        int64_t inMemorySize = 0;
+        if (getInMemoryData(readCallback, callbackData, &inMemoryData, &inMemorySize) && mStartPos <= inMemorySize)
+        {
+            mInMemoryData = inMemoryData + mStartPos;
+            mInMemorySize = inMemorySize - mStartPos;
+        }
+    }
+
+    ProbeReader::~ProbeReader()
+    {
+        if (mStreamPos != 0)
+            mSeekCallback(mCallbackData, mStartPos);
+    }
+
+    const uint8_t* ProbeReader::get(int64_t offset, int32_t count)
+    {
+        int32_t available = count;
+        const uint8_t* data = getUpTo(offset, &available);
+
+        return available == count ? data : NULL;
+    }
+
+    const uint8_t* ProbeReader::getUpTo(int64_t offset, int32_t* count)
+    {
+        if (offset < 0 || *count < 0 || *count > PROBE_BLOCK_SIZE)
+        {
+            *count = 0;
+            return NULL;
+        }
+
+        if (mInMemoryData != NULL)
+        {
+            offset = std::min(offset, mInMemorySize);
+            *count = (int32_t)std::min<int64_t>(*count, mInMemorySize - offset);
+            return mInMemoryData + offset;
+        }
+
+        if (offset < mBlockStart || offset + *count > mBlockStart + mBlockFilled)
+        {
+            if (mStreamPos != offset)
+                mSeekCallback(mCallbackData, mStartPos + offset);
+
+            int64_t bytesRead = mReadCallback(mCallbackData, mBlock, PROBE_BLOCK_SIZE);
+            if (bytesRead < 0)
+                bytesRead = 0;
+
+            mBlockStart = offset;
+            mBlockFilled = bytesRead;
+            mStreamPos = offset + bytesRead;
+        }
+
+        *count = (int32_t)std::min<int64_t>(*count, mBlockStart + mBlockFilled - offset);
+        return mBlock + (offset - mBlockStart);
+    }
+
+    bool ProbeReader::readU8(int64_t offset, uint8_t* value)
+    {
+        const uint8_t* bytes = get(offset, 1);
+        if (bytes == NULL)
+            return false;
+
+        *value = bytes[0];
+        return true;
+    }
+
+    bool ProbeReader::readU16LE(int64_t offset, uint16_t* value)
+    {
+        const uint8_t* bytes = get(offset, 2);
+        if (bytes == NULL)
+            return false;
+
+        *value = (uint16_t)(bytes[0] | (bytes[1] << 8));
+        return true;
+    }
+
+    bool ProbeReader::readU16BE(int64_t offset, uint16_t* value)
+    {
+        const uint8_t* bytes = get(offset, 2);
+        if (bytes == NULL)
+            return false;
+
+        *value = (uint16_t)((bytes[0] << 8) | bytes[1]);
+        return true;
+    }
+
+    bool ProbeReader::readU32LE(int64_t offset, uint32_t* value)
+    {
+        const uint8_t* bytes = get(offset, 4);
+        if (bytes == NULL)
+            return false;
+
+        *value = (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+        return true;
+    }
+
+    bool ProbeReader::readU32BE(int64_t offset, uint32_t* value)
+    {
+        const uint8_t* bytes = get(offset, 4);
+        if (bytes == NULL)
+            return false;
+
+        *value = ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3];
+        return true;
+    }
+
+    bool ProbeReader::readU64LE(int64_t offset, uint64_t* value)
+    {
+        uint32_t low, high;
+        if (!readU32LE(offset, &low) || !readU32LE(offset + 4, &high))
+            return false;
+
+        *value = ((uint64_t)high << 32) | low;
+        return true;
+    }
+
+    bool ProbeReader::readU64BE(int64_t offset, uint64_t* value)
+    {
+        uint32_t high, low;
+        if (!readU32BE(offset, &high) || !readU32BE(offset + 4, &low))
+            return false;
+
+        *value = ((uint64_t)high << 32) | low;
+        return true;
+    }
+
+    bool ProbeReader::readLine(int64_t* offset, char* line, int32_t maxLength)
+    {
+        int32_t length = 0;
+        for (int64_t pos = *offset; ; )
+        {
+            // search whatever we have from pos on, rather than going a byte at a time
+            int32_t count = 1;
+            const uint8_t* data = getUpTo(pos, &count);
+            if (count == 0)
+                return false;
+
+            size_t available = (size_t)(mInMemoryData != NULL ? mInMemorySize - pos : mBlockStart + mBlockFilled - pos);
+            const uint8_t* newline = (const uint8_t*)memchr(data, '\n', available);
+            size_t lineBytes = newline != NULL ? newline - data : available;
+
+            size_t copy = std::min(lineBytes, (size_t)(maxLength - length));
+            memcpy(line + length, data, copy);
+            length += (int32_t)copy;
+
+            if (newline != NULL)
+            {
+                line[length] = '\0';
+                *offset = pos + lineBytes + 1;
+                return true;
+            }
+
+            pos += available;
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef ARTOMATIX_PROBE_H
+#define ARTOMATIX_PROBE_H
+
+#include <stdint.h>
+
+#include "AIL.h"
+
+namespace AImg
+{
+    // What the loaders' probeImage parsers read the header through. Reads are relative to where the stream was when
+    // it was created, and the stream is put back there when it goes. Input that's already in memory is read in place,
+    // anything else is read PROBE_BLOCK_SIZE bytes at a time into a buffer on the stack, so probing never allocates.
+    class ProbeReader
+    {
+    public:
+        static const int32_t PROBE_BLOCK_SIZE = 4096;
+
+        ProbeReader(ReadCallback64 readCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void* callbackData);
+        ~ProbeReader();
+
+        // Points at count bytes starting at offset, or NULL if the stream ends first. count can be at most
+        // PROBE_BLOCK_SIZE, and the pointer is only good until the next call.
+        const uint8_t* get(int64_t offset, int32_t count);
+
+        // Like get, but if the stream ends first it gives what there is, and sets count to how much that was
+        const uint8_t* getUpTo(int64_t offset, int32_t* count);
+
+        bool readU8(int64_t offset, uint8_t* value);
+        bool readU16LE(int64_t offset, uint16_t* value);
+        bool readU16BE(int64_t offset, uint16_t* value);
+        bool readU32LE(int64_t offset, uint32_t* value);
+        bool readU32BE(int64_t offset, uint32_t* value);
+        bool readU64LE(int64_t offset, uint64_t* value);
+        bool readU64BE(int64_t offset, uint64_t* value);
+
+        // Reads a line ending in '\n' (not included) into line, which must hold maxLength + 1 chars, cutting it short if
+        // it's longer than that. Fails if the stream ends first. offset is moved past the newline.
+        bool readLine(int64_t* offset, char* line, int32_t maxLength);
+
+    private:
+        ProbeReader(const ProbeReader&);
+        ProbeReader& operator=(const ProbeReader&);
+
+        ReadCallback64 mReadCallback;
+        SeekCallback64 mSeekCallback;
+        void* mCallbackData;
+        int64_t mStartPos;
+        int64_t mStreamPos; // where the stream is now, relative to mStartPos
+
+        const uint8_t* mInMemoryData;
+        int64_t mInMemorySize;
+
+        uint8_t mBlock[PROBE_BLOCK_SIZE];
+        int64_t mBlockStart; // offset of mBlock[0]
+        int64_t mBlockFilled;
+    };
+}
+
+#endif // ARTOMATIX_PROBE_H
@@ -0,0 +1,113 @@
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+
+#include "AIL.h"
+#include "readbuffer.h"
+
+namespace AImg
+{
+    ReadBuffer::ReadBuffer(ReadCallback64 readCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void* callbackData, int32_t readBufferSize)
+    {
+        mReadCallback = readCallback;
+        mTellCallback = tellCallback;
+        mSeekCallback = seekCallback;
+        mCallbackData = callbackData;
+
+        mBuffer.resize(std::max(readBufferSize, 1));
+        mBufferStart = 0;
+        mBufferFilled = 0;
+
+        mPos = tellCallback(callbackData);
+        mUnderlyingPos = mPos;
+    }
+
+    int64_t ReadBuffer::readUnderlying(int64_t pos, uint8_t* dest, int64_t count)
+    {
+        if (mUnderlyingPos != pos)
+            mSeekCallback(mCallbackData, pos);
+
+        int64_t bytesRead = mReadCallback(mCallbackData, dest, count);
+        mUnderlyingPos = pos + std::max(bytesRead, (int64_t)0);
+
+        return bytesRead;
+    }
+
+    int64_t ReadBuffer::read(uint8_t* dest, int64_t count)
+    {
+        int64_t totalRead = 0;
+
+        while (totalRead < count)
+        {
+            int64_t bufferOffset = mPos - mBufferStart;
+
+            // serve whatever we can from the current block
+            if (bufferOffset >= 0 && bufferOffset < mBufferFilled)
+            {
+                int64_t toCopy = std::min(count - totalRead, mBufferFilled - bufferOffset);
+                memcpy(dest + totalRead, &mBuffer[bufferOffset], toCopy);
+
+                totalRead += toCopy;
+                mPos += toCopy;
+                continue;
+            }
+
+            int64_t remaining = count - totalRead;
+
+            // no point copying big reads through the buffer
+            if (remaining >= (int64_t)mBuffer.size())
+            {
+                int64_t bytesRead = readUnderlying(mPos, dest + totalRead, remaining);
+                if (bytesRead > 0)
+                {
+                    totalRead += bytesRead;
+                    mPos += bytesRead;
+                }
+
+                break;
+            }
+
+            int64_t bytesRead = readUnderlying(mPos, &mBuffer[0], (int64_t)mBuffer.size());
+            mBufferStart = mPos;
+            mBufferFilled = std::max(bytesRead, (int64_t)0);
+
+            if (mBufferFilled == 0)
+                break;
+        }
+
+        return totalRead;
+    }
+
+    int64_t CALLCONV ReadBuffer::readCallback(void* callbackData, uint8_t* dest, int64_t count)
+    {
+        return ((ReadBuffer*)callbackData)->read(dest, count);
+    }
+
+    int64_t CALLCONV ReadBuffer::tellCallback(void* callbackData)
+    {
+        return ((ReadBuffer*)callbackData)->mPos;
+    }
+
+    void CALLCONV ReadBuffer::seekCallback(void* callbackData, int64_t pos)
+    {
+        // the underlying stream is only moved if the next read falls outside the buffer
+        ((ReadBuffer*)callbackData)->mPos = pos;
+    }
+
+    std::atomic<int32_t> globalReadBufferSize(256 * 1024);
+
+    int32_t getReadBufferSize()
+    {
+        return globalReadBufferSize.load();
+    }
+}
+
+int32_t AImgSetReadBufferSize(int32_t readBufferSize)
+{
+    if (readBufferSize < 0)
+        return AImgErrorCode::AIMG_INVALID_ARGS;
+
+    AImg::globalReadBufferSize = readBufferSize;
+
+    return AImgErrorCode::AIMG_SUCCESS;
+}
@@ -0,0 +1,46 @@
+#ifndef ARTOMATIX_READBUFFER_H
+#define ARTOMATIX_READBUFFER_H
+
+#include <vector>
+
+#include "AIL.h"
+#include "allocator.h"
+
+namespace AImg
+{
+    // Sits in front of a set of read callbacks and reads ahead from them in large blocks, so decoders that make lots of
+    // small reads (libjpeg, libpng, stb) only call back out to the user every readBufferSize bytes. Reads and seeks
+    // that land inside the current block are served from memory.
+    // While it's in use the underlying stream's position won't match tellCallback's, we only seek it when we refill.
+    class ReadBuffer : public Allocated
+    {
+    public:
+        ReadBuffer(ReadCallback64 readCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void* callbackData, int32_t readBufferSize);
+
+        // These have the callback signatures, with a ReadBuffer as the callbackData
+        static int64_t CALLCONV readCallback(void* callbackData, uint8_t* dest, int64_t count);
+        static int64_t CALLCONV tellCallback(void* callbackData);
+        static void CALLCONV seekCallback(void* callbackData, int64_t pos);
+
+    private:
+        int64_t read(uint8_t* dest, int64_t count);
+        int64_t readUnderlying(int64_t pos, uint8_t* dest, int64_t count);
+
+        ReadCallback64 mReadCallback;
+        TellCallback64 mTellCallback;
+        SeekCallback64 mSeekCallback;
+        void* mCallbackData;
+
+        Vector<uint8_t> mBuffer;
+        int64_t mBufferStart;   // stream position of mBuffer[0]
+        int64_t mBufferFilled;  // how much of mBuffer holds valid data
+
+        int64_t mPos;           // the position we report, which the next read starts from
+        int64_t mUnderlyingPos; // where the underlying stream actually is
+    };
+
+    // 0 means reads aren't buffered
+    int32_t getReadBufferSize();
+}
+
+#endif // ARTOMATIX_READBUFFER_H
@@ -0,0 +1,94 @@
+#include "AIL.h"
+#include "scratch.h"
+#include "ImageLoaderBase.h"
+#include "stats.h"
+
+namespace AImg
+{
+    Scratch::Scratch()
+    {
+        for (int32_t i = 0; i < NUM_SLOTS; i++)
+        {
+            mBuffers[i] = NULL;
+            mSizes[i] = 0;
+        }
+    }
+
+    Scratch::~Scratch()
+    {
+        for (int32_t i = 0; i < NUM_SLOTS; i++)
+            deallocate(mBuffers[i]);
+    }
+
+    uint8_t* Scratch::get(int32_t slot, size_t size)
+    {
+        if (size > mSizes[slot])
+        {
+            // nothing in it needs keeping, so free first rather than realloc and copy
+            deallocate(mBuffers[slot]);
+            mBuffers[slot] = (uint8_t*)allocate(size);
+            mSizes[slot] = mBuffers[slot] != NULL ? size : 0;
+
+            if (mBuffers[slot] == NULL)
+                throw std::bad_alloc();
+        }
+
+        return mBuffers[slot];
+    }
+
+    ScratchBuffer::~ScratchBuffer()
+    {
+        if (mScratch == NULL)
+            deallocate(mData);
+
+        if (mStats != NULL)
+            mStats->addScratchBytes(-(int64_t)mStatsSize);
+    }
+
+    uint8_t* ScratchBuffer::resize(size_t size)
+    {
+        if (mStats == NULL)
+            mStats = getCurrentStats();
+
+        if (mStats != NULL && size > mStatsSize)
+        {
+            mStats->addScratchBytes((int64_t)(size - mStatsSize));
+            mStatsSize = size;
+        }
+
+        if (mScratch != NULL)
+        {
+            mData = mScratch->get(mSlot, size);
+        }
+        else if (size > mSize)
+        {
+            deallocate(mData);
+            mData = (uint8_t*)allocate(size);
+            mSize = mData != NULL ? size : 0;
+
+            if (mData == NULL)
+                throw std::bad_alloc();
+        }
+
+        return mData;
+    }
+}
+
+AImgScratch AImgCreateScratch()
+{
+    return new AImg::Scratch();
+}
+
+void AImgDestroyScratch(AImgScratch scratch)
+{
+    delete (AImg::Scratch*)scratch;
+}
+
+int32_t AImgSetScratch(AImgHandle img, AImgScratch scratch)
+{
+    if (img == NULL)
+        return AImgErrorCode::AIMG_INVALID_ARGS;
+
+    ((AImg::AImgBase*)img)->mScratch = (AImg::Scratch*)scratch;
+    return AImgErrorCode::AIMG_SUCCESS;
+}
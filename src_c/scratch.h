@@ -0,0 +1,66 @@
+#ifndef ARTOMATIX_SCRATCH_H
+#define ARTOMATIX_SCRATCH_H
+
+#include <cstddef>
+#include <stdint.h>
+
+#include "allocator.h"
+
+namespace AImg
+{
+    class Stats;
+
+    // The object behind an AImgScratch. A few buffers that grow to the biggest size asked of them and are kept between
+    // calls, so decoding or writing image after image with the same scratch stops allocating once they're big enough.
+    class Scratch : public Allocated
+    {
+    public:
+        // Each slot is a separate buffer, so a call can hold one of each at the same time
+        enum Slot
+        {
+            CONVERT,        // whole images converted to or from another format
+            BAND,           // bands of rows decoded before converting them
+            REGION,         // bands read by decodeRegion, which decodes into BAND underneath
+            ROW_POINTERS,   // row pointer arrays for libpng and libjpeg
+            NUM_SLOTS
+        };
+
+        Scratch();
+        ~Scratch();
+
+        // At least size bytes, not zeroed, and only valid until the slot is asked for again
+        uint8_t* get(int32_t slot, size_t size);
+
+    private:
+        uint8_t* mBuffers[NUM_SLOTS];
+        size_t mSizes[NUM_SLOTS];
+    };
+
+    // A temporary buffer for one call. It comes from the handle's scratch if there is one, otherwise it's allocated here
+    // and freed on destruction. Either way it isn't zeroed. Throws std::bad_alloc if it can't be allocated, like Vector.
+    class ScratchBuffer
+    {
+    public:
+        ScratchBuffer(Scratch* scratch, Scratch::Slot slot) : mScratch(scratch), mSlot(slot), mData(NULL), mSize(0), mStats(NULL), mStatsSize(0) {}
+        ~ScratchBuffer();
+
+        // Makes the buffer at least size bytes, the contents are lost if it has to grow
+        uint8_t* resize(size_t size);
+        uint8_t* data() { return mData; }
+
+    private:
+        ScratchBuffer(const ScratchBuffer&);
+        ScratchBuffer& operator=(const ScratchBuffer&);
+
+        Scratch* mScratch;
+        Scratch::Slot mSlot;
+        uint8_t* mData;
+        size_t mSize;
+
+        // the stats of the call that asked for the buffer, and how much of it they've been told about
+        Stats* mStats;
+        size_t mStatsSize;
+    };
+}
+
+#endif // ARTOMATIX_SCRATCH_H
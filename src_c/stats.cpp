@@ -0,0 +1,145 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+#include "AIL.h"
+#include "stats.h"
+#include "ImageLoaderBase.h"
+
+namespace AImg
+{
+    std::atomic<bool> globalStatsEnabled(false);
+
+    // set by StatsCall
+    thread_local Stats* currentStats = nullptr;
+
+    bool isStatsEnabled()
+    {
+        return globalStatsEnabled.load();
+    }
+
+    int64_t getStatsTime()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    Stats* getCurrentStats()
+    {
+        return currentStats;
+    }
+
+    Stats::Stats() : scratchBytes(0)
+    {
+        memset(&counters, 0, sizeof(counters));
+        memset(&readCallbacks, 0, sizeof(readCallbacks));
+        readCallbacks.stats = this;
+    }
+
+    void Stats::addScratchBytes(int64_t bytes)
+    {
+        scratchBytes += bytes;
+        if (scratchBytes > counters.peakScratchBytes)
+            counters.peakScratchBytes = scratchBytes;
+    }
+
+    int64_t CALLCONV StatsCallbacks::read(void* callbackData, uint8_t* dest, int64_t count)
+    {
+        auto callbacks = (StatsCallbacks*)callbackData;
+
+        int64_t start = getStatsTime();
+        int64_t bytesRead = callbacks->readCallback(callbacks->callbackData, dest, count);
+        callbacks->stats->counters.callbackTime += getStatsTime() - start;
+
+        callbacks->stats->counters.readCalls++;
+        if (bytesRead > 0)
+            callbacks->stats->counters.bytesRead += bytesRead;
+
+        return bytesRead;
+    }
+
+    void CALLCONV StatsCallbacks::write(void* callbackData, const uint8_t* src, int64_t count)
+    {
+        auto callbacks = (StatsCallbacks*)callbackData;
+
+        int64_t start = getStatsTime();
+        callbacks->writeCallback(callbacks->callbackData, src, count);
+        callbacks->stats->counters.callbackTime += getStatsTime() - start;
+
+        callbacks->stats->counters.writeCalls++;
+        callbacks->stats->counters.bytesWritten += count;
+    }
+
+    int64_t CALLCONV StatsCallbacks::tell(void* callbackData)
+    {
+        auto callbacks = (StatsCallbacks*)callbackData;
+
+        int64_t start = getStatsTime();
+        int64_t pos = callbacks->tellCallback(callbacks->callbackData);
+        callbacks->stats->counters.callbackTime += getStatsTime() - start;
+
+        callbacks->stats->counters.tellCalls++;
+        return pos;
+    }
+
+    void CALLCONV StatsCallbacks::seek(void* callbackData, int64_t pos)
+    {
+        auto callbacks = (StatsCallbacks*)callbackData;
+
+        int64_t start = getStatsTime();
+        callbacks->seekCallback(callbacks->callbackData, pos);
+        callbacks->stats->counters.callbackTime += getStatsTime() - start;
+
+        callbacks->stats->counters.seekCalls++;
+    }
+
+    StatsCall::StatsCall(AImgBase* img) : mStats(img != NULL ? img->mStats : NULL), mPrevious(currentStats), mStart(0), mCallbackTime(0), mConvertTime(0)
+    {
+        // a call inside another call on the same handle is already being timed
+        if (mStats == NULL || mStats == mPrevious)
+        {
+            mStats = NULL;
+            return;
+        }
+
+        currentStats = mStats;
+        mStart = getStatsTime();
+        mCallbackTime = mStats->counters.callbackTime;
+        mConvertTime = mStats->counters.convertTime;
+    }
+
+    StatsCall::~StatsCall()
+    {
+        if (mStats == NULL)
+            return;
+
+        int64_t elapsed = getStatsTime() - mStart;
+        elapsed -= mStats->counters.callbackTime - mCallbackTime;
+        elapsed -= mStats->counters.convertTime - mConvertTime;
+
+        mStats->counters.codecTime += elapsed > 0 ? elapsed : 0;
+        currentStats = mPrevious;
+    }
+
+    StatsConvertTimer::~StatsConvertTimer()
+    {
+        if (mStats != NULL)
+            mStats->counters.convertTime += getStatsTime() - mStart;
+    }
+}
+
+int32_t AImgSetStatsEnabled(int32_t enabled)
+{
+    AImg::globalStatsEnabled = enabled != 0;
+
+    return AImgErrorCode::AIMG_SUCCESS;
+}
+
+int32_t AImgGetStats(AImgHandle img, AImgStats* stats)
+{
+    if (img == NULL || stats == NULL || ((AImg::AImgBase*)img)->mStats == NULL)
+        return AImgErrorCode::AIMG_INVALID_ARGS;
+
+    *stats = ((AImg::AImgBase*)img)->mStats->counters;
+
+    return AImgErrorCode::AIMG_SUCCESS;
+}
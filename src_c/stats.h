@@ -0,0 +1,89 @@
+#ifndef ARTOMATIX_STATS_H
+#define ARTOMATIX_STATS_H
+
+#include <stdint.h>
+
+#include "AIL.h"
+#include "allocator.h"
+
+namespace AImg
+{
+    class AImgBase;
+    class Stats;
+
+    // Forwards to another set of callbacks, counting and timing each call into stats
+    struct StatsCallbacks
+    {
+        ReadCallback64 readCallback;
+        WriteCallback64 writeCallback;
+        TellCallback64 tellCallback;
+        SeekCallback64 seekCallback;
+        void* callbackData;
+
+        Stats* stats;
+
+        // These have the callback signatures, with a StatsCallbacks as the callbackData
+        static int64_t CALLCONV read(void* callbackData, uint8_t* dest, int64_t count);
+        static void CALLCONV write(void* callbackData, const uint8_t* src, int64_t count);
+        static int64_t CALLCONV tell(void* callbackData);
+        static void CALLCONV seek(void* callbackData, int64_t pos);
+    };
+
+    // The object behind AImgGetStats, created with the handle when stats are on and freed by AImgClose.
+    // Like the handle, it's only used by one thread at a time.
+    class Stats : public Allocated
+    {
+    public:
+        Stats();
+
+        void addScratchBytes(int64_t bytes);
+
+        AImgStats counters;
+        int64_t scratchBytes; // held by temporary buffers right now
+
+        // the callbacks the handle was opened with, writes wrap theirs for the length of the call
+        StatsCallbacks readCallbacks;
+    };
+
+    bool isStatsEnabled();
+
+    // Nanoseconds from a monotonic clock
+    int64_t getStatsTime();
+
+    // The stats of the handle whose call is running on this thread, or NULL if there isn't one or it has no stats
+    Stats* getCurrentStats();
+
+    // Lives for the length of a public call on img. Until it goes, conversions and temporary buffers on this thread are
+    // counted against img, and then whatever time wasn't spent in callbacks or converting goes to codecTime.
+    // Does nothing if img has no stats.
+    class StatsCall
+    {
+    public:
+        explicit StatsCall(AImgBase* img);
+        ~StatsCall();
+
+    private:
+        StatsCall(const StatsCall&);
+        StatsCall& operator=(const StatsCall&);
+
+        Stats* mStats;
+        Stats* mPrevious;
+        int64_t mStart;
+        int64_t mCallbackTime;
+        int64_t mConvertTime;
+    };
+
+    // Adds the time it lives to the current call's convertTime
+    class StatsConvertTimer
+    {
+    public:
+        StatsConvertTimer() : mStats(getCurrentStats()), mStart(mStats != NULL ? getStatsTime() : 0) {}
+        ~StatsConvertTimer();
+
+    private:
+        Stats* mStats;
+        int64_t mStart;
+    };
+}
+
+#endif // ARTOMATIX_STATS_H
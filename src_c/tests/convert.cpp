@@ -0,0 +1,213 @@
+#include <gtest/gtest.h>
+#include "../AIL.h"
+#include "../convert.h"
+#include "testCommon.h"
+
+#include <vector>
+#include <random>
+#include <limits>
+#include <cstring>
+
+std::vector<int32_t> getAllFormats()
+{
+    std::vector<int32_t> formats = {
+        AImgFormat::R8U, AImgFormat::RG8U, AImgFormat::RGB8U, AImgFormat::RGBA8U,
+        AImgFormat::R16U, AImgFormat::RG16U, AImgFormat::RGB16U, AImgFormat::RGBA16U,
+        AImgFormat::R32F, AImgFormat::RG32F, AImgFormat::RGB32F, AImgFormat::RGBA32F
+    };
+
+#ifdef HAVE_EXR
+    formats.push_back(AImgFormat::R16F);
+    formats.push_back(AImgFormat::RG16F);
+    formats.push_back(AImgFormat::RGB16F);
+    formats.push_back(AImgFormat::RGBA16F);
+#endif
+
+    return formats;
+}
+
+size_t getPixelSize(int32_t format)
+{
+    int32_t numChannels, bytesPerChannel, floatOrInt;
+    AIGetFormatDetails(format, &numChannels, &bytesPerChannel, &floatOrInt);
+    return numChannels * bytesPerChannel;
+}
+
+// random bytes for int and half formats, and a mix of in-range, out-of-range and special values for 32F
+std::vector<uint8_t> makeTestPixels(int32_t format, size_t count, std::mt19937& rng)
+{
+    std::vector<uint8_t> data(count * getPixelSize(format));
+
+    if (format & AImgFormat::FLOAT_FORMAT && format & AImgFormat::_32BITS)
+    {
+        const float specials[] = { 0.0f, -0.0f, 1.0f, 0.5f, -1.0f, 2.0f, 1e30f, -1e30f,
+            std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+            std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::denorm_min() };
+
+        std::uniform_real_distribution<float> dist(-0.25f, 1.25f);
+
+        float* values = (float*)&data[0];
+        for (size_t i = 0; i < data.size() / sizeof(float); i++)
+        {
+            if (i % 7 == 0)
+                values[i] = specials[(i / 7) % (sizeof(specials) / sizeof(float))];
+            else
+                values[i] = dist(rng);
+        }
+    }
+    else
+    {
+        std::uniform_int_distribution<int> dist(0, 255);
+
+        for (size_t i = 0; i < data.size(); i++)
+            data[i] = (uint8_t)dist(rng);
+    }
+
+    return data;
+}
+
+TEST(Convert, TestBestLevelSupported)
+{
+    ASSERT_TRUE(AImg::isConvertKernelLevelSupported(AImg::getBestConvertKernelLevel()));
+    ASSERT_TRUE(AImg::isConvertKernelLevelSupported(AImg::CONVERT_KERNEL_SCALAR));
+}
+
+TEST(Convert, TestVectorisedMatchesScalar)
+{
+    // odd size so the scalar tails of the kernels and the partial last block get exercised
+    const size_t count = 1021;
+
+    AImg::ConvertKernelLevel levels[] = { AImg::CONVERT_KERNEL_SSE2, AImg::CONVERT_KERNEL_AVX2, AImg::CONVERT_KERNEL_NEON };
+    std::vector<int32_t> formats = getAllFormats();
+
+    std::mt19937 rng(1234);
+
+    for (AImg::ConvertKernelLevel level : levels)
+    {
+        if (!AImg::isConvertKernelLevelSupported(level))
+            continue;
+
+        for (int32_t inFormat : formats)
+        {
+            std::vector<uint8_t> src = makeTestPixels(inFormat, count, rng);
+
+            for (int32_t outFormat : formats)
+            {
+                std::vector<uint8_t> expected(count * getPixelSize(outFormat), 78);
+                std::vector<uint8_t> actual(count * getPixelSize(outFormat), 78);
+
+                AImg::convertPixels(&src[0], &expected[0], count, inFormat, outFormat, AImg::CONVERT_KERNEL_SCALAR);
+                AImg::convertPixels(&src[0], &actual[0], count, inFormat, outFormat, level);
+
+                ASSERT_EQ(0, memcmp(&expected[0], &actual[0], expected.size()))
+                    << "level " << level << ", inFormat " << inFormat << ", outFormat " << outFormat;
+            }
+        }
+    }
+}
+
+TEST(Convert, TestDirectMatchesScalar)
+{
+    const size_t count = 1021;
+
+    std::vector<int32_t> formats = getAllFormats();
+
+    std::mt19937 rng(5678);
+
+    int32_t directPairs = 0;
+
+    for (int32_t inFormat : formats)
+    {
+        std::vector<uint8_t> src = makeTestPixels(inFormat, count, rng);
+
+        for (int32_t outFormat : formats)
+        {
+            std::vector<uint8_t> expected(count * getPixelSize(outFormat), 78);
+            std::vector<uint8_t> actual(count * getPixelSize(outFormat), 78);
+
+            if (!AImg::convertPixelsDirect(&src[0], &actual[0], count, inFormat, outFormat))
+            {
+                ASSERT_FALSE(AImg::hasDirectConversion(inFormat, outFormat));
+                continue;
+            }
+
+            directPairs++;
+
+            AImg::convertPixels(&src[0], &expected[0], count, inFormat, outFormat, AImg::CONVERT_KERNEL_SCALAR);
+
+            ASSERT_EQ(0, memcmp(&expected[0], &actual[0], expected.size()))
+                << "inFormat " << inFormat << ", outFormat " << outFormat;
+        }
+    }
+
+    // all the 8U/16U pairs, plus the 32F (and 16F, if available) channel swizzles
+#ifdef HAVE_EXR
+    ASSERT_EQ(directPairs, 64 + 16 + 16);
+#else
+    ASSERT_EQ(directPairs, 64 + 16);
+#endif
+
+    ASSERT_TRUE(AImg::hasDirectConversion(AImgFormat::RGB8U, AImgFormat::RGBA8U));
+    ASSERT_TRUE(AImg::hasDirectConversion(AImgFormat::RGBA16U, AImgFormat::RGBA8U));
+    ASSERT_FALSE(AImg::hasDirectConversion(AImgFormat::RGBA8U, AImgFormat::RGBA32F));
+    ASSERT_FALSE(AImg::hasDirectConversion(AImgFormat::RGBA16F, AImgFormat::RGBA32F));
+}
+
+TEST(Convert, TestConvertFormatMatchesScalar)
+{
+    int32_t width = 67;
+    int32_t height = 13;
+
+    std::mt19937 rng(4321);
+    std::vector<uint8_t> src = makeTestPixels(AImgFormat::RGBA32F, width * height, rng);
+
+    std::vector<uint8_t> expected(width * height * getPixelSize(AImgFormat::RGB8U));
+    std::vector<uint8_t> actual(width * height * getPixelSize(AImgFormat::RGB8U));
+
+    AImg::convertPixels(&src[0], &expected[0], width * height, AImgFormat::RGBA32F, AImgFormat::RGB8U, AImg::CONVERT_KERNEL_SCALAR);
+
+    int32_t err = AImgConvertFormat(&src[0], &actual[0], width, height, AImgFormat::RGBA32F, AImgFormat::RGB8U);
+    ASSERT_EQ(err, AImgErrorCode::AIMG_SUCCESS);
+
+    ASSERT_EQ(0, memcmp(&expected[0], &actual[0], expected.size()));
+}
+
+TEST(Convert, TestThreadedConvertFormatMatchesScalar)
+{
+    // big enough to be split into bands, with a height that doesn't divide evenly into them
+    int32_t width = 1031;
+    int32_t height = 517;
+
+    std::mt19937 rng(8765);
+    std::vector<uint8_t> src = makeTestPixels(AImgFormat::RGBA32F, width * height, rng);
+
+    std::vector<uint8_t> expected(width * height * getPixelSize(AImgFormat::RGB8U));
+    AImg::convertPixels(&src[0], &expected[0], width * height, AImgFormat::RGBA32F, AImgFormat::RGB8U, AImg::CONVERT_KERNEL_SCALAR);
+
+    ASSERT_EQ(AImgSetThreadCount(-1), AImgErrorCode::AIMG_INVALID_ARGS);
+
+    int32_t threadCounts[] = { 1, 3, 0 };
+    for (int32_t threadCount : threadCounts)
+    {
+        ASSERT_EQ(AImgSetThreadCount(threadCount), AImgErrorCode::AIMG_SUCCESS);
+
+        std::vector<uint8_t> actual(expected.size(), 78);
+
+        int32_t err = AImgConvertFormat(&src[0], &actual[0], width, height, AImgFormat::RGBA32F, AImgFormat::RGB8U);
+        ASSERT_EQ(err, AImgErrorCode::AIMG_SUCCESS);
+
+        ASSERT_EQ(0, memcmp(&expected[0], &actual[0], expected.size())) << "threadCount " << threadCount;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    AImgInitialise();
+
+    ::testing::InitGoogleTest(&argc, argv);
+    int retval = RUN_ALL_TESTS();
+
+    AImgCleanUp();
+
+    return retval;
+}
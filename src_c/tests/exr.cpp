@@ -85,6 +85,31 @@ TEST(Exr, TestCompareForceImageFormat2)
     ASSERT_TRUE(compareForceImageFormat("/exr/neal_half.exr"));
 }
 
+TEST(Exr, TestDecodeRows)
+{
+    ASSERT_TRUE(compareDecodeRows("/exr/grad_32.exr", AImgFormat::INVALID_FORMAT, true));
+}
+
+TEST(Exr, TestDecodeRowsForceImageFormat)
+{
+    ASSERT_TRUE(compareDecodeRows("/exr/neal_half.exr", AImgFormat::RGBA8U));
+}
+
+TEST(Exr, TestDecodeRegion)
+{
+    ASSERT_TRUE(compareDecodeRegion("/exr/neal_half.exr", 13, 17, 31, 19, AImgFormat::RGBA32F));
+}
+
+TEST(Exr, TestMappedFile)
+{
+    ASSERT_TRUE(compareMappedFile("/exr/neal_half.exr"));
+}
+
+TEST(Exr, TestLargeStreamOffset)
+{
+    ASSERT_TRUE(compareLargeStreamOffset("/exr/grad_32.exr"));
+}
+
 // THIS HAS NOTHING TO DO WITH EXRS
 
 TEST(Exr, TestMemoryCallbacksRead)
@@ -323,6 +348,12 @@ TEST(Exr, TestSupportedFormat)
     ASSERT_TRUE(AImgIsFormatSupported(AImgFileFormat::EXR_IMAGE_FORMAT, AImgFormat::_32BITS | AImgFormat::FLOAT_FORMAT));
 }
 
+TEST(Exr, TestProbe)
+{
+    ASSERT_TRUE(compareProbe("/exr/grad_32.exr"));
+    ASSERT_TRUE(compareProbe("/exr/neal_half.exr"));
+}
+
 #endif
 
 int main(int argc, char **argv) 
@@ -33,6 +33,37 @@ TEST(HDR, TestDetectBadHDR)
     ASSERT_FALSE(detectImage("/jpeg/test.jpeg", HDR_IMAGE_FORMAT));
 }
 
+TEST(HDR, TestDetectRGBEHeader)
+{
+    // same image, with the "#?RGBE" programtype some writers use instead of "#?RADIANCE"
+    auto data = readFile<uint8_t>(getImagesDir() + "/hdr/test-env.hdr");
+    std::string radiance = "#?RADIANCE";
+    ASSERT_EQ(0, memcmp(&data[0], radiance.data(), radiance.size()));
+    std::string rgbe = "#?RGBE";
+    data.erase(data.begin(), data.begin() + radiance.size());
+    data.insert(data.begin(), rgbe.begin(), rgbe.end());
+
+    ReadCallback readCallback = NULL;
+    WriteCallback writeCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+
+    AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &data[0], (int32_t)data.size());
+
+    AImgHandle img = NULL;
+    int32_t fileFormat = UNKNOWN_IMAGE_FORMAT;
+    int32_t err = AImgOpen(readCallback, tellCallback, seekCallback, callbackData, &img, &fileFormat);
+
+    if (img != NULL)
+        AImgClose(img);
+
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+    ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, err);
+    ASSERT_EQ(HDR_IMAGE_FORMAT, fileFormat);
+}
+
 TEST(HDR, TestReadHDRFile)
 {
     auto data = readFile<uint8_t>(getImagesDir() + "/hdr/test-env.hdr");
@@ -85,6 +116,70 @@ TEST(HDR, TestReadHDRFile)
     AImgClose(img);
 }
 
+TEST(HDR, TestReadHDRFileFloats)
+{
+    std::string path = getImagesDir() + "/hdr/test-env.hdr";
+
+    int knownWidth, knownHeight, knownComp;
+    FILE * file = fopen(path.c_str(), "rb");
+    float * knownData = stbi_loadf_from_file(file, &knownWidth, &knownHeight, &knownComp, 0);
+    fclose(file);
+    ASSERT_TRUE(knownData != NULL);
+
+    std::vector<uint8_t> fileData = readFile<uint8_t>(path);
+
+    ReadCallback readCallback = NULL;
+    WriteCallback writeCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+
+    AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &fileData[0], (int32_t)fileData.size());
+
+    AImgHandle img = NULL;
+    ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgOpen(readCallback, tellCallback, seekCallback, callbackData, &img, NULL));
+
+    int32_t width, height, numChannels, bytesPerChannel, floatOrInt, imgFmt;
+    AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &imgFmt, NULL);
+    ASSERT_EQ(knownWidth, width);
+    ASSERT_EQ(knownHeight, height);
+    ASSERT_EQ(knownComp, numChannels);
+
+    std::vector<float> imgData(width * height * numChannels);
+    ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgDecodeImage(img, &imgData[0], AImgFormat::INVALID_FORMAT));
+    AImgClose(img);
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+    bool same = memcmp(knownData, &imgData[0], imgData.size() * sizeof(float)) == 0;
+    stbi_image_free(knownData);
+    ASSERT_TRUE(same);
+}
+
+TEST(HDR, TestDecodeRows)
+{
+    ASSERT_TRUE(compareDecodeRows("/hdr/test-env.hdr", AImgFormat::INVALID_FORMAT));
+}
+
+TEST(HDR, TestDecodeRowsBottomUp)
+{
+    ASSERT_TRUE(compareDecodeRows("/hdr/test-env.hdr", AImgFormat::RGBA16F, true));
+}
+
+TEST(HDR, TestMappedFile)
+{
+    ASSERT_TRUE(compareMappedFile("/hdr/test-env.hdr"));
+}
+
+TEST(HDR, TestConcurrentDecode)
+{
+    ASSERT_TRUE(compareConcurrentDecode("/hdr/test-env.hdr", 8));
+}
+
+TEST(HDR, TestProbe)
+{
+    ASSERT_TRUE(compareProbe("/hdr/test-env.hdr"));
+}
+
 int main(int argc, char * argv[])
 {
     AImgInitialise();
@@ -4,22 +4,30 @@
 #ifdef HAVE_JPEG
 #include <jpeglib.h>
 #include <math.h>
+#include <atomic>
+#include <cstring>
 
-std::vector<uint8_t> decodeJPEGFile(const std::string & path)
+std::vector<uint8_t> decodeJPEGData(std::vector<uint8_t>& data, int32_t scaleDenom = 1, const JpegDecodingOptions* options = NULL)
 {
-    FILE * file = fopen(path.c_str(), "rb");
-    if (file == NULL)
-        std::cout << "Could not open file: " + path << std::endl;
-
     jpeg_decompress_struct cinfo;
     jpeg_error_mgr jerr;
     cinfo.err = jpeg_std_error(&jerr);
     int row_stride;
 
     jpeg_create_decompress(&cinfo);
-    jpeg_stdio_src(&cinfo, file);
+    jpeg_mem_src(&cinfo, &data[0], data.size());
 
     jpeg_read_header(&cinfo, TRUE);
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = scaleDenom;
+    if (options != NULL)
+    {
+        cinfo.dct_method = (J_DCT_METHOD)options->dctMethod;
+        cinfo.do_fancy_upsampling = options->fancyUpsampling ? TRUE : FALSE;
+        cinfo.do_block_smoothing = options->blockSmoothing ? TRUE : FALSE;
+        if (options->colourSpace != AIL_JPEG_COLOURSPACE_DEFAULT)
+            cinfo.out_color_space = (J_COLOR_SPACE)options->colourSpace;
+    }
     jpeg_start_decompress(&cinfo);
     row_stride = cinfo.output_components * cinfo.output_width;
 
@@ -38,12 +46,17 @@ std::vector<uint8_t> decodeJPEGFile(const std::string & path)
     jpeg_destroy_decompress(&cinfo);
     free(buffer[0]);
     free(buffer);
-    fclose(file);
 
     return Vbuffer;
 }
 
-bool testReadJpegFile(const std::string& path)
+std::vector<uint8_t> decodeJPEGFile(const std::string & path, int32_t scaleDenom = 1, const JpegDecodingOptions* options = NULL)
+{
+    auto data = readFile<uint8_t>(path);
+    return decodeJPEGData(data, scaleDenom, options);
+}
+
+bool testReadJpegFile(const std::string& path, int32_t scaleDenom = 1, JpegDecodingOptions* options = NULL)
 {
     auto data = readFile<uint8_t>(getImagesDir() + path);
 
@@ -71,6 +84,12 @@ bool testReadJpegFile(const std::string& path)
     int32_t floatOrInt;
     int32_t imgFmt;
 
+    if (scaleDenom != 1 && AImgSetDecodeScale(img, scaleDenom) != AImgErrorCode::AIMG_SUCCESS)
+        return false;
+
+    if (options != NULL && AImgSetDecodingOptions(img, options) != AImgErrorCode::AIMG_SUCCESS)
+        return false;
+
     AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &imgFmt, NULL);
 
     std::vector<uint8_t> imgData(width*height*numChannels*bytesPerChannel, 78);
@@ -83,16 +102,9 @@ bool testReadJpegFile(const std::string& path)
         return false;
     }
 
-    auto knownData = decodeJPEGFile(getImagesDir() + path);
-
-    for (int32_t y = 0; y < height; y++)
-    {
-        for (int32_t x = 0; x < width; x++)
-        {
-            if (knownData[x + width*y] != imgData[(x + width*y)])
-                return false;
-        }
-    }
+    auto knownData = decodeJPEGFile(getImagesDir() + path, scaleDenom, options);
+    if (knownData != imgData)
+        return false;
 
     AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
     AImgClose(img);
@@ -177,6 +189,42 @@ void TestWriteJpeg(AImgFormat decodeFormat, AImgFormat writeFormat, AImgFormat e
     }
 }
 
+// Writes test.jpeg back out as a JPEG with encodeOptions into fileData
+int32_t writeJpegWithOptions(void* encodeOptions, std::vector<uint8_t>& fileData)
+{
+    auto data = readFile<uint8_t>(getImagesDir() + "/jpeg/test.jpeg");
+
+    ReadCallback readCallback = NULL;
+    WriteCallback writeCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+
+    AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &data[0], data.size());
+
+    AImgHandle img = NULL;
+    AImgOpen(readCallback, tellCallback, seekCallback, callbackData, &img, NULL);
+
+    int32_t width, height, numChannels, bytesPerChannel, floatOrInt, fmt;
+    AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &fmt, NULL);
+
+    std::vector<uint8_t> imgData(width * height * numChannels * bytesPerChannel);
+    AImgDecodeImage(img, &imgData[0], AImgFormat::INVALID_FORMAT);
+
+    AImgClose(img);
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+    fileData.clear();
+    AIGetResizableMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &fileData);
+
+    AImgHandle wImg = AImgGetAImg(AImgFileFormat::JPEG_IMAGE_FORMAT);
+    int32_t err = AImgWriteImage(wImg, &imgData[0], width, height, fmt, fmt, NULL, NULL, 0, writeCallback, tellCallback, seekCallback, callbackData, encodeOptions);
+    AImgClose(wImg);
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+    return err;
+}
+
 TEST(JPEG, TestDetectJPEG)
 {
     ASSERT_TRUE(detectImage("/jpeg/test.jpeg", JPEG_IMAGE_FORMAT));
@@ -197,6 +245,31 @@ TEST(JPEG, TestCompareForceImageFormat1)
     ASSERT_TRUE(compareForceImageFormat("/jpeg/test.jpeg"));
 }
 
+TEST(JPEG, TestDecodeRows)
+{
+    ASSERT_TRUE(compareDecodeRows("/jpeg/karl.jpeg", AImgFormat::INVALID_FORMAT));
+}
+
+TEST(JPEG, TestDecodeRowsForceImageFormat)
+{
+    ASSERT_TRUE(compareDecodeRows("/jpeg/greyscale.jpeg", AImgFormat::RGBA32F));
+}
+
+TEST(JPEG, TestDecodeRegion)
+{
+    ASSERT_TRUE(compareDecodeRegion("/jpeg/karl.jpeg", 17, 33, 41, 29, AImgFormat::INVALID_FORMAT));
+}
+
+TEST(JPEG, TestBufferedRead)
+{
+    ASSERT_TRUE(compareBufferedRead("/jpeg/karl.jpeg", 256 * 1024));
+}
+
+TEST(JPEG, TestConcurrentDecode)
+{
+    ASSERT_TRUE(compareConcurrentDecode("/jpeg/karl.jpeg", 8));
+}
+
 TEST(JPEG, TestReadJPEGFile1)
 {
     ASSERT_TRUE(testReadJpegFile("/jpeg/test.jpeg"));
@@ -212,6 +285,265 @@ TEST(JPEG, TestReadJPEGFile3)
     ASSERT_TRUE(testReadJpegFile("/jpeg/karl_comment.jpeg"));
 }
 
+TEST(JPEG, TestReadJPEGFileScaled)
+{
+    ASSERT_TRUE(testReadJpegFile("/jpeg/test.jpeg", 2));
+    ASSERT_TRUE(testReadJpegFile("/jpeg/karl.jpeg", 4));
+    ASSERT_TRUE(testReadJpegFile("/jpeg/greyscale.jpeg", 8));
+}
+
+TEST(JPEG, TestDecodeScaleInfo)
+{
+    auto data = readFile<uint8_t>(getImagesDir() + "/jpeg/test.jpeg");
+
+    ReadCallback readCallback = NULL;
+    WriteCallback writeCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+
+    AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &data[0], data.size());
+
+    AImgHandle img = NULL;
+    ASSERT_EQ(AImgOpen(readCallback, tellCallback, seekCallback, callbackData, &img, NULL), AImgErrorCode::AIMG_SUCCESS);
+
+    ASSERT_EQ(AImgSetDecodeScale(img, 3), AImgErrorCode::AIMG_INVALID_ARGS);
+    ASSERT_EQ(AImgSetDecodeScale(img, 8), AImgErrorCode::AIMG_SUCCESS);
+
+    // 640x400 rounded up
+    int32_t width, height, numChannels, bytesPerChannel, floatOrInt, format;
+    AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &format, NULL);
+    ASSERT_EQ(width, 80);
+    ASSERT_EQ(height, 50);
+
+    std::vector<uint8_t> decoded((size_t)width * height * numChannels);
+    ASSERT_EQ(AImgDecodeRows(img, &decoded[0], 0, height / 2, 0, AImgFormat::INVALID_FORMAT), AImgErrorCode::AIMG_SUCCESS);
+    ASSERT_EQ(AImgSetDecodeScale(img, 1), AImgErrorCode::AIMG_INVALID_ARGS);
+
+    AImgClose(img);
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+}
+
+TEST(JPEG, TestReadJPEGFileDecodingOptions)
+{
+    JpegDecodingOptions options;
+    options.type = AImgFileFormat::JPEG_IMAGE_FORMAT;
+    options.dctMethod = AIL_JPEG_DCT_IFAST;
+    options.fancyUpsampling = 0;
+    options.blockSmoothing = 0;
+    options.colourSpace = AIL_JPEG_COLOURSPACE_DEFAULT;
+    ASSERT_TRUE(testReadJpegFile("/jpeg/test.jpeg", 1, &options));
+    ASSERT_TRUE(testReadJpegFile("/jpeg/greyscale.jpeg", 1, &options));
+
+    options.dctMethod = AIL_JPEG_DCT_FLOAT;
+    options.fancyUpsampling = 1;
+    options.colourSpace = AIL_JPEG_COLOURSPACE_GREYSCALE;
+    ASSERT_TRUE(testReadJpegFile("/jpeg/karl.jpeg", 1, &options));
+
+    options.colourSpace = AIL_JPEG_COLOURSPACE_YCBCR;
+    ASSERT_TRUE(testReadJpegFile("/jpeg/karl.jpeg", 2, &options));
+}
+
+TEST(JPEG, TestDecodingOptionsInfo)
+{
+    auto data = readFile<uint8_t>(getImagesDir() + "/jpeg/test.jpeg");
+
+    ReadCallback readCallback = NULL;
+    WriteCallback writeCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+
+    AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &data[0], data.size());
+
+    AImgHandle img = NULL;
+    ASSERT_EQ(AImgOpen(readCallback, tellCallback, seekCallback, callbackData, &img, NULL), AImgErrorCode::AIMG_SUCCESS);
+
+    JpegDecodingOptions options;
+    options.type = AImgFileFormat::PNG_IMAGE_FORMAT;
+    options.dctMethod = AIL_JPEG_DCT_IFAST;
+    options.fancyUpsampling = 1;
+    options.blockSmoothing = 1;
+    options.colourSpace = AIL_JPEG_COLOURSPACE_GREYSCALE;
+    ASSERT_EQ(AImgSetDecodingOptions(img, &options), AImgErrorCode::AIMG_INVALID_ARGS);
+
+    options.type = AImgFileFormat::JPEG_IMAGE_FORMAT;
+    options.dctMethod = 3;
+    ASSERT_EQ(AImgSetDecodingOptions(img, &options), AImgErrorCode::AIMG_INVALID_ARGS);
+
+    options.dctMethod = AIL_JPEG_DCT_IFAST;
+    ASSERT_EQ(AImgSetDecodingOptions(img, &options), AImgErrorCode::AIMG_SUCCESS);
+
+    int32_t width, height, numChannels, bytesPerChannel, floatOrInt, format;
+    AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &format, NULL);
+    ASSERT_EQ(numChannels, 1);
+    ASSERT_EQ(format, AImgFormat::R8U);
+
+    // NULL goes back to the defaults
+    ASSERT_EQ(AImgSetDecodingOptions(img, NULL), AImgErrorCode::AIMG_SUCCESS);
+    AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &format, NULL);
+    ASSERT_EQ(numChannels, 3);
+    ASSERT_EQ(format, AImgFormat::RGB8U);
+
+    std::vector<uint8_t> decoded((size_t)width * height * numChannels);
+    ASSERT_EQ(AImgDecodeRows(img, &decoded[0], 0, height / 2, 0, AImgFormat::INVALID_FORMAT), AImgErrorCode::AIMG_SUCCESS);
+    ASSERT_EQ(AImgSetDecodingOptions(img, NULL), AImgErrorCode::AIMG_INVALID_ARGS);
+
+    AImgClose(img);
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+}
+
+std::atomic<int32_t> decodeBlocks(0);
+
+void CALLCONV countDecodeBlocks(void* userData, const char* stage)
+{
+    (void)userData;
+    if (strcmp(stage, "aimg.decode.block") == 0)
+        decodeBlocks++;
+}
+
+void CALLCONV ignoreTraceEnd(void* userData, const char* stage)
+{
+    (void)userData;
+    (void)stage;
+}
+
+// Writes an image big enough to be decoded in parallel with restartInterval MCUs between restart markers, and checks
+// decoding it on 4 threads gives exactly what libjpeg gives decoding it in one go
+bool compareRestartDecode(int32_t subsampling, int32_t restartInterval, int32_t scaleDenom = 1, JpegDecodingOptions* options = NULL,
+    int32_t forceImageFormat = AImgFormat::INVALID_FORMAT, bool inMemory = true)
+{
+    // not a multiple of the MCU size either way, so the last row and column of MCUs are partial
+    const int32_t width = 1501, height = 1003;
+
+    std::vector<uint8_t> pixels((size_t)width * height * 3);
+    for (int32_t y = 0; y < height; y++)
+    {
+        for (int32_t x = 0; x < width; x++)
+        {
+            uint8_t* pixel = &pixels[((size_t)y * width + x) * 3];
+            pixel[0] = (uint8_t)(x + y);
+            pixel[1] = (uint8_t)((x * y) >> 4);
+            pixel[2] = (uint8_t)(((x >> 3) ^ (y >> 3)) * 16);
+        }
+    }
+
+    JpegEncodingOptions encodeOptions;
+    encodeOptions.type = AImgFileFormat::JPEG_IMAGE_FORMAT;
+    encodeOptions.quality = 90;
+    encodeOptions.subsampling = subsampling;
+    encodeOptions.progressive = 0;
+    encodeOptions.optimizeCoding = 0;
+    encodeOptions.restartInterval = restartInterval;
+
+    std::vector<uint8_t> fileData;
+
+    ReadCallback readCallback = NULL;
+    WriteCallback writeCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+
+    AIGetResizableMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &fileData);
+
+    AImgHandle wImg = AImgGetAImg(AImgFileFormat::JPEG_IMAGE_FORMAT);
+    int32_t err = AImgWriteImage(wImg, &pixels[0], width, height, AImgFormat::RGB8U, AImgFormat::RGB8U, NULL, NULL, 0, writeCallback, tellCallback, seekCallback, callbackData, &encodeOptions);
+    AImgClose(wImg);
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+    if (err != AImgErrorCode::AIMG_SUCCESS)
+        return false;
+
+    if (inMemory)
+    {
+        AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &fileData[0], fileData.size());
+    }
+    else
+    {
+        AIGetSimpleMemoryBufferCallbacks(&CopyingCallbacks::innerRead, &writeCallback, &CopyingCallbacks::innerTell, &CopyingCallbacks::innerSeek, &callbackData, &fileData[0], fileData.size());
+        readCallback = &CopyingCallbacks::read;
+        tellCallback = &CopyingCallbacks::tell;
+        seekCallback = &CopyingCallbacks::seek;
+    }
+
+    AImgSetThreadCount(4);
+    AImgSetTraceHooks(&countDecodeBlocks, &ignoreTraceEnd, NULL);
+    decodeBlocks = 0;
+
+    AImgHandle img = NULL;
+    err = AImgOpen(readCallback, tellCallback, seekCallback, callbackData, &img, NULL);
+
+    if (err == AImgErrorCode::AIMG_SUCCESS && scaleDenom != 1)
+        err = AImgSetDecodeScale(img, scaleDenom);
+
+    if (err == AImgErrorCode::AIMG_SUCCESS && options != NULL)
+        err = AImgSetDecodingOptions(img, options);
+
+    int32_t decodedWidth = 0, decodedHeight = 0, numChannels, bytesPerChannel, floatOrInt, decodedFormat = AImgFormat::INVALID_FORMAT;
+    if (err == AImgErrorCode::AIMG_SUCCESS)
+        err = AImgGetInfo(img, &decodedWidth, &decodedHeight, &numChannels, &bytesPerChannel, &floatOrInt, &decodedFormat, NULL);
+
+    if (forceImageFormat == AImgFormat::INVALID_FORMAT)
+        forceImageFormat = decodedFormat;
+
+    AIGetFormatDetails(forceImageFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+    std::vector<uint8_t> decoded((size_t)decodedWidth * decodedHeight * numChannels * bytesPerChannel, 78);
+
+    if (err == AImgErrorCode::AIMG_SUCCESS)
+        err = AImgDecodeImage(img, &decoded[0], forceImageFormat);
+
+    AImgClose(img);
+    AIDestroySimpleMemoryBufferCallbacks(inMemory ? readCallback : CopyingCallbacks::innerRead, writeCallback, inMemory ? tellCallback : CopyingCallbacks::innerTell,
+        inMemory ? seekCallback : CopyingCallbacks::innerSeek, callbackData);
+
+    AImgSetTraceHooks(NULL, NULL, NULL);
+    AImgSetThreadCount(0);
+
+    if (err != AImgErrorCode::AIMG_SUCCESS)
+        return false;
+
+    // one block for each thread's band, or none when there's nothing to split
+    if (forceImageFormat == decodedFormat && decodeBlocks != (restartInterval != 0 ? 4 : 0))
+        return false;
+
+    std::vector<uint8_t> expected = decodeJPEGData(fileData, scaleDenom, options);
+    if (forceImageFormat != decodedFormat)
+    {
+        std::vector<uint8_t> converted(decoded.size());
+        AImgConvertFormat(&expected[0], &converted[0], decodedWidth, decodedHeight, decodedFormat, forceImageFormat);
+        expected.swap(converted);
+    }
+
+    return expected == decoded;
+}
+
+TEST(JPEG, TestRestartDecode)
+{
+    // 94 MCUs to a row, so the restarts are every row, every half row, and at no row boundary at all
+    ASSERT_TRUE(compareRestartDecode(AIL_JPEG_SUBSAMPLING_420, 94));
+    ASSERT_TRUE(compareRestartDecode(AIL_JPEG_SUBSAMPLING_422, 47));
+    ASSERT_TRUE(compareRestartDecode(AIL_JPEG_SUBSAMPLING_444, 7));
+    ASSERT_TRUE(compareRestartDecode(AIL_JPEG_SUBSAMPLING_420, 0));
+}
+
+TEST(JPEG, TestRestartDecodeOptions)
+{
+    JpegDecodingOptions options;
+    options.type = AImgFileFormat::JPEG_IMAGE_FORMAT;
+    options.dctMethod = AIL_JPEG_DCT_IFAST;
+    options.fancyUpsampling = 0;
+    options.blockSmoothing = 0;
+    options.colourSpace = AIL_JPEG_COLOURSPACE_DEFAULT;
+    ASSERT_TRUE(compareRestartDecode(AIL_JPEG_SUBSAMPLING_420, 94, 1, &options));
+
+    options.fancyUpsampling = 1;
+    options.colourSpace = AIL_JPEG_COLOURSPACE_GREYSCALE;
+    ASSERT_TRUE(compareRestartDecode(AIL_JPEG_SUBSAMPLING_420, 10, 4, &options));
+
+    ASSERT_TRUE(compareRestartDecode(AIL_JPEG_SUBSAMPLING_420, 94, 2, NULL, AImgFormat::RGBA16U));
+    ASSERT_TRUE(compareRestartDecode(AIL_JPEG_SUBSAMPLING_420, 94, 1, NULL, AImgFormat::INVALID_FORMAT, false));
+}
+
 TEST(JPEG, TestWriteJPEG)
 {
     TestWriteJpeg(AImgFormat::INVALID_FORMAT, AImgFormat::INVALID_FORMAT);
@@ -224,6 +556,76 @@ TEST(JPEG, TestWriteConvert)
     TestWriteJpeg(AImgFormat::RGB16U, AImgFormat::RGB8U);
 }
 
+TEST(JPEG, TestWriteEncodingOptions)
+{
+    JpegEncodingOptions options;
+    options.type = AImgFileFormat::JPEG_IMAGE_FORMAT;
+    options.quality = 85;
+    options.subsampling = AIL_JPEG_SUBSAMPLING_422;
+    options.progressive = 1;
+    options.optimizeCoding = 1;
+    options.restartInterval = 16;
+
+    std::vector<uint8_t> fileData;
+    ASSERT_EQ(writeJpegWithOptions(&options, fileData), AImgErrorCode::AIMG_SUCCESS);
+
+    // check what was written with libjpeg
+    jpeg_decompress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, &fileData[0], fileData.size());
+    jpeg_read_header(&cinfo, TRUE);
+
+    ASSERT_TRUE(cinfo.progressive_mode);
+    ASSERT_EQ(cinfo.restart_interval, 16u);
+    ASSERT_EQ(cinfo.comp_info[0].h_samp_factor, 2);
+    ASSERT_EQ(cinfo.comp_info[0].v_samp_factor, 1);
+
+    jpeg_destroy_decompress(&cinfo);
+
+    // optimised Huffman tables are never bigger than the standard ones
+    std::vector<uint8_t> optimisedData;
+    options.progressive = 0;
+    options.restartInterval = 0;
+    ASSERT_EQ(writeJpegWithOptions(&options, optimisedData), AImgErrorCode::AIMG_SUCCESS);
+
+    std::vector<uint8_t> unoptimisedData;
+    options.optimizeCoding = 0;
+    ASSERT_EQ(writeJpegWithOptions(&options, unoptimisedData), AImgErrorCode::AIMG_SUCCESS);
+    ASSERT_LT(optimisedData.size(), unoptimisedData.size());
+
+    // a lower quality makes a smaller file
+    std::vector<uint8_t> defaultData;
+    ASSERT_EQ(writeJpegWithOptions(NULL, defaultData), AImgErrorCode::AIMG_SUCCESS);
+    ASSERT_LT(unoptimisedData.size(), defaultData.size());
+}
+
+TEST(JPEG, TestWriteInvalidEncodingOptions)
+{
+    JpegEncodingOptions options;
+    options.type = AImgFileFormat::JPEG_IMAGE_FORMAT;
+    options.quality = 0;
+    options.subsampling = AIL_JPEG_SUBSAMPLING_420;
+    options.progressive = 0;
+    options.optimizeCoding = 0;
+    options.restartInterval = 0;
+
+    std::vector<uint8_t> fileData;
+    ASSERT_EQ(writeJpegWithOptions(&options, fileData), AImgErrorCode::AIMG_INVALID_ENCODE_ARGS);
+
+    options.quality = 85;
+    options.subsampling = 3;
+    ASSERT_EQ(writeJpegWithOptions(&options, fileData), AImgErrorCode::AIMG_INVALID_ENCODE_ARGS);
+
+    options.subsampling = AIL_JPEG_SUBSAMPLING_420;
+    options.restartInterval = 65536;
+    ASSERT_EQ(writeJpegWithOptions(&options, fileData), AImgErrorCode::AIMG_INVALID_ENCODE_ARGS);
+
+    int32_t pngOptions = AImgFileFormat::PNG_IMAGE_FORMAT;
+    ASSERT_EQ(writeJpegWithOptions(&pngOptions, fileData), AImgErrorCode::AIMG_INVALID_ENCODE_ARGS);
+}
+
 TEST(JPEG, TestSupportedFormat)
 {
     ASSERT_TRUE(AImgIsFormatSupported(AImgFileFormat::JPEG_IMAGE_FORMAT, AImgFormat::_8BITS | AImgFormat::RGB));
@@ -231,6 +633,18 @@ TEST(JPEG, TestSupportedFormat)
     ASSERT_FALSE(AImgIsFormatSupported(AImgFileFormat::JPEG_IMAGE_FORMAT, AImgFormat::_32BITS));
 }
 
+TEST(JPEG, TestScratchReuse)
+{
+    ASSERT_TRUE(compareScratch("/jpeg/test.jpeg", AImgFormat::RGBA16U));
+}
+
+TEST(JPEG, TestProbe)
+{
+    ASSERT_TRUE(compareProbe("/jpeg/test.jpeg"));
+    ASSERT_TRUE(compareProbe("/jpeg/greyscale.jpeg"));
+    ASSERT_TRUE(compareProbe("/jpeg/karl_comment.jpeg"));
+}
+
 int main(int argc, char **argv)
 {
     AImgInitialise();
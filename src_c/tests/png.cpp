@@ -424,6 +424,165 @@ TEST(PNG, TestCompareForceImageFormat3)
     ASSERT_TRUE(compareForceImageFormat("/png/alpha.png"));
 }
 
+TEST(PNG, TestDecodeRows)
+{
+    ASSERT_TRUE(compareDecodeRows("/png/8-bit.png", AImgFormat::INVALID_FORMAT));
+}
+
+TEST(PNG, TestDecodeRowsForceImageFormat)
+{
+    ASSERT_TRUE(compareDecodeRows("/png/16-bit.png", AImgFormat::RGBA32F));
+}
+
+TEST(PNG, TestDecodeRowsOutOfOrder)
+{
+    auto data = readFile<uint8_t>(getImagesDir() + "/png/8-bit.png");
+
+    ReadCallback readCallback = NULL;
+    WriteCallback writeCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+
+    AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &data[0], (int32_t)data.size());
+
+    AImgHandle img = NULL;
+    ASSERT_EQ(AImgOpen(readCallback, tellCallback, seekCallback, callbackData, &img, NULL), AImgErrorCode::AIMG_SUCCESS);
+
+    std::vector<uint8_t> rows(640 * 3 * 10);
+
+    // skipping forwards is fine, going back isn't
+    ASSERT_EQ(AImgDecodeRows(img, &rows[0], 20, 10, 0, AImgFormat::INVALID_FORMAT), AImgErrorCode::AIMG_SUCCESS);
+    ASSERT_EQ(AImgDecodeRows(img, &rows[0], 0, 10, 0, AImgFormat::INVALID_FORMAT), AImgErrorCode::AIMG_INVALID_ARGS);
+    ASSERT_EQ(AImgDecodeRows(img, &rows[0], 395, 10, 0, AImgFormat::INVALID_FORMAT), AImgErrorCode::AIMG_INVALID_ARGS);
+    ASSERT_EQ(AImgDecodeRows(img, &rows[0], 390, 10, 0, AImgFormat::INVALID_FORMAT), AImgErrorCode::AIMG_SUCCESS);
+
+    AImgClose(img);
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+}
+
+TEST(PNG, TestDecodeRegion)
+{
+    ASSERT_TRUE(compareDecodeRegion("/png/16-bit.png", 101, 203, 317, 97, AImgFormat::RGB8U));
+}
+
+TEST(PNG, TestLargeStreamOffset)
+{
+    ASSERT_TRUE(compareLargeStreamOffset("/png/8-bit.png"));
+}
+
+TEST(PNG, TestBufferedRead)
+{
+    ASSERT_TRUE(compareBufferedRead("/png/16-bit.png", 256 * 1024));
+    ASSERT_TRUE(compareBufferedRead("/png/16-bit.png", 1000));
+}
+
+TEST(PNG, TestConcurrentDecode)
+{
+    ASSERT_TRUE(compareConcurrentDecode("/png/16-bit.png", 8));
+}
+
+TEST(PNG, TestCustomAllocator)
+{
+    ASSERT_TRUE(compareCustomAllocator("/png/8-bit.png"));
+}
+
+TEST(PNG, TestScratchReuse)
+{
+    ASSERT_TRUE(compareScratch("/png/8-bit.png", AImgFormat::RGBA32F));
+}
+
+TEST(PNG, TestStats)
+{
+    ASSERT_TRUE(compareStats("/png/8-bit.png", AImgFileFormat::PNG_IMAGE_FORMAT));
+}
+
+TEST(PNG, TestTraceHooks)
+{
+    ASSERT_TRUE(compareTraceHooks("/png/8-bit.png", AImgFileFormat::PNG_IMAGE_FORMAT));
+}
+
+TEST(PNG, TestProbe)
+{
+    ASSERT_TRUE(compareProbe("/png/8-bit.png"));
+    ASSERT_TRUE(compareProbe("/png/16-bit.png"));
+    ASSERT_TRUE(compareProbe("/png/alpha.png"));
+    ASSERT_TRUE(compareProbe("/png/indextest_indexed.png"));
+    ASSERT_TRUE(compareProbe("/png/ICC.png"));
+}
+
+TEST(PNG, TestDecodeScaleUnsupported)
+{
+    auto data = readFile<uint8_t>(getImagesDir() + "/png/8-bit.png");
+
+    ReadCallback readCallback = NULL;
+    WriteCallback writeCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+
+    AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &data[0], data.size());
+
+    AImgHandle img = NULL;
+    ASSERT_EQ(AImgOpen(readCallback, tellCallback, seekCallback, callbackData, &img, NULL), AImgErrorCode::AIMG_SUCCESS);
+
+    ASSERT_EQ(AImgSetDecodeScale(img, 2), AImgErrorCode::AIMG_INVALID_ARGS);
+    ASSERT_EQ(AImgSetDecodeScale(img, 1), AImgErrorCode::AIMG_SUCCESS);
+
+    JpegDecodingOptions options;
+    options.type = AImgFileFormat::JPEG_IMAGE_FORMAT;
+    options.dctMethod = AIL_JPEG_DCT_IFAST;
+    options.fancyUpsampling = 0;
+    options.blockSmoothing = 0;
+    options.colourSpace = AIL_JPEG_COLOURSPACE_DEFAULT;
+    ASSERT_EQ(AImgSetDecodingOptions(img, &options), AImgErrorCode::AIMG_INVALID_ARGS);
+    ASSERT_EQ(AImgSetDecodingOptions(img, NULL), AImgErrorCode::AIMG_SUCCESS);
+
+    AImgClose(img);
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+}
+
+TEST(PNG, TestDecodeImageAsync)
+{
+    ASSERT_TRUE(compareDecodeAsync("/png/16-bit.png", 8));
+}
+
+TEST(PNG, TestDecodeImageAsyncWhileResizingPool)
+{
+    ASSERT_TRUE(compareDecodeAsync("/png/16-bit.png", 8, true));
+}
+
+TEST(PNG, TestDecodeBatch)
+{
+    std::vector<std::vector<uint8_t> > files;
+    files.push_back(readFile<uint8_t>(getImagesDir() + "/png/8-bit.png"));
+    files.push_back(readFile<uint8_t>(getImagesDir() + "/png/16-bit.png"));
+    files.push_back(readFile<uint8_t>(getImagesDir() + "/png/alpha.png"));
+    files.push_back(std::vector<uint8_t>(64, 0x42)); // not an image, should fail on its own
+    files.push_back(readFile<uint8_t>(getImagesDir() + "/jpeg/test.jpeg"));
+
+    ASSERT_TRUE(compareDecodeBatch(files, AImgFormat::INVALID_FORMAT));
+    ASSERT_TRUE(compareDecodeBatch(files, AImgFormat::RGBA32F));
+}
+
+TEST(PNG, TestRegistryLookups)
+{
+    // already initialised by main
+    ASSERT_EQ(AImgInitialise(), AImgErrorCode::AIMG_SUCCESS);
+
+    ASSERT_TRUE(AImgIsFormatSupported(PNG_IMAGE_FORMAT, AImgFormat::RGBA8U));
+    ASSERT_FALSE(AImgIsFormatSupported(UNKNOWN_IMAGE_FORMAT, AImgFormat::RGBA8U));
+    ASSERT_FALSE(AImgIsFormatSupported(1000, AImgFormat::RGBA8U));
+    ASSERT_EQ(AImgGetWhatFormatWillBeWrittenForData(1000, AImgFormat::RGBA8U, AImgFormat::INVALID_FORMAT), AImgFormat::INVALID_FORMAT);
+
+    ASSERT_TRUE(AImgGetAImg(UNKNOWN_IMAGE_FORMAT) == NULL);
+    ASSERT_TRUE(AImgGetAImg(0) == NULL);
+
+    AImgHandle img = AImgGetAImg(PNG_IMAGE_FORMAT);
+    ASSERT_TRUE(img != NULL);
+    AImgClose(img);
+}
+
 TEST(PNG, TestForceImageFormat)
 {
     auto data = readFile<uint8_t>(getImagesDir() + "/png/8-bit.png");
@@ -1,6 +1,10 @@
 #include "testCommon.h"
 #include <cmath>
 #include <string.h>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <set>
 
 bool detectImage(const std::string& path, int32_t format)
 {
@@ -145,6 +149,879 @@ bool compareForceImageFormat(const std::string& path)
     return true;
 }
 
+// Decodes the whole image, then decodes it again in small bands into a buffer with padded rows, and checks they match
+bool compareDecodeRows(const std::string& path, int32_t forceImageFormat, bool bottomUp)
+{
+    auto data = readFile<uint8_t>(getImagesDir() + path);
+
+    ReadCallback readCallback = NULL;
+    WriteCallback writeCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+
+    AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &data[0], (int32_t)data.size());
+
+    AImgHandle img = NULL;
+    int32_t err = AImgOpen(readCallback, tellCallback, seekCallback, callbackData, &img, NULL);
+    if (err != AIMG_SUCCESS)
+        return false;
+
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t numChannels = 0;
+    int32_t bytesPerChannel = 0;
+    int32_t floatOrInt = 0;
+    int32_t decodedImgFormat = 0;
+
+    err = AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &decodedImgFormat, NULL);
+    if (err != AIMG_SUCCESS)
+        return false;
+
+    int32_t format = forceImageFormat == AImgFormat::INVALID_FORMAT ? decodedImgFormat : forceImageFormat;
+    AIGetFormatDetails(format, &numChannels, &bytesPerChannel, &floatOrInt);
+    int32_t rowSize = width * numChannels * bytesPerChannel;
+
+    std::vector<uint8_t> wholeImage(rowSize * height, 78);
+
+    err = AImgDecodeImage(img, &wholeImage[0], forceImageFormat);
+    if (err != AIMG_SUCCESS)
+        return false;
+
+    AImgClose(img);
+    img = NULL;
+
+    seekCallback(callbackData, 0);
+
+    err = AImgOpen(readCallback, tellCallback, seekCallback, callbackData, &img, NULL);
+    if (err != AIMG_SUCCESS)
+        return false;
+
+    // odd sizes, so the bands don't line up with strips or anything else in the file
+    const int32_t bandRows = 7;
+    const int32_t stride = rowSize + 13;
+
+    std::vector<uint8_t> rows(stride * height, 78);
+
+    int32_t numBands = (height + bandRows - 1) / bandRows;
+    for (int32_t i = 0; i < numBands; i++)
+    {
+        int32_t firstRow = (bottomUp ? numBands - 1 - i : i) * bandRows;
+        int32_t numRows = std::min(bandRows, height - firstRow);
+
+        err = AImgDecodeRows(img, &rows[firstRow * stride], firstRow, numRows, stride, forceImageFormat);
+        if (err != AIMG_SUCCESS)
+            return false;
+    }
+
+    AImgClose(img);
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+    for (int32_t y = 0; y < height; y++)
+    {
+        if (memcmp(&wholeImage[y * rowSize], &rows[y * stride], rowSize) != 0)
+            return false;
+
+        // the padding at the end of each row must be left alone
+        for (int32_t x = rowSize; x < stride; x++)
+        {
+            if (rows[y * stride + x] != 78)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+// Decodes the whole image, then just the given region of it into a buffer with padded rows, and checks the region matches
+bool compareDecodeRegion(const std::string& path, int32_t x, int32_t y, int32_t width, int32_t height, int32_t forceImageFormat)
+{
+    auto data = readFile<uint8_t>(getImagesDir() + path);
+
+    ReadCallback readCallback = NULL;
+    WriteCallback writeCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+
+    AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &data[0], (int32_t)data.size());
+
+    AImgHandle img = NULL;
+    int32_t err = AImgOpen(readCallback, tellCallback, seekCallback, callbackData, &img, NULL);
+    if (err != AIMG_SUCCESS)
+        return false;
+
+    int32_t imgWidth = 0;
+    int32_t imgHeight = 0;
+    int32_t numChannels = 0;
+    int32_t bytesPerChannel = 0;
+    int32_t floatOrInt = 0;
+    int32_t decodedImgFormat = 0;
+
+    err = AImgGetInfo(img, &imgWidth, &imgHeight, &numChannels, &bytesPerChannel, &floatOrInt, &decodedImgFormat, NULL);
+    if (err != AIMG_SUCCESS)
+        return false;
+
+    int32_t format = forceImageFormat == AImgFormat::INVALID_FORMAT ? decodedImgFormat : forceImageFormat;
+    AIGetFormatDetails(format, &numChannels, &bytesPerChannel, &floatOrInt);
+    int32_t pixelSize = numChannels * bytesPerChannel;
+
+    std::vector<uint8_t> wholeImage(imgWidth * imgHeight * pixelSize, 78);
+
+    err = AImgDecodeImage(img, &wholeImage[0], forceImageFormat);
+    if (err != AIMG_SUCCESS)
+        return false;
+
+    AImgClose(img);
+    img = NULL;
+
+    seekCallback(callbackData, 0);
+
+    err = AImgOpen(readCallback, tellCallback, seekCallback, callbackData, &img, NULL);
+    if (err != AIMG_SUCCESS)
+        return false;
+
+    const int32_t stride = width * pixelSize + 5;
+    std::vector<uint8_t> region(stride * height, 78);
+
+    err = AImgDecodeRegion(img, x, y, width, height, &region[0], stride, forceImageFormat);
+    if (err != AIMG_SUCCESS)
+        return false;
+
+    // anything outside the image is an error
+    if (AImgDecodeRegion(img, imgWidth - width + 1, y, width, height, &region[0], stride, forceImageFormat) != AImgErrorCode::AIMG_INVALID_ARGS)
+        return false;
+
+    AImgClose(img);
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+    for (int32_t row = 0; row < height; row++)
+    {
+        if (memcmp(&wholeImage[((y + row) * imgWidth + x) * pixelSize], &region[row * stride], width * pixelSize) != 0)
+            return false;
+
+        for (int32_t i = width * pixelSize; i < stride; i++)
+        {
+            if (region[row * stride + i] != 78)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+namespace CopyingCallbacks
+{
+    ReadCallback innerRead = NULL;
+    TellCallback innerTell = NULL;
+    SeekCallback innerSeek = NULL;
+
+    int32_t reads = 0;
+
+    int32_t CALLCONV read(void* callbackData, uint8_t* dest, int32_t count) { reads++; return innerRead(callbackData, dest, count); }
+    int32_t CALLCONV tell(void* callbackData) { return innerTell(callbackData); }
+    void CALLCONV seek(void* callbackData, int32_t pos) { innerSeek(callbackData, pos); }
+}
+
+bool decodeWithCallbacks(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, std::vector<uint8_t>& decoded,
+    int32_t openFlags = AImgOpenFlags::AIMG_OPEN_FLAGS_NONE)
+{
+    AImgHandle img = NULL;
+    int32_t err = AImgOpenWithFlags(readCallback, tellCallback, seekCallback, callbackData, &img, NULL, openFlags);
+    if (err != AIMG_SUCCESS)
+        return false;
+
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t numChannels = 0;
+    int32_t bytesPerChannel = 0;
+    int32_t floatOrInt = 0;
+    int32_t decodedImgFormat = 0;
+
+    err = AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &decodedImgFormat, NULL);
+    if (err != AIMG_SUCCESS)
+        return false;
+
+    decoded.resize(width * height * numChannels * bytesPerChannel);
+    err = AImgDecodeImage(img, &decoded[0], AImgFormat::INVALID_FORMAT);
+
+    AImgClose(img);
+
+    return err == AIMG_SUCCESS;
+}
+
+// Decodes the image through memory mapped file callbacks, and checks it matches decoding with callbacks that copy
+bool compareMappedFile(const std::string& path)
+{
+    std::string fullPath = getImagesDir() + path;
+
+    ReadCallback readCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+
+    if (AIGetMappedFileCallbacks((fullPath + ".missing").c_str(), &readCallback, &tellCallback, &seekCallback, &callbackData) != AImgErrorCode::AIMG_OPEN_FAILED_FILE)
+        return false;
+
+    if (AIGetMappedFileCallbacks(fullPath.c_str(), &readCallback, &tellCallback, &seekCallback, &callbackData) != AIMG_SUCCESS)
+        return false;
+
+    std::vector<uint8_t> mappedDecoded;
+    bool ok = decodeWithCallbacks(readCallback, tellCallback, seekCallback, callbackData, mappedDecoded);
+
+    AIDestroyMappedFileCallbacks(readCallback, tellCallback, seekCallback, callbackData);
+
+    if (!ok)
+        return false;
+
+    auto data = readFile<uint8_t>(fullPath);
+
+    WriteCallback writeCallback = NULL;
+    AIGetSimpleMemoryBufferCallbacks(&CopyingCallbacks::innerRead, &writeCallback, &CopyingCallbacks::innerTell, &CopyingCallbacks::innerSeek, &callbackData, &data[0], (int32_t)data.size());
+
+    std::vector<uint8_t> copiedDecoded;
+    ok = decodeWithCallbacks(&CopyingCallbacks::read, &CopyingCallbacks::tell, &CopyingCallbacks::seek, callbackData, copiedDecoded);
+
+    AIDestroySimpleMemoryBufferCallbacks(CopyingCallbacks::innerRead, writeCallback, CopyingCallbacks::innerTell, CopyingCallbacks::innerSeek, callbackData);
+
+    return ok && mappedDecoded == copiedDecoded;
+}
+
+// 64 bit callbacks over a memory buffer that claim the buffer starts 5GiB into the stream, to check nothing truncates positions
+namespace OffsetCallbacks
+{
+    const int64_t offset = 5LL * 1024 * 1024 * 1024;
+
+    struct Data
+    {
+        std::vector<uint8_t>* buffer;
+        int64_t pos;
+    };
+
+    int64_t CALLCONV read(void* callbackData, uint8_t* dest, int64_t count)
+    {
+        Data* data = (Data*)callbackData;
+
+        int64_t bufferPos = data->pos - offset;
+        int64_t toRead = std::min(count, (int64_t)data->buffer->size() - bufferPos);
+        if (bufferPos < 0 || toRead < 0)
+            return 0;
+
+        memcpy(dest, &(*data->buffer)[bufferPos], toRead);
+        data->pos += toRead;
+
+        return toRead;
+    }
+
+    int64_t CALLCONV tell(void* callbackData) { return ((Data*)callbackData)->pos; }
+    void CALLCONV seek(void* callbackData, int64_t pos) { ((Data*)callbackData)->pos = pos; }
+}
+
+// Decodes the image through 64 bit callbacks positioned past 4GiB, and checks it matches decoding it normally
+bool compareLargeStreamOffset(const std::string& path)
+{
+    auto fileData = readFile<uint8_t>(getImagesDir() + path);
+
+    OffsetCallbacks::Data data;
+    data.buffer = &fileData;
+    data.pos = OffsetCallbacks::offset;
+
+    std::vector<uint8_t> offsetDecoded;
+    AImgHandle img = NULL;
+    if (AImgOpen64(&OffsetCallbacks::read, &OffsetCallbacks::tell, &OffsetCallbacks::seek, &data, &img, NULL) != AIMG_SUCCESS)
+        return false;
+
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t numChannels = 0;
+    int32_t bytesPerChannel = 0;
+    int32_t floatOrInt = 0;
+    int32_t decodedImgFormat = 0;
+
+    if (AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &decodedImgFormat, NULL) != AIMG_SUCCESS)
+        return false;
+
+    offsetDecoded.resize(width * height * numChannels * bytesPerChannel);
+    int32_t err = AImgDecodeImage(img, &offsetDecoded[0], AImgFormat::INVALID_FORMAT);
+    AImgClose(img);
+
+    if (err != AIMG_SUCCESS)
+        return false;
+
+    ReadCallback readCallback = NULL;
+    WriteCallback writeCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+    AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &fileData[0], (int32_t)fileData.size());
+
+    std::vector<uint8_t> decoded;
+    bool ok = decodeWithCallbacks(readCallback, tellCallback, seekCallback, callbackData, decoded);
+
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+    return ok && decoded == offsetDecoded;
+}
+
+// Decodes the image with AIMG_OPEN_BUFFERED_READS, and checks it matches an unbuffered decode while calling readCallback less often
+bool compareBufferedRead(const std::string& path, int32_t readBufferSize)
+{
+    auto data = readFile<uint8_t>(getImagesDir() + path);
+
+    WriteCallback writeCallback = NULL;
+    void* callbackData = NULL;
+    AIGetSimpleMemoryBufferCallbacks(&CopyingCallbacks::innerRead, &writeCallback, &CopyingCallbacks::innerTell, &CopyingCallbacks::innerSeek, &callbackData, &data[0], (int32_t)data.size());
+
+    CopyingCallbacks::reads = 0;
+    std::vector<uint8_t> unbuffered;
+    bool ok = decodeWithCallbacks(&CopyingCallbacks::read, &CopyingCallbacks::tell, &CopyingCallbacks::seek, callbackData, unbuffered);
+    int32_t unbufferedReads = CopyingCallbacks::reads;
+
+    CopyingCallbacks::innerSeek(callbackData, 0);
+
+    AImgSetReadBufferSize(readBufferSize);
+
+    CopyingCallbacks::reads = 0;
+    std::vector<uint8_t> buffered;
+    ok = ok && decodeWithCallbacks(&CopyingCallbacks::read, &CopyingCallbacks::tell, &CopyingCallbacks::seek, callbackData, buffered, AImgOpenFlags::AIMG_OPEN_BUFFERED_READS);
+    int32_t bufferedReads = CopyingCallbacks::reads;
+
+    AImgSetReadBufferSize(256 * 1024);
+
+    AIDestroySimpleMemoryBufferCallbacks(CopyingCallbacks::innerRead, writeCallback, CopyingCallbacks::innerTell, CopyingCallbacks::innerSeek, callbackData);
+
+    return ok && buffered == unbuffered && bufferedReads < unbufferedReads;
+}
+
+// Decodes the same file on several threads at once, each with its own handle, and checks they all match a decode on this thread
+bool compareConcurrentDecode(const std::string& path, int32_t numThreads)
+{
+    auto data = readFile<uint8_t>(getImagesDir() + path);
+
+    auto decode = [&data](std::vector<uint8_t>& decoded) -> bool
+    {
+        ReadCallback readCallback = NULL;
+        WriteCallback writeCallback = NULL;
+        TellCallback tellCallback = NULL;
+        SeekCallback seekCallback = NULL;
+        void* callbackData = NULL;
+
+        AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &data[0], (int32_t)data.size());
+        bool ok = decodeWithCallbacks(readCallback, tellCallback, seekCallback, callbackData, decoded);
+        AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+        return ok;
+    };
+
+    std::vector<uint8_t> expected;
+    if (!decode(expected))
+        return false;
+
+    std::vector<std::vector<uint8_t> > results(numThreads);
+    std::vector<int32_t> succeeded(numThreads, 0);
+    std::vector<std::thread> threads;
+
+    for (int32_t i = 0; i < numThreads; i++)
+        threads.push_back(std::thread([&, i]() { succeeded[i] = decode(results[i]); }));
+
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+
+    for (int32_t i = 0; i < numThreads; i++)
+    {
+        if (!succeeded[i] || results[i] != expected)
+            return false;
+    }
+
+    return true;
+}
+
+namespace AsyncCallbacks
+{
+    // userData is where to put the error code
+    void CALLCONV complete(void* userData, void* /*img*/, int32_t error)
+    {
+        *(int32_t*)userData = error;
+    }
+}
+
+// Starts numImages async decodes of the same file, each on its own handle, and checks they all match a normal decode.
+// With resizePool, the thread pool is replaced while they are running.
+bool compareDecodeAsync(const std::string& path, int32_t numImages, bool resizePool)
+{
+    auto data = readFile<uint8_t>(getImagesDir() + path);
+
+    ReadCallback readCallback = NULL;
+    WriteCallback writeCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+
+    AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &data[0], (int32_t)data.size());
+    std::vector<uint8_t> expected;
+    bool ok = decodeWithCallbacks(readCallback, tellCallback, seekCallback, callbackData, expected);
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+    if (!ok)
+        return false;
+
+    std::vector<void*> callbackDatas(numImages);
+    std::vector<AImgHandle> imgs(numImages);
+    std::vector<std::vector<uint8_t> > results(numImages, std::vector<uint8_t>(expected.size()));
+    std::vector<int32_t> callbackErrors(numImages, AImgErrorCode::AIMG_NOT_READY);
+    std::vector<AImgFuture> futures(numImages, (AImgFuture)NULL);
+
+    for (int32_t i = 0; i < numImages; i++)
+    {
+        AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackDatas[i], &data[0], (int32_t)data.size());
+        ok = ok && AImgOpen(readCallback, tellCallback, seekCallback, callbackDatas[i], &imgs[i], NULL) == AIMG_SUCCESS;
+        ok = ok && AImgDecodeImageAsync(imgs[i], &results[i][0], AImgFormat::INVALID_FORMAT, &AsyncCallbacks::complete, &callbackErrors[i], &futures[i]) == AIMG_SUCCESS;
+    }
+
+    if (resizePool)
+    {
+        AImgSetThreadCount(3);
+        AImgSetThreadCount(0);
+    }
+
+    int32_t pollResult = AImgFutureWait(futures[numImages - 1], 0);
+    ok = ok && (pollResult == AIMG_SUCCESS || pollResult == AImgErrorCode::AIMG_NOT_READY);
+
+    for (int32_t i = 0; i < numImages; i++)
+    {
+        // the callback runs before the future is marked ready
+        ok = ok && AImgFutureWait(futures[i], -1) == AIMG_SUCCESS && callbackErrors[i] == AIMG_SUCCESS && results[i] == expected;
+        ok = ok && AImgFutureWait(futures[i], 0) == AIMG_SUCCESS;
+
+        AImgFutureRelease(futures[i]);
+        AImgClose(imgs[i]);
+        AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackDatas[i]);
+    }
+
+    return ok;
+}
+
+namespace CountingAllocator
+{
+    std::mutex mutex;
+    std::set<void*> live;
+    int32_t allocations = 0;
+
+    void* CALLCONV allocate(void* /*userData*/, size_t size)
+    {
+        void* ptr = malloc(size);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        live.insert(ptr);
+        allocations++;
+        return ptr;
+    }
+
+    void* CALLCONV reallocate(void* /*userData*/, void* ptr, size_t size)
+    {
+        void* newPtr = realloc(ptr, size);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        live.erase(ptr);
+        live.insert(newPtr);
+        allocations++;
+        return newPtr;
+    }
+
+    void CALLCONV deallocate(void* /*userData*/, void* ptr)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            live.erase(ptr);
+        }
+
+        free(ptr);
+    }
+}
+
+// Decodes the file with an allocator set that tracks what it hands out, and checks the library used it, freed
+// everything it allocated, and decoded the same thing as with the default allocator
+bool compareCustomAllocator(const std::string& path)
+{
+    auto data = readFile<uint8_t>(getImagesDir() + path);
+
+    ReadCallback readCallback = NULL;
+    WriteCallback writeCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+
+    AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &data[0], (int32_t)data.size());
+
+    std::vector<uint8_t> expected;
+    bool ok = decodeWithCallbacks(readCallback, tellCallback, seekCallback, callbackData, expected);
+
+    if (AImgSetAllocator(&CountingAllocator::allocate, NULL, NULL, NULL) != AImgErrorCode::AIMG_INVALID_ARGS)
+        ok = false;
+
+    CountingAllocator::allocations = 0;
+    AImgSetAllocator(&CountingAllocator::allocate, &CountingAllocator::deallocate, &CountingAllocator::reallocate, NULL);
+
+    seekCallback(callbackData, 0);
+    std::vector<uint8_t> decoded;
+    ok = ok && decodeWithCallbacks(readCallback, tellCallback, seekCallback, callbackData, decoded);
+
+    AImgSetAllocator(NULL, NULL, NULL, NULL);
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+    return ok && decoded == expected && CountingAllocator::allocations > 0 && CountingAllocator::live.empty();
+}
+
+// Decodes the file a few times through fresh handles sharing one AImgScratch, checks every decode matches decoding
+// without a scratch, and that once the scratch has grown the later decodes allocate less and the same each time
+bool compareScratch(const std::string& path, int32_t forceImageFormat)
+{
+    auto data = readFile<uint8_t>(getImagesDir() + path);
+
+    ReadCallback readCallback = NULL;
+    WriteCallback writeCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+
+    AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &data[0], (int32_t)data.size());
+
+    AImgScratch scratch = AImgCreateScratch();
+    bool ok = scratch != NULL && AImgSetScratch(NULL, scratch) == AImgErrorCode::AIMG_INVALID_ARGS;
+
+    std::vector<uint8_t> expected;
+    int32_t passAllocations[4] = {};
+
+    AImgSetAllocator(&CountingAllocator::allocate, &CountingAllocator::deallocate, &CountingAllocator::reallocate, NULL);
+
+    for (int32_t pass = 0; pass < 4 && ok; pass++)
+    {
+        seekCallback(callbackData, 0);
+        CountingAllocator::allocations = 0;
+
+        AImgHandle img = NULL;
+        ok = AImgOpen(readCallback, tellCallback, seekCallback, callbackData, &img, NULL) == AIMG_SUCCESS;
+
+        int32_t width = 0, height = 0, numChannels = 0, bytesPerChannel = 0, floatOrInt = 0, format = 0;
+        ok = ok && AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &format, NULL) == AIMG_SUCCESS;
+
+        if (ok)
+        {
+            // the first pass is the reference decode without a scratch
+            if (pass > 0)
+                AImgSetScratch(img, scratch);
+
+            if (forceImageFormat != AImgFormat::INVALID_FORMAT)
+                format = forceImageFormat;
+            AIGetFormatDetails(format, &numChannels, &bytesPerChannel, &floatOrInt);
+
+            std::vector<uint8_t> decoded((size_t)width * height * numChannels * bytesPerChannel);
+            ok = AImgDecodeImage(img, &decoded[0], forceImageFormat) == AIMG_SUCCESS;
+
+            if (pass == 0)
+                expected.swap(decoded);
+            else
+                ok = ok && decoded == expected;
+        }
+
+        AImgClose(img);
+        passAllocations[pass] = CountingAllocator::allocations;
+    }
+
+    AImgSetAllocator(NULL, NULL, NULL, NULL);
+    AImgDestroyScratch(scratch);
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+    return ok && passAllocations[2] < passAllocations[1] && passAllocations[3] == passAllocations[2];
+}
+
+// Decodes the file forced to RGBA32F with stats on and checks they add up to something sensible, that turning them on
+// doesn't change what's decoded, and that handles created before they were turned on have none. Then writes the
+// image back out as fileFormat and checks the writes were counted.
+bool compareStats(const std::string& path, int32_t fileFormat)
+{
+    auto data = readFile<uint8_t>(getImagesDir() + path);
+
+    ReadCallback readCallback = NULL;
+    WriteCallback writeCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+
+    AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &data[0], (int32_t)data.size());
+
+    AImgHandle plainImg = NULL;
+    bool ok = AImgOpen(readCallback, tellCallback, seekCallback, callbackData, &plainImg, NULL) == AIMG_SUCCESS;
+
+    int32_t width = 0, height = 0, numChannels = 0, bytesPerChannel = 0, floatOrInt = 0, format = 0;
+    ok = ok && AImgGetInfo(plainImg, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &format, NULL) == AIMG_SUCCESS;
+
+    std::vector<float> expected((size_t)width * height * 4);
+    ok = ok && AImgDecodeImage(plainImg, &expected[0], AImgFormat::RGBA32F) == AIMG_SUCCESS;
+
+    AImgStats stats;
+    ok = ok && AImgGetStats(plainImg, &stats) == AImgErrorCode::AIMG_INVALID_ARGS;
+    AImgClose(plainImg);
+
+    AImgSetStatsEnabled(1);
+
+    seekCallback(callbackData, 0);
+    AImgHandle img = NULL;
+    ok = ok && AImgOpen(readCallback, tellCallback, seekCallback, callbackData, &img, NULL) == AIMG_SUCCESS;
+
+    std::vector<float> decoded(expected.size());
+    ok = ok && AImgDecodeImage(img, &decoded[0], AImgFormat::RGBA32F) == AIMG_SUCCESS && decoded == expected;
+    ok = ok && AImgGetStats(img, &stats) == AIMG_SUCCESS;
+    AImgClose(img);
+
+    // the in memory callbacks let some loaders read in place, but they all at least tell or seek to find where they are
+    ok = ok && stats.readCalls + stats.tellCalls + stats.seekCalls > 0 && (stats.bytesRead > 0) == (stats.readCalls > 0);
+    ok = ok && stats.bytesWritten == 0 && stats.writeCalls == 0;
+    ok = ok && stats.codecTime > 0 && stats.convertTime > 0 && stats.callbackTime >= 0 && stats.peakScratchBytes >= 0;
+
+    std::vector<uint8_t> written(1);
+    ReadCallback writeReadCallback = NULL;
+    WriteCallback writeWriteCallback = NULL;
+    TellCallback writeTellCallback = NULL;
+    SeekCallback writeSeekCallback = NULL;
+    void* writeCallbackData = NULL;
+
+    AIGetResizableMemoryBufferCallbacks(&writeReadCallback, &writeWriteCallback, &writeTellCallback, &writeSeekCallback, &writeCallbackData, &written);
+
+    AImgHandle wImg = AImgGetAImg(fileFormat);
+    int32_t writeFormat = AImgGetWhatFormatWillBeWrittenForData(fileFormat, AImgFormat::RGBA32F, AImgFormat::INVALID_FORMAT);
+    ok = ok && AImgWriteImage(wImg, &decoded[0], width, height, AImgFormat::RGBA32F, writeFormat, NULL, NULL, 0,
+        writeWriteCallback, writeTellCallback, writeSeekCallback, writeCallbackData, NULL) == AIMG_SUCCESS;
+
+    ok = ok && AImgGetStats(wImg, &stats) == AIMG_SUCCESS;
+    ok = ok && stats.writeCalls > 0 && stats.bytesWritten >= (int64_t)written.size() && stats.bytesRead == 0 && stats.codecTime > 0;
+
+    AImgClose(wImg);
+    AIDestroySimpleMemoryBufferCallbacks(writeReadCallback, writeWriteCallback, writeTellCallback, writeSeekCallback, writeCallbackData);
+
+    AImgSetStatsEnabled(0);
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+    return ok;
+}
+
+namespace TraceRecorder
+{
+    std::mutex mutex;
+    std::vector<std::pair<std::thread::id, std::string> > open; // stages begun and not yet ended
+    std::set<std::string> seen;
+    bool balanced = true;
+
+    void CALLCONV begin(void* /*userData*/, const char* stage)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        open.push_back(std::make_pair(std::this_thread::get_id(), std::string(stage)));
+        seen.insert(stage);
+    }
+
+    void CALLCONV end(void* /*userData*/, const char* stage)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // the stage ending has to be the last one this thread began
+        for (auto it = open.rbegin(); it != open.rend(); ++it)
+        {
+            if (it->first == std::this_thread::get_id())
+            {
+                balanced = balanced && it->second == stage;
+                open.erase(std::next(it).base());
+                return;
+            }
+        }
+
+        balanced = false;
+    }
+}
+
+// Decodes the file forced to RGBA32F and writes it back out as fileFormat with trace hooks set, and checks every stage
+// that should have run was traced, with each begin matched by an end on the same thread
+bool compareTraceHooks(const std::string& path, int32_t fileFormat)
+{
+    auto data = readFile<uint8_t>(getImagesDir() + path);
+
+    ReadCallback readCallback = NULL;
+    WriteCallback writeCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+
+    AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &data[0], (int32_t)data.size());
+
+    bool ok = AImgSetTraceHooks(&TraceRecorder::begin, NULL, NULL) == AImgErrorCode::AIMG_INVALID_ARGS;
+
+    TraceRecorder::open.clear();
+    TraceRecorder::seen.clear();
+    TraceRecorder::balanced = true;
+    AImgSetTraceHooks(&TraceRecorder::begin, &TraceRecorder::end, NULL);
+
+    AImgHandle img = NULL;
+    ok = ok && AImgOpen(readCallback, tellCallback, seekCallback, callbackData, &img, NULL) == AIMG_SUCCESS;
+
+    int32_t width = 0, height = 0, numChannels = 0, bytesPerChannel = 0, floatOrInt = 0, format = 0;
+    ok = ok && AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &format, NULL) == AIMG_SUCCESS;
+
+    std::vector<float> decoded((size_t)width * height * 4);
+    ok = ok && AImgDecodeImage(img, &decoded[0], AImgFormat::RGBA32F) == AIMG_SUCCESS;
+    AImgClose(img);
+
+    std::vector<uint8_t> written(1);
+    ReadCallback writeReadCallback = NULL;
+    WriteCallback writeWriteCallback = NULL;
+    TellCallback writeTellCallback = NULL;
+    SeekCallback writeSeekCallback = NULL;
+    void* writeCallbackData = NULL;
+
+    AIGetResizableMemoryBufferCallbacks(&writeReadCallback, &writeWriteCallback, &writeTellCallback, &writeSeekCallback, &writeCallbackData, &written);
+
+    AImgHandle wImg = AImgGetAImg(fileFormat);
+    int32_t writeFormat = AImgGetWhatFormatWillBeWrittenForData(fileFormat, AImgFormat::RGBA32F, AImgFormat::INVALID_FORMAT);
+    ok = ok && AImgWriteImage(wImg, &decoded[0], width, height, AImgFormat::RGBA32F, writeFormat, NULL, NULL, 0,
+        writeWriteCallback, writeTellCallback, writeSeekCallback, writeCallbackData, NULL) == AIMG_SUCCESS;
+
+    AImgClose(wImg);
+    AIDestroySimpleMemoryBufferCallbacks(writeReadCallback, writeWriteCallback, writeTellCallback, writeSeekCallback, writeCallbackData);
+
+    AImgSetTraceHooks(NULL, NULL, NULL);
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+    const char* expectedStages[] = { "aimg.open", "aimg.open.detect", "aimg.open.header", "aimg.decode", "aimg.decode.block", "aimg.convert", "aimg.encode" };
+    for (const char* stage : expectedStages)
+        ok = ok && TraceRecorder::seen.count(stage) == 1;
+
+    return ok && TraceRecorder::balanced && TraceRecorder::open.empty();
+}
+
+namespace BatchAllocator
+{
+    // allocatorData is the std::vector<uint8_t> to decode into
+    void* CALLCONV allocate(void* allocatorData, int32_t /*width*/, int32_t /*height*/, int32_t /*format*/, int64_t size)
+    {
+        std::vector<uint8_t>* buffer = (std::vector<uint8_t>*)allocatorData;
+        buffer->resize((size_t)size);
+        return &(*buffer)[0];
+    }
+}
+
+// Probes the file through in memory callbacks, callbacks that copy, and 64 bit callbacks past 4GiB, and checks each gives
+// what AImgOpen and AImgGetInfo do and leaves the stream where it was. The copying callbacks should need very few reads.
+bool compareProbe(const std::string& path)
+{
+    auto data = readFile<uint8_t>(getImagesDir() + path);
+
+    ReadCallback readCallback = NULL;
+    WriteCallback writeCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+
+    AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &data[0], (int32_t)data.size());
+
+    AImgProbeInfo expected;
+    AImgHandle img = NULL;
+    bool ok = AImgOpen(readCallback, tellCallback, seekCallback, callbackData, &img, &expected.fileFormat) == AIMG_SUCCESS;
+    ok = ok && AImgGetInfo(img, &expected.width, &expected.height, &expected.numChannels, &expected.bytesPerChannel, &expected.floatOrInt,
+        &expected.decodedImgFormat, NULL) == AIMG_SUCCESS;
+    AImgClose(img);
+
+    auto matches = [&expected](const AImgProbeInfo& info)
+    {
+        return info.fileFormat == expected.fileFormat && info.width == expected.width && info.height == expected.height &&
+            info.numChannels == expected.numChannels && info.bytesPerChannel == expected.bytesPerChannel &&
+            info.floatOrInt == expected.floatOrInt && info.decodedImgFormat == expected.decodedImgFormat;
+    };
+
+    AImgProbeInfo info;
+    seekCallback(callbackData, 0);
+    ok = ok && AImgProbe(readCallback, tellCallback, seekCallback, callbackData, &info) == AIMG_SUCCESS && matches(info);
+    ok = ok && tellCallback(callbackData) == 0;
+
+    CopyingCallbacks::innerRead = readCallback;
+    CopyingCallbacks::innerTell = tellCallback;
+    CopyingCallbacks::innerSeek = seekCallback;
+    CopyingCallbacks::reads = 0;
+
+    info = AImgProbeInfo();
+    ok = ok && AImgProbe(&CopyingCallbacks::read, &CopyingCallbacks::tell, &CopyingCallbacks::seek, callbackData, &info) == AIMG_SUCCESS && matches(info);
+    ok = ok && tellCallback(callbackData) == 0 && CopyingCallbacks::reads <= 3;
+
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+    OffsetCallbacks::Data offsetData;
+    offsetData.buffer = &data;
+    offsetData.pos = OffsetCallbacks::offset;
+
+    info = AImgProbeInfo();
+    ok = ok && AImgProbe64(&OffsetCallbacks::read, &OffsetCallbacks::tell, &OffsetCallbacks::seek, &offsetData, &info) == AIMG_SUCCESS && matches(info);
+    ok = ok && offsetData.pos == OffsetCallbacks::offset;
+
+    return ok;
+}
+
+// Decodes all the files with one AImgDecodeBatch call and checks each one matches decoding it on its own. Files that
+// fail on their own have to fail in the batch too, without affecting the rest.
+bool compareDecodeBatch(std::vector<std::vector<uint8_t> >& files, int32_t forceImageFormat)
+{
+    std::vector<AImgDecodeJob> jobs(files.size());
+    std::vector<std::vector<uint8_t> > batchResults(files.size());
+    std::vector<WriteCallback64> writeCallbacks(files.size());
+
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        AIGetSimpleMemoryBufferCallbacks64(&jobs[i].readCallback, &writeCallbacks[i], &jobs[i].tellCallback, &jobs[i].seekCallback, &jobs[i].callbackData, &files[i][0], (int64_t)files[i].size());
+        jobs[i].allocateCallback = &BatchAllocator::allocate;
+        jobs[i].allocatorData = &batchResults[i];
+        jobs[i].forceImageFormat = forceImageFormat;
+    }
+
+    int32_t batchErr = AImgDecodeBatch(&jobs[0], (int32_t)jobs.size(), AImgOpenFlags::AIMG_OPEN_FLAGS_NONE);
+    bool ok = true;
+    bool anyFailed = false;
+
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        jobs[i].seekCallback(jobs[i].callbackData, 0);
+
+        AImgHandle img = NULL;
+        int32_t err = AImgOpen64(jobs[i].readCallback, jobs[i].tellCallback, jobs[i].seekCallback, jobs[i].callbackData, &img, NULL);
+
+        int32_t width = 0, height = 0, numChannels = 0, bytesPerChannel = 0, floatOrInt = 0, format = 0;
+        if (err == AIMG_SUCCESS)
+            err = AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &format, NULL);
+
+        std::vector<uint8_t> expected;
+        if (err == AIMG_SUCCESS)
+        {
+            if (forceImageFormat != AImgFormat::INVALID_FORMAT)
+                format = forceImageFormat;
+
+            AIGetFormatDetails(format, &numChannels, &bytesPerChannel, &floatOrInt);
+            expected.resize((size_t)width * height * numChannels * bytesPerChannel);
+            err = AImgDecodeImage(img, &expected[0], forceImageFormat);
+        }
+
+        AImgClose(img);
+        AIDestroySimpleMemoryBufferCallbacks64(jobs[i].readCallback, writeCallbacks[i], jobs[i].tellCallback, jobs[i].seekCallback, jobs[i].callbackData);
+
+        if (err != AIMG_SUCCESS)
+        {
+            anyFailed = true;
+            ok = ok && jobs[i].error != AIMG_SUCCESS;
+        }
+        else
+        {
+            ok = ok && jobs[i].error == AIMG_SUCCESS && jobs[i].width == width && jobs[i].height == height && jobs[i].format == format &&
+                jobs[i].destBuffer == &batchResults[i][0] && batchResults[i] == expected;
+        }
+    }
+
+    return ok && (batchErr != AIMG_SUCCESS) == anyFailed;
+}
+
 void writeToFile(const std::string& path, int32_t width, int32_t height, void* data, int32_t inputFormat, int32_t outputFormat, int32_t fileFormat,
     const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen)
 {
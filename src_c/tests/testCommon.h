@@ -41,9 +41,37 @@ std::vector<T> readFile(const std::string& path)
     return retval;
 }
 
+// Wrappers around the simple memory buffer callbacks, so loaders can't tell the data is already in memory and have to read it through the callbacks.
+// Set the inner callbacks with AIGetSimpleMemoryBufferCallbacks.
+namespace CopyingCallbacks
+{
+    extern ReadCallback innerRead;
+    extern TellCallback innerTell;
+    extern SeekCallback innerSeek;
+
+    extern int32_t reads;
+
+    int32_t CALLCONV read(void* callbackData, uint8_t* dest, int32_t count);
+    int32_t CALLCONV tell(void* callbackData);
+    void CALLCONV seek(void* callbackData, int32_t pos);
+}
+
 bool detectImage(const std::string& path, int32_t format);
 bool validateImageHeaders(const std::string & path, int32_t expectedWidth, int32_t expectedHeight, int32_t expectedNumChannels, int32_t expectedBytesPerChannel, int32_t expectedFloatOrInt, int32_t expectedFormat);
 bool compareForceImageFormat(const std::string& path);
+bool compareDecodeRows(const std::string& path, int32_t forceImageFormat, bool bottomUp = false);
+bool compareDecodeRegion(const std::string& path, int32_t x, int32_t y, int32_t width, int32_t height, int32_t forceImageFormat);
+bool compareMappedFile(const std::string& path);
+bool compareLargeStreamOffset(const std::string& path);
+bool compareBufferedRead(const std::string& path, int32_t readBufferSize);
+bool compareConcurrentDecode(const std::string& path, int32_t numThreads);
+bool compareDecodeAsync(const std::string& path, int32_t numImages, bool resizePool = false);
+bool compareCustomAllocator(const std::string& path);
+bool compareScratch(const std::string& path, int32_t forceImageFormat);
+bool compareStats(const std::string& path, int32_t fileFormat);
+bool compareTraceHooks(const std::string& path, int32_t fileFormat);
+bool compareProbe(const std::string& path);
+bool compareDecodeBatch(std::vector<std::vector<uint8_t> >& files, int32_t forceImageFormat);
 
 void writeToFile(const std::string& path, int32_t width, int32_t height, void* data, int32_t inputFormat, int32_t outputFormat, int32_t fileFormat,
     const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen);
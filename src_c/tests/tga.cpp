@@ -7,6 +7,8 @@
 #include <string>
 #include <setjmp.h>
 #include <stdint.h>
+#include <cstring>
+#include <algorithm>
 #include "testCommon.h"
 
 #define STBI_ONLY_TGA
@@ -117,6 +119,51 @@ TEST(TGA, TestDetectBadTGA)
     ASSERT_FALSE(detectImage("/jpeg/test.jpeg", TGA_IMAGE_FORMAT));
 }
 
+namespace CountingCallbacks
+{
+    int32_t reads = 0;
+    int32_t seeks = 0;
+    std::vector<uint8_t> buffer;
+    int32_t pos = 0;
+
+    int32_t CALLCONV read(void*, uint8_t* dest, int32_t count)
+    {
+        reads++;
+
+        int32_t toRead = std::min(count, (int32_t)buffer.size() - pos);
+        memcpy(dest, &buffer[pos], toRead);
+        pos += toRead;
+
+        return toRead;
+    }
+
+    int32_t CALLCONV tell(void*) { return pos; }
+    void CALLCONV seek(void*, int32_t newPos) { seeks++; pos = newPos; }
+}
+
+// TGA is the fallback guess, so failing to detect anything means every loader has looked at the header
+TEST(TGA, TestDetectReadsHeaderOnce)
+{
+    size_t sizes[] = { 2, 1000 };
+    for (size_t size : sizes)
+    {
+        CountingCallbacks::buffer = std::vector<uint8_t>(size, 0);
+        CountingCallbacks::reads = 0;
+        CountingCallbacks::seeks = 0;
+        CountingCallbacks::pos = 0;
+
+        AImgHandle img = NULL;
+        int32_t fileFormat = 0;
+        int32_t err = AImgOpen(&CountingCallbacks::read, &CountingCallbacks::tell, &CountingCallbacks::seek, NULL, &img, &fileFormat);
+
+        ASSERT_EQ(err, AImgErrorCode::AIMG_UNSUPPORTED_FILETYPE);
+        ASSERT_EQ(fileFormat, UNKNOWN_IMAGE_FORMAT);
+        ASSERT_EQ(CountingCallbacks::reads, 1);
+        ASSERT_EQ(CountingCallbacks::seeks, 1);
+        ASSERT_EQ(CountingCallbacks::pos, 0);
+    }
+}
+
 TEST(TGA, TestReadGoodTGAAttrs)
 {
     ASSERT_TRUE(validateImageHeaders("/tga/test.tga", 640, 400, 3, 1, AImgFloatOrIntType::FITYPE_INT, AImgFormat::RGB8U));
@@ -137,6 +184,43 @@ TEST(TGA, TestCompareForceImageFormat2)
     ASSERT_TRUE(compareForceImageFormat("/tga/indexed.tga"));
 }
 
+TEST(TGA, TestDecodeRows)
+{
+    ASSERT_TRUE(compareDecodeRows("/tga/test.tga", AImgFormat::RGBA16U));
+}
+
+TEST(TGA, TestDecodeRegion)
+{
+    ASSERT_TRUE(compareDecodeRegion("/tga/test.tga", 3, 4, 5, 6, AImgFormat::INVALID_FORMAT));
+}
+
+TEST(TGA, TestMappedFile)
+{
+    ASSERT_TRUE(compareMappedFile("/tga/test.tga"));
+}
+
+TEST(TGA, TestBufferedRead)
+{
+    ASSERT_TRUE(compareBufferedRead("/tga/test.tga", 256 * 1024));
+}
+
+TEST(TGA, TestCustomAllocator)
+{
+    ASSERT_TRUE(compareCustomAllocator("/tga/test.tga"));
+}
+
+TEST(TGA, TestProbe)
+{
+    ASSERT_TRUE(compareProbe("/tga/test.tga"));
+    ASSERT_TRUE(compareProbe("/tga/4channel.tga"));
+    ASSERT_TRUE(compareProbe("/tga/indexed.tga"));
+}
+
+TEST(TGA, TestConcurrentDecode)
+{
+    ASSERT_TRUE(compareConcurrentDecode("/tga/test.tga", 8));
+}
+
 TEST(TGA, TestForceImageFormatRemoveAlpha)
 {
     auto data = readFile<uint8_t>(getImagesDir() + "/tga/4channel.tga");
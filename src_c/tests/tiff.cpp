@@ -413,6 +413,115 @@ TEST(TIFF, TestRead32BitFloatSeparate)
     ASSERT_TRUE(compareTiffToPng("32_bit_float_separate_chans.tif", true));
 }
 
+TEST(TIFF, TestDecodeRows)
+{
+    ASSERT_TRUE(compareDecodeRows("/tiff/8_bit_int.tif", AImgFormat::INVALID_FORMAT));
+}
+
+TEST(TIFF, TestDecodeRowsSeparate)
+{
+    ASSERT_TRUE(compareDecodeRows("/tiff/24_bit_float_separate_chans.tif", AImgFormat::RGBA16U));
+}
+
+TEST(TIFF, TestDecodeRowsBottomUp)
+{
+    ASSERT_TRUE(compareDecodeRows("/tiff/16_bit_int.tif", AImgFormat::RGB32F, true));
+}
+
+TEST(TIFF, TestDecodeRegion)
+{
+    ASSERT_TRUE(compareDecodeRegion("/tiff/32_bit_float_separate_chans.tif", 5, 3, 50, 21, AImgFormat::INVALID_FORMAT));
+}
+
+TEST(TIFF, TestDecodeRegionForceImageFormat)
+{
+    ASSERT_TRUE(compareDecodeRegion("/tiff/16_bit_float.tif", 0, 11, 64, 1, AImgFormat::RGBA8U));
+}
+
+TEST(TIFF, TestMappedFile)
+{
+    ASSERT_TRUE(compareMappedFile("/tiff/8_bit_int.tif"));
+    ASSERT_TRUE(compareMappedFile("/tiff/32_bit_float_separate_chans.tif"));
+}
+
+TEST(TIFF, TestLargeStreamOffset)
+{
+    ASSERT_TRUE(compareLargeStreamOffset("/tiff/16_bit_int_separate_chans.tif"));
+}
+
+TEST(TIFF, TestBufferedRead)
+{
+    ASSERT_TRUE(compareBufferedRead("/tiff/8_bit_int_separate_chans.tif", 256 * 1024));
+    ASSERT_TRUE(compareBufferedRead("/tiff/8_bit_int_separate_chans.tif", 100));
+}
+
+TEST(TIFF, TestConcurrentDecode)
+{
+    ASSERT_TRUE(compareConcurrentDecode("/tiff/16_bit_float.tif", 8));
+}
+
+TEST(TIFF, TestCustomAllocator)
+{
+    ASSERT_TRUE(compareCustomAllocator("/tiff/16_bit_int_separate_chans.tif"));
+}
+
+TEST(TIFF, TestStats)
+{
+    ASSERT_TRUE(compareStats("/tiff/16_bit_int_separate_chans.tif", AImgFileFormat::TIFF_IMAGE_FORMAT));
+}
+
+TEST(TIFF, TestTraceHooks)
+{
+    ASSERT_TRUE(compareTraceHooks("/tiff/16_bit_int_separate_chans.tif", AImgFileFormat::TIFF_IMAGE_FORMAT));
+}
+
+TEST(TIFF, TestProbe)
+{
+    ASSERT_TRUE(compareProbe("/tiff/8_bit_int.tif"));
+    ASSERT_TRUE(compareProbe("/tiff/16_bit_int_separate_chans.tif"));
+    ASSERT_TRUE(compareProbe("/tiff/16_bit_float.tif"));
+    ASSERT_TRUE(compareProbe("/tiff/24_bit_float.tif"));
+    ASSERT_TRUE(compareProbe("/tiff/32_bit_float_separate_chans.tif"));
+    ASSERT_TRUE(compareProbe("/tiff/ICC.tif"));
+}
+
+TEST(TIFF, TestDecodeImageAsync)
+{
+    ASSERT_TRUE(compareDecodeAsync("/tiff/16_bit_float.tif", 8));
+}
+
+TEST(TIFF, TestDecodeBatchSplitsLargeImages)
+{
+    // big enough that the batch splits it into bands of strips, each decoded on its own handle
+    int32_t width = 1024;
+    int32_t height = 1024;
+    std::vector<float> pixels((size_t)width * height * 4);
+    for (size_t i = 0; i < pixels.size(); i++)
+        pixels[i] = (float)(i % 1021) / 1021.0f;
+
+    std::vector<uint8_t> bigFile;
+    ReadCallback readCallback = NULL;
+    WriteCallback writeCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+    AIGetResizableMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &bigFile);
+
+    AImgHandle wImg = AImgGetAImg(AImgFileFormat::TIFF_IMAGE_FORMAT);
+    ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgWriteImage(wImg, &pixels[0], width, height, AImgFormat::RGBA32F, AImgFormat::RGBA32F, NULL, NULL, 0,
+        writeCallback, tellCallback, seekCallback, callbackData, NULL));
+    AImgClose(wImg);
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+    std::vector<std::vector<uint8_t> > files;
+    files.push_back(readFile<uint8_t>(getImagesDir() + "/tiff/8_bit_int.tif"));
+    files.push_back(bigFile);
+    files.push_back(readFile<uint8_t>(getImagesDir() + "/tiff/16_bit_float_separate_chans.tif"));
+
+    ASSERT_TRUE(compareDecodeBatch(files, AImgFormat::INVALID_FORMAT));
+    ASSERT_TRUE(compareDecodeBatch(files, AImgFormat::RGBA16F));
+}
+
 // disabled for now, as hunter version of libtiff has jpg support disabled
 //TEST(TIFF, TestReadJpegCompressed)
 //{
@@ -2,14 +2,33 @@
 #include "AIL.h"
 #include "tga.h"
 #include "AIL_internal.h"
+#include "allocator.h"
+#include "probe.h"
+#include "scratch.h"
 #include <vector>
 #include <string.h>
 #include <cstring>
+#include <limits>
 #include <setjmp.h>
 #define STBI_ONLY_TGA
-#define STBI_ONLY_HDR
+// stb keeps the last failure reason in a global, which would be written from every thread that fails a decode
+#define STBI_NO_FAILURE_STRINGS
+#define STBI_MALLOC(size) AImg::allocate(size)
+#define STBI_REALLOC(ptr, size) AImg::reallocate(ptr, size)
+#define STBI_FREE(ptr) AImg::deallocate(ptr)
 #define STB_IMAGE_IMPLEMENTATION
+// without failure strings stb never calls its stbi__err helper
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
 #include "extern/stb_image.h"
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+#define STBIW_MALLOC(size) AImg::allocate(size)
+#define STBIW_REALLOC(ptr, size) AImg::reallocate(ptr, size)
+#define STBIW_FREE(ptr) AImg::deallocate(ptr)
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "extern/stb_image_write.h"
 
@@ -66,21 +85,16 @@ namespace AImg
         return AImgErrorCode::AIMG_SUCCESS;
     }
 
-    bool TGAImageLoader::canLoadImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData)
+    bool TGAImageLoader::canLoadImage(const uint8_t *header, int32_t headerSize)
     {
-        uint8_t header[18];
-
-        int startingPosition = tellCallback(callbackData);
-
-        readCallback(callbackData, header, 18);
-
-        seekCallback(callbackData, startingPosition);
+        if (headerSize < 18)
+            return false;
 
         bool hasCorrectColourMapType = (header[1] == 0 || header[1] == 1);
         bool hasCorrectImageType = (header[2] == 0 || header[2] == 1 || header[2] == 2 || header[2] == 3 || header[2] == 9 || header[2] == 10 || header[2] == 11);
-        uint16_t paletteLength = *(uint16_t *)(header + 5);
-        uint16_t width = *(uint16_t *)(header + 12);
-        uint16_t height = *(uint16_t *)(header + 14);
+        uint16_t paletteLength = *(const uint16_t *)(header + 5);
+        uint16_t width = *(const uint16_t *)(header + 12);
+        uint16_t height = *(const uint16_t *)(header + 14);
 
         bool correctDimensions = (width > 0 && height > 0);
         bool realBitDepth = (header[16] == 8 || header[16] == 16 || header[16] == 24 || header[16] == 32);
@@ -104,6 +118,67 @@ namespace AImg
         return TGA_IMAGE_FORMAT;
     }
 
+    int32_t TGAImageLoader::probeImage(ProbeReader& reader, AImgProbeInfo* info)
+    {
+        const uint8_t* header = reader.get(0, 18);
+        if (header == NULL)
+            return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+
+        // the same checks and channel counts as stbi__tga_info, which TGAFile::openImage uses
+        int32_t colourMapType = header[1];
+        int32_t imageType = header[2];
+        int32_t colourMapBitsPerPixel = 0;
+        int32_t width = header[12] | (header[13] << 8);
+        int32_t height = header[14] | (header[15] << 8);
+        int32_t bitsPerPixel = header[16];
+
+        if (colourMapType == 1)
+        {
+            colourMapBitsPerPixel = header[7];
+
+            if ((imageType != 1 && imageType != 9) || (bitsPerPixel != 8 && bitsPerPixel != 16))
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+        }
+        else if (colourMapType != 0 || (imageType != 2 && imageType != 3 && imageType != 10 && imageType != 11))
+        {
+            return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+        }
+
+        if (width < 1 || height < 1)
+            return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+
+        // palette entries are always colour, and only 16 bit grey has alpha
+        bool isGrey = colourMapType == 0 && (imageType == 3 || imageType == 11);
+        switch (colourMapType == 1 ? colourMapBitsPerPixel : bitsPerPixel)
+        {
+        case 8:
+            info->numChannels = 1;
+            break;
+        case 15:
+            info->numChannels = 3;
+            break;
+        case 16:
+            info->numChannels = isGrey ? 2 : 3;
+            break;
+        case 24:
+            info->numChannels = 3;
+            break;
+        case 32:
+            info->numChannels = 4;
+            break;
+        default:
+            return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+        }
+
+        info->width = width;
+        info->height = height;
+        info->bytesPerChannel = 1;
+        info->floatOrInt = AImgFloatOrIntType::FITYPE_INT;
+        info->decodedImgFormat = AImgFormat::_8BITS | (AImgFormat::R << (info->numChannels - 1));
+
+        return AImgErrorCode::AIMG_SUCCESS;
+    }
+
     bool isFormatSupportedByTga(int32_t format)
     {
         return format & AImgFormat::_8BITS;
@@ -115,6 +190,10 @@ namespace AImg
         CallbackData data;
         int32_t numChannels, width, height;
 
+        // set when the input is already in memory, so stb can read it in place
+        const uint8_t *inMemoryData = nullptr;
+        int64_t inMemorySize = 0;
+
         int32_t getDecodeFormat()
         {
             switch (numChannels)
@@ -169,11 +248,15 @@ namespace AImg
             callbacks.read = STBICallbacks::readCallback;
             callbacks.skip = STBICallbacks::seekCallback;
 
-            uint8_t* loadedData = stbi_load_from_callbacks(&callbacks, &data, &width, &height, &numChannels, numChannels);
+            uint8_t* loadedData = nullptr;
+            if (inMemoryData != nullptr)
+                loadedData = stbi_load_from_memory(inMemoryData, (int)inMemorySize, &width, &height, &numChannels, numChannels);
+            else
+                loadedData = stbi_load_from_callbacks(&callbacks, &data, &width, &height, &numChannels, numChannels);
 
             if (!loadedData)
             {
-                mErrorDetails = "[AImg::TGAImageLoader::TGAFile::decodeImage] stbi_load_from_callbacks failed!";
+                mErrorDetails = "[AImg::TGAImageLoader::TGAFile::decodeImage] stbi_load failed!";
                 return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
             }
 
@@ -181,29 +264,25 @@ namespace AImg
             int32_t numChannels, bytesPerChannel, floatOrInt;
             AIGetFormatDetails(decodeFormat, &numChannels, &bytesPerChannel, &floatOrInt);
 
-            void* destBuffer = realDestBuffer;
-
-            std::vector<uint8_t> convertTmpBuffer(0);
+            // stb hands us the whole image anyway, so convert out of its buffer rather than copying it somewhere first
             if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != decodeFormat)
             {
-                convertTmpBuffer.resize(width * height * bytesPerChannel * numChannels);
-                destBuffer = &convertTmpBuffer[0];
-            }
+                int32_t err = AImgConvertFormat(loadedData, realDestBuffer, width, height, decodeFormat, forceImageFormat);
+                stbi_image_free(loadedData);
 
-            memcpy(destBuffer, loadedData, width * height * bytesPerChannel * numChannels);
-            stbi_image_free(loadedData);
-
-            if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != decodeFormat)
-            {
-                int32_t err = AImgConvertFormat(destBuffer, realDestBuffer, width, height, decodeFormat, forceImageFormat);
                 if (err != AImgErrorCode::AIMG_SUCCESS)
                     return err;
             }
+            else
+            {
+                memcpy(realDestBuffer, loadedData, width * height * bytesPerChannel * numChannels);
+                stbi_image_free(loadedData);
+            }
 
             return AImgErrorCode::AIMG_SUCCESS;
         }
 
-        virtual int32_t openImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData)
+        virtual int32_t openImage(ReadCallback64 readCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void *callbackData)
         {
             data.readCallback = readCallback;
             data.tellCallback = tellCallback;
@@ -213,15 +292,27 @@ namespace AImg
             callbacks.read = STBICallbacks::readCallback;
             callbacks.skip = STBICallbacks::seekCallback;
 
-            int startingPosition = tellCallback(callbackData);
-            stbi_info_from_callbacks(&callbacks, &data, &width, &height, &numChannels);
-            seekCallback(callbackData, startingPosition);
+            int64_t startingPosition = tellCallback(callbackData);
+
+            if (getInMemoryData(readCallback, callbackData, &inMemoryData, &inMemorySize) && startingPosition <= inMemorySize &&
+                inMemorySize - startingPosition <= std::numeric_limits<int>::max())
+            {
+                inMemoryData += startingPosition;
+                inMemorySize -= startingPosition;
+                stbi_info_from_memory(inMemoryData, (int)inMemorySize, &width, &height, &numChannels);
+            }
+            else
+            {
+                inMemoryData = nullptr;
+                stbi_info_from_callbacks(&callbacks, &data, &width, &height, &numChannels);
+                seekCallback(callbackData, startingPosition);
+            }
 
             return AImgErrorCode::AIMG_SUCCESS;
         }
 
         virtual int32_t writeImage(void *data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat, const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
-            WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData, void* encodingOptions)
+            WriteCallback64 writeCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void *callbackData, void* encodingOptions)
         {
             AIL_UNUSED_PARAM(profileName);
             AIL_UNUSED_PARAM(colourProfile);
@@ -230,20 +321,20 @@ namespace AImg
 
             int32_t writeFormat = getWhatFormatWillBeWrittenForDataTGA(inputFormat, outputFormat);
 
-            std::vector<uint8_t> convertBuffer(0);
+            ScratchBuffer convertBuffer(mScratch, Scratch::CONVERT);
 
             int32_t numChannels, bytesPerChannel, floatOrInt;
             AIGetFormatDetails(writeFormat, &numChannels, &bytesPerChannel, &floatOrInt);
 
             if (writeFormat != inputFormat)
             {
-                convertBuffer.resize(width * height * numChannels * bytesPerChannel);
+                convertBuffer.resize((size_t)width * height * numChannels * bytesPerChannel);
 
-                int32_t convertError = AImgConvertFormat(data, &convertBuffer[0], width, height, inputFormat, writeFormat);
+                int32_t convertError = AImgConvertFormat(data, convertBuffer.data(), width, height, inputFormat, writeFormat);
 
                 if (convertError != AImgErrorCode::AIMG_SUCCESS)
                     return convertError;
-                data = &convertBuffer[0];
+                data = convertBuffer.data();
             }
 
             CallbackData callbackFunctions;
@@ -0,0 +1,220 @@
+#include <atomic>
+#include <algorithm>
+
+#include "AIL.h"
+#include "threadpool.h"
+
+namespace AImg
+{
+    struct ParallelForJob
+    {
+        const std::function<void(size_t)>* task = nullptr;
+        size_t taskCount = 0;
+
+        std::atomic<size_t> nextTask;
+        std::atomic<size_t> tasksFinished;
+
+        std::mutex finishedMutex;
+        std::condition_variable allFinished;
+
+        ParallelForJob() : nextTask(0), tasksFinished(0) {}
+
+        // Claims and runs tasks until there are none left to claim. Returns false if there was nothing to do.
+        bool runTasks()
+        {
+            bool didWork = false;
+
+            while (true)
+            {
+                size_t i = nextTask.fetch_add(1);
+                if (i >= taskCount)
+                    return didWork;
+
+                (*task)(i);
+                didWork = true;
+
+                if (tasksFinished.fetch_add(1) + 1 == taskCount)
+                {
+                    std::lock_guard<std::mutex> lock(finishedMutex);
+                    allFinished.notify_all();
+                }
+            }
+        }
+    };
+
+    struct PoolState
+    {
+        std::mutex mutex;
+        std::condition_variable workAvailable;
+        std::deque<std::shared_ptr<ParallelForJob> > jobs;
+        std::deque<std::function<void()> > tasks;
+        bool shuttingDown = false;
+    };
+
+    void workerLoop(std::shared_ptr<PoolState> state)
+    {
+        while (true)
+        {
+            std::shared_ptr<ParallelForJob> job;
+            std::function<void()> task;
+
+            {
+                std::unique_lock<std::mutex> lock(state->mutex);
+                state->workAvailable.wait(lock, [&state]() { return state->shuttingDown || !state->jobs.empty() || !state->tasks.empty(); });
+
+                // parallelFor jobs have a thread waiting on them, so they go before submitted tasks
+                if (!state->jobs.empty())
+                {
+                    job = state->jobs.front();
+                }
+                else if (!state->tasks.empty())
+                {
+                    task = std::move(state->tasks.front());
+                    state->tasks.pop_front();
+                }
+                else
+                {
+                    return; // shutting down, and nothing left to run
+                }
+            }
+
+            if (job)
+            {
+                // Once a job has no unclaimed tasks left, whoever notices first takes it off the queue
+                if (!job->runTasks())
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (!state->jobs.empty() && state->jobs.front() == job)
+                        state->jobs.pop_front();
+                }
+            }
+            else
+            {
+                task();
+            }
+        }
+    }
+
+    ThreadPool::ThreadPool(int32_t threadCount) : mState(std::make_shared<PoolState>())
+    {
+        mThreadCount = std::max(threadCount, 1);
+
+        for (int32_t i = 0; i < mThreadCount - 1; i++)
+            mWorkers.push_back(std::thread(&workerLoop, mState));
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mState->mutex);
+            mState->shuttingDown = true;
+        }
+
+        mState->workAvailable.notify_all();
+
+        for (size_t i = 0; i < mWorkers.size(); i++)
+        {
+            // A submitted task can drop the last reference to its own pool (eg if AImgSetThreadCount replaced it
+            // while the task was converting), and a thread can't join itself. It has its own hold on the state.
+            if (mWorkers[i].get_id() == std::this_thread::get_id())
+                mWorkers[i].detach();
+            else
+                mWorkers[i].join();
+        }
+    }
+
+    void ThreadPool::submit(const std::function<void()>& task)
+    {
+        if (mWorkers.empty())
+        {
+            task();
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mState->mutex);
+            mState->tasks.push_back(task);
+        }
+
+        mState->workAvailable.notify_one();
+    }
+
+    void ThreadPool::parallelFor(size_t taskCount, const std::function<void(size_t)>& task)
+    {
+        if (taskCount == 0)
+            return;
+
+        if (mWorkers.empty() || taskCount == 1)
+        {
+            for (size_t i = 0; i < taskCount; i++)
+                task(i);
+
+            return;
+        }
+
+        std::shared_ptr<ParallelForJob> job = std::make_shared<ParallelForJob>();
+        job->task = &task;
+        job->taskCount = taskCount;
+
+        {
+            std::lock_guard<std::mutex> lock(mState->mutex);
+            mState->jobs.push_back(job);
+        }
+
+        mState->workAvailable.notify_all();
+
+        job->runTasks();
+
+        {
+            std::unique_lock<std::mutex> lock(job->finishedMutex);
+            job->allFinished.wait(lock, [&job]() { return job->tasksFinished.load() == job->taskCount; });
+        }
+
+        // task is a reference to the caller's function, so make sure no worker can see the job after we return
+        std::lock_guard<std::mutex> lock(mState->mutex);
+        auto it = std::find(mState->jobs.begin(), mState->jobs.end(), job);
+        if (it != mState->jobs.end())
+            mState->jobs.erase(it);
+    }
+
+    int32_t getDefaultThreadCount()
+    {
+        int32_t hardwareThreads = (int32_t)std::thread::hardware_concurrency();
+        return hardwareThreads > 0 ? hardwareThreads : 1;
+    }
+
+    std::mutex globalPoolMutex;
+    std::shared_ptr<ThreadPool> globalPool;
+    int32_t globalThreadCount = 0; // 0 means use getDefaultThreadCount()
+
+    std::shared_ptr<ThreadPool> getThreadPool()
+    {
+        std::lock_guard<std::mutex> lock(globalPoolMutex);
+
+        // created lazily, so programs that never convert anything big never start any threads
+        if (!globalPool)
+            globalPool = std::make_shared<ThreadPool>(globalThreadCount > 0 ? globalThreadCount : getDefaultThreadCount());
+
+        return globalPool;
+    }
+}
+
+int32_t AImgSetThreadCount(int32_t threadCount)
+{
+    if (threadCount < 0)
+        return AImgErrorCode::AIMG_INVALID_ARGS;
+
+    std::shared_ptr<AImg::ThreadPool> oldPool;
+
+    {
+        std::lock_guard<std::mutex> lock(AImg::globalPoolMutex);
+
+        AImg::globalThreadCount = threadCount;
+
+        // anyone still using the old pool keeps it alive until they're done, the new one is made on next use
+        oldPool = AImg::globalPool;
+        AImg::globalPool.reset();
+    }
+
+    return AImgErrorCode::AIMG_SUCCESS;
+}
@@ -0,0 +1,53 @@
+#ifndef ARTOMATIX_THREADPOOL_H
+#define ARTOMATIX_THREADPOOL_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "AIL.h"
+
+namespace AImg
+{
+    struct ParallelForJob;
+    struct PoolState;
+
+    // Simple pool for splitting work into independent tasks. The calling thread always takes part in the work
+    // it submits, so nested calls from inside a task can't deadlock, they just run with less help.
+    // Work that nobody waits on can be queued with submit, it only runs once no parallelFor needs the threads.
+    class ThreadPool
+    {
+    public:
+        // threadCount is the total number of threads that will work on a job, including the calling one
+        explicit ThreadPool(int32_t threadCount);
+        ~ThreadPool();
+
+        int32_t getThreadCount() const { return mThreadCount; }
+
+        // Calls task(i) for every i in [0, taskCount), and returns once they have all finished
+        void parallelFor(size_t taskCount, const std::function<void(size_t)>& task);
+
+        // Queues task to run on one of the pool's threads and returns straight away. Anything still queued when the pool
+        // is destroyed is run before its threads exit. A pool with no threads besides the caller's runs task before returning.
+        void submit(const std::function<void()>& task);
+
+    private:
+        int32_t mThreadCount;
+        std::vector<std::thread> mWorkers;
+
+        // shared with the workers, so one that ends up destroying its own pool can still finish its loop
+        std::shared_ptr<PoolState> mState;
+    };
+
+    // The library-wide pool used for conversions. Holding on to the returned pointer keeps the pool alive
+    // even if AImgSetThreadCount replaces it in the meantime.
+    std::shared_ptr<ThreadPool> getThreadPool();
+
+    int32_t getDefaultThreadCount();
+}
+
+#endif // ARTOMATIX_THREADPOOL_H
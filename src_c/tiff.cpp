@@ -11,6 +11,10 @@
 #include <assert.h>
 #include "AIL.h"
 #include "AIL_internal.h"
+#include "convert.h"
+#include "probe.h"
+#include "scratch.h"
+#include "trace.h"
 #include "tiff.h"
 
 namespace AImg
@@ -34,30 +38,34 @@ namespace AImg
 
     struct tiffCallbackData
     {
-        ReadCallback mReadCallback = nullptr;
-        WriteCallback mWriteCallback = nullptr;
-        TellCallback mTellCallback = nullptr;
-        SeekCallback mSeekCallback = nullptr;
+        ReadCallback64 mReadCallback = nullptr;
+        WriteCallback64 mWriteCallback = nullptr;
+        TellCallback64 mTellCallback = nullptr;
+        SeekCallback64 mSeekCallback = nullptr;
         void *callbackData = nullptr;
 
-        int32_t startPos = 0;
-        int32_t furthestPositionWritten = 0;
+        int64_t startPos = 0;
+        int64_t furthestPositionWritten = 0;
+
+        // set when the input is already in memory, starting at startPos
+        const uint8_t *inMemoryData = nullptr;
+        int64_t inMemorySize = 0;
     };
 
     tsize_t tiffRead(thandle_t st, tdata_t buffer, tsize_t size)
     {
         tiffCallbackData *callbacks = (tiffCallbackData *)st;
 
-        return callbacks->mReadCallback(callbacks->callbackData, (uint8_t *)buffer, (int32_t)size);
+        return callbacks->mReadCallback(callbacks->callbackData, (uint8_t *)buffer, (int64_t)size);
     }
 
     tsize_t tiff_Write(thandle_t st, tdata_t buffer, tsize_t size)
     {
         tiffCallbackData *callbacks = (tiffCallbackData *)st;
 
-        int32_t start = callbacks->mTellCallback(callbacks->callbackData);
-        callbacks->mWriteCallback(callbacks->callbackData, (uint8_t *)buffer, (int32_t)size);
-        int32_t end = callbacks->mTellCallback(callbacks->callbackData);
+        int64_t start = callbacks->mTellCallback(callbacks->callbackData);
+        callbacks->mWriteCallback(callbacks->callbackData, (uint8_t *)buffer, (int64_t)size);
+        int64_t end = callbacks->mTellCallback(callbacks->callbackData);
 
         if (end > callbacks->furthestPositionWritten)
             callbacks->furthestPositionWritten = end;
@@ -82,8 +90,8 @@ namespace AImg
     {
         tiffCallbackData *callbacks = (tiffCallbackData *)st;
 
-        if (pos == 0xFFFFFFFF)
-            return 0xFFFFFFFF;
+        if (pos == (toff_t)-1)
+            return (toff_t)-1;
 
         toff_t finalPos = pos;
 
@@ -112,14 +120,25 @@ namespace AImg
         }
         }
 
-        callbacks->mSeekCallback(callbacks->callbackData, (int32_t)finalPos);
+        callbacks->mSeekCallback(callbacks->callbackData, (int64_t)finalPos);
 
-        return callbacks->mTellCallback(callbacks->callbackData);
+        // libtiff checks this against the offset it asked for, which is relative to the start of the tiff
+        return callbacks->mTellCallback(callbacks->callbackData) - callbacks->startPos;
     }
 
-    int tiff_Map(thandle_t, tdata_t *, toff_t *)
+    // libtiff reads straight out of the mapping instead of copying through tiffRead when this succeeds,
+    // so we hand it the buffer if the callbacks are backed by memory
+    int tiff_Map(thandle_t st, tdata_t *base, toff_t *size)
     {
-        return 0;
+        tiffCallbackData *callbacks = (tiffCallbackData *)st;
+
+        if (callbacks->inMemoryData == nullptr)
+            return 0;
+
+        *base = (tdata_t)callbacks->inMemoryData;
+        *size = (toff_t)callbacks->inMemorySize;
+
+        return 1;
     }
 
     void tiff_Unmap(thandle_t, tdata_t, toff_t)
@@ -177,6 +196,33 @@ namespace AImg
         return final;
     }
 
+    int32_t getTiffDecodeFormat(int32_t channels, int32_t bitsPerChannel, int32_t sampleFormat)
+    {
+        if (channels > 0 && channels <= 4)
+        {
+            // handle 24-bit float (lolwtf)
+            if (bitsPerChannel == 24 && sampleFormat == SAMPLEFORMAT_IEEEFP)
+                return AImgFormat::_32BITS | AImgFormat::FLOAT_FORMAT | (AImgFormat::R << (channels - 1));
+
+            if (sampleFormat == SAMPLEFORMAT_IEEEFP)
+            {
+                if (bitsPerChannel == 16)
+                    return AImgFormat::_16BITS | AImgFormat::FLOAT_FORMAT | (AImgFormat::R << (channels - 1));
+                else if (bitsPerChannel == 32)
+                    return AImgFormat::_32BITS | AImgFormat::FLOAT_FORMAT | (AImgFormat::R << (channels - 1));
+            }
+            else if (sampleFormat == SAMPLEFORMAT_UINT || sampleFormat == SAMPLEFORMAT_INT)
+            {
+                if (bitsPerChannel == 8)
+                    return AImgFormat::_8BITS | (AImgFormat::R << (channels - 1));
+                else if (bitsPerChannel == 16)
+                    return AImgFormat::_16BITS | (AImgFormat::R << (channels - 1));
+            }
+        }
+
+        return AImgFormat::INVALID_FORMAT;
+    }
+
     class TiffFile : public AImgBase
     {
         TIFF *tiff = nullptr;
@@ -192,6 +238,12 @@ namespace AImg
         uint8_t * compressedProfile = NULL;
         uint32_t compressedProfileLen = 0;
 
+        // The rows of the last strip decodeRows read for a band that didn't line up with whole strips, in the decode format
+        static const uint32_t NO_STRIP_ROWS = 0xFFFFFFFF;
+        Vector<uint8_t> stripRows;
+        uint32_t stripRowsFirstRow = NO_STRIP_ROWS;
+        Vector<char> stripBuffer;
+
     public:
         virtual ~TiffFile()
         {
@@ -201,29 +253,7 @@ namespace AImg
 
         int32_t getDecodeFormat()
         {
-            if (channels > 0 && channels <= 4)
-            {
-                // handle 24-bit float (lolwtf)
-                if (bitsPerChannel == 24 && sampleFormat == SAMPLEFORMAT_IEEEFP)
-                    return AImgFormat::_32BITS | AImgFormat::FLOAT_FORMAT | (AImgFormat::R << (channels - 1));
-
-                if (sampleFormat == SAMPLEFORMAT_IEEEFP)
-                {
-                    if (bitsPerChannel == 16)
-                        return AImgFormat::_16BITS | AImgFormat::FLOAT_FORMAT | (AImgFormat::R << (channels - 1));
-                    else if (bitsPerChannel == 32)
-                        return AImgFormat::_32BITS | AImgFormat::FLOAT_FORMAT | (AImgFormat::R << (channels - 1));
-                }
-                else if (sampleFormat == SAMPLEFORMAT_UINT || sampleFormat == SAMPLEFORMAT_INT)
-                {
-                    if (bitsPerChannel == 8)
-                        return AImgFormat::_8BITS | (AImgFormat::R << (channels - 1));
-                    else if (bitsPerChannel == 16)
-                        return AImgFormat::_16BITS | (AImgFormat::R << (channels - 1));
-                }
-            }
-
-            return AImgFormat::INVALID_FORMAT;
+            return getTiffDecodeFormat(channels, bitsPerChannel, sampleFormat);
         }
 
         virtual int32_t getImageInfo(int32_t *width, int32_t *height, int32_t *numChannels, int32_t *bytesPerChannel, int32_t *floatOrInt, int32_t *decodedImgFormat, uint32_t *colourProfileLen)
@@ -273,177 +303,155 @@ namespace AImg
 
         virtual int32_t decodeImage(void *realDestBuffer, int32_t forceImageFormat)
         {
-            uint8_t *destBuffer = (uint8_t *)realDestBuffer;
+            if (forceImageFormat == AImgFormat::INVALID_FORMAT)
+                forceImageFormat = getDecodeFormat();
 
-            int32_t decodeFormat = getDecodeFormat();
-
-            std::vector<uint8_t> convertTmpBuffer(0);
-            if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != decodeFormat)
-            {
-                int32_t numChannels, bytesPerChannelF, floatOrInt;
-                AIGetFormatDetails(decodeFormat, &numChannels, &bytesPerChannelF, &floatOrInt);
-
-                convertTmpBuffer.resize(width * height * bytesPerChannelF * numChannels);
-                destBuffer = &convertTmpBuffer[0];
-            }
+            int32_t numChannels, bytesPerChannel, floatOrInt;
+            AIGetFormatDetails(forceImageFormat, &numChannels, &bytesPerChannel, &floatOrInt);
 
-            uint32 stripsize = (uint32)TIFFStripSize(tiff);
-            int32_t bytesPerChannel = bitsPerChannel / 8;
+            return decodeRows(realDestBuffer, 0, height, (size_t)width * numChannels * bytesPerChannel, forceImageFormat);
+        }
 
-            std::vector<char> stripBuffer(stripsize);
+        virtual int32_t decodeRows(void *destBuffer, int32_t firstRow, int32_t numRows, size_t destStride, int32_t forceImageFormat)
+        {
+            int32_t decodeFormat = getDecodeFormat();
 
-            int32_t _;
-            int32_t decodeFormatBytesPerChannel;
+            int32_t _, decodeFormatBytesPerChannel;
             AIGetFormatDetails(decodeFormat, &_, &decodeFormatBytesPerChannel, &_);
+            size_t decodeRowSize = (size_t)width * channels * decodeFormatBytesPerChannel;
+
+            uint32_t endRow = firstRow + numRows;
 
-            if (planarConfig == PLANARCONFIG_CONTIG)
+            for (uint32_t row = firstRow; row < endRow;)
             {
-                unsigned char *bufferPtr = destBuffer;
+                uint32_t stripFirstRow = (row / rowsPerStrip) * rowsPerStrip;
+                uint32_t stripNumRows = std::min(rowsPerStrip, height - stripFirstRow);
+                uint32_t rowsFromStrip = std::min(stripFirstRow + stripNumRows, endRow) - row;
 
-                size_t row = 0;
-                for (tstrip_t strip = 0; strip < TIFFNumberOfStrips(tiff); strip++)
+                uint8_t *rowDest = (uint8_t *)destBuffer + (row - firstRow) * destStride;
+
+                // whole strips that don't need converting can be unpacked straight into destBuffer
+                if (forceImageFormat == decodeFormat && destStride == decodeRowSize && rowsFromStrip == stripNumRows)
+                {
+                    int32_t err = readStripRows(stripFirstRow, stripNumRows, rowDest);
+                    if (err != AImgErrorCode::AIMG_SUCCESS)
+                        return err;
+                }
+                else
                 {
-                    if (TIFFReadEncodedStrip(tiff, strip, &stripBuffer[0], -1) == ((tmsize_t)-1)) // this function returns -1 on failure. As an unsigned int. yaaaaaaaaaaay
+                    if (stripRowsFirstRow != stripFirstRow)
                     {
-                        mErrorDetails = "[AImg::TIFFImageLoader::TiffFile::openImage] Tiff read failure, TIFFReadEncodedStrip failed";
-                        return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
-                    }
-
-                    char *stripPtr = &stripBuffer[0];
+                        stripRowsFirstRow = NO_STRIP_ROWS;
+                        stripRows.resize(stripNumRows * decodeRowSize);
 
-                    for (size_t rowStrip = 0; rowStrip < rowsPerStrip; rowStrip++)
-                    {
-                        if (row >= height)
-                            break;
+                        int32_t err = readStripRows(stripFirstRow, stripNumRows, &stripRows[0]);
+                        if (err != AImgErrorCode::AIMG_SUCCESS)
+                            return err;
 
-                        for (size_t x = 0; x < width; x++)
-                        {
-                            for (size_t channelIndex = 0; channelIndex < channels; channelIndex++)
-                            {
-                                if (bytesPerChannel == 4)
-                                {
-                                    *((float *)bufferPtr) = *(float *)stripPtr;
-                                    stripPtr += 4;
-                                    bufferPtr += 4;
-                                }
-                                else if (bytesPerChannel == 3)
-                                {
-                                    // this will always be 24-bit float, as we return an error in openImage if BITSPERSAMPLE == 3 and SAMPLEFORMAT is not IEEEFP
-                                    *((float *)bufferPtr) = convertFloat24((unsigned char *)stripPtr);
-                                    stripPtr += 3;
-                                    bufferPtr += 4;
-                                }
-                                else if (bytesPerChannel == 2)
-                                {
-                                    // doesn't matter if we have 16-bit int or float, we can just copy the data over all the same
-                                    *((uint16_t *)bufferPtr) = *((uint16_t *)stripPtr);
-
-                                    stripPtr += 2;
-                                    bufferPtr += 2;
-                                }
-                                else if (bytesPerChannel == 1)
-                                {
-                                    *bufferPtr = *stripPtr;
-                                    stripPtr += 1;
-                                    bufferPtr += 1;
-                                }
-                            }
-
-                            // convert from YCbCr to RGB (jpeg tiffs always have bytesPerChannel == 1 and PLANARCONFIG_CONTIG, and always have three channels)
-                            if (compression == COMPRESSION_JPEG)
-                            {
-                                float Y = bufferPtr[-3];
-                                float Cb = bufferPtr[-2];
-                                float Cr = bufferPtr[-1];
-
-                                bufferPtr[-3] = (char)std::max(std::min(Y + 1.40200 * (Cr - 127.0), 255.0), 0.0);
-                                bufferPtr[-2] = (char)std::max(std::min(Y - 0.34414 * (Cb - 127.0) - 0.71414 * (Cr - 127.0), 255.0), 0.0);
-                                bufferPtr[-1] = (char)std::max(std::min(Y + 1.77200 * (Cb - 127.0), 255.0), 0.0);
-                            }
-                        }
-                        row++;
+                        stripRowsFirstRow = stripFirstRow;
                     }
+
+                    int32_t err = AImg::convertRows(&stripRows[(row - stripFirstRow) * decodeRowSize], decodeRowSize, rowDest, destStride, width, rowsFromStrip, decodeFormat, forceImageFormat);
+                    if (err != AImgErrorCode::AIMG_SUCCESS)
+                        return err;
                 }
+
+                row += rowsFromStrip;
             }
 
-            // This is just a copy of the above block, fixed up to work for channels being stored sequentially not interleaved.
-            // for clarity, interleaved for a 2x1 image would be: R1,G1,B1,R2,G2,B2, where as SEPARATE would be R1,R2,G1,G2,B1,B2
+            return AImgErrorCode::AIMG_SUCCESS;
+        }
+
+        virtual int32_t getRowBlockSize()
+        {
+            return (int32_t)std::min(rowsPerStrip, height);
+        }
+
+        // Reads the strip (or for separate planes, the strip from each plane) starting at stripFirstRow, and unpacks
+        // its numRows rows into destBuffer as tightly packed, interleaved pixels in the decode format.
+        int32_t readStripRows(uint32_t stripFirstRow, uint32_t numRows, uint8_t *destBuffer)
+        {
+            AImg::TraceScope trace(AImg::TRACE_DECODE_BLOCK);
+            stripBuffer.resize((size_t)TIFFStripSize(tiff));
+            int32_t bytesPerChannel = bitsPerChannel / 8;
+
+            int32_t _, decodeFormatBytesPerChannel;
+            AIGetFormatDetails(getDecodeFormat(), &_, &decodeFormatBytesPerChannel, &_);
+
+            // For clarity, interleaved for a 2x1 image would be: R1,G1,B1,R2,G2,B2, where as SEPARATE would be R1,R2,G1,G2,B1,B2
             // We don't actually support decoding separated channel buffers like that, so we manually interleave the channels to fix it up.
-            else if (planarConfig == PLANARCONFIG_SEPARATE)
+            uint16_t planes = planarConfig == PLANARCONFIG_SEPARATE ? channels : 1;
+            uint16_t channelsPerPlane = planarConfig == PLANARCONFIG_SEPARATE ? 1 : channels;
+
+            // space left after each pixel for the channels that come from other planes
+            size_t bufferSkip = (channels - channelsPerPlane) * decodeFormatBytesPerChannel;
+
+            for (uint16_t plane = 0; plane < planes; plane++)
             {
-                int32_t channelIndex = -1;
-                unsigned char *bufferPtr = NULL;
+                tstrip_t strip = TIFFComputeStrip(tiff, stripFirstRow, plane);
+
+                if (TIFFReadEncodedStrip(tiff, strip, &stripBuffer[0], -1) == ((tmsize_t)-1)) // this function returns -1 on failure. As an unsigned int. yaaaaaaaaaaay
+                {
+                    mErrorDetails = "[AImg::TIFFImageLoader::TiffFile::readStripRows] Tiff read failure, TIFFReadEncodedStrip failed";
+                    return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+                }
 
-                while (true)
+                char *stripPtr = &stripBuffer[0];
+                unsigned char *bufferPtr = destBuffer + plane * decodeFormatBytesPerChannel;
+
+                for (size_t i = 0; i < (size_t)numRows * width; i++)
                 {
-                    size_t row = 0;
-                    for (tstrip_t strip = 0; strip < TIFFNumberOfStrips(tiff); strip++)
+                    for (size_t channelIndex = 0; channelIndex < channelsPerPlane; channelIndex++)
                     {
-                        if (TIFFReadEncodedStrip(tiff, strip, &stripBuffer[0], -1) == ((tmsize_t)-1))
+                        if (bytesPerChannel == 4)
                         {
-                            mErrorDetails = "[AImg::TIFFImageLoader::TiffFile::openImage] Tiff read failure, TIFFReadEncodedStrip failed";
-                            return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+                            *((float *)bufferPtr) = *(float *)stripPtr;
+                            stripPtr += 4;
+                            bufferPtr += 4;
                         }
+                        else if (bytesPerChannel == 3)
+                        {
+                            // this will always be 24-bit float, as we return an error in openImage if BITSPERSAMPLE == 3 and SAMPLEFORMAT is not IEEEFP
+                            *((float *)bufferPtr) = convertFloat24((unsigned char *)stripPtr);
+                            stripPtr += 3;
+                            bufferPtr += 4;
+                        }
+                        else if (bytesPerChannel == 2)
+                        {
+                            // doesn't matter if we have 16-bit int or float, we can just copy the data over all the same
+                            *((uint16_t *)bufferPtr) = *((uint16_t *)stripPtr);
 
-                        char *stripPtr = (char *)&stripBuffer[0];
-
-                        for (size_t rowStrip = 0; rowStrip < rowsPerStrip; rowStrip++)
+                            stripPtr += 2;
+                            bufferPtr += 2;
+                        }
+                        else if (bytesPerChannel == 1)
                         {
-                            if (row % height == 0)
-                            {
-                                channelIndex++;
-                                if (channelIndex >= channels)
-                                    goto done;
-
-                                bufferPtr = destBuffer + channelIndex * decodeFormatBytesPerChannel;
-                            }
-
-                            for (size_t x = 0; x < width; x++)
-                            {
-                                if (bytesPerChannel == 4)
-                                {
-                                    *((float *)bufferPtr) = *(float *)stripPtr;
-                                    stripPtr += 4;
-                                    bufferPtr += 4 * channels;
-                                }
-                                else if (bytesPerChannel == 3)
-                                {
-                                    *((float *)bufferPtr) = convertFloat24((unsigned char *)stripPtr);
-                                    stripPtr += 3;
-                                    bufferPtr += 4 * channels;
-                                }
-                                else if (bytesPerChannel == 2)
-                                {
-                                    *((uint16_t *)bufferPtr) = *((uint16 *)stripPtr);
-
-                                    stripPtr += 2;
-                                    bufferPtr += 2 * channels;
-                                }
-                                else if (bytesPerChannel == 1)
-                                {
-                                    *bufferPtr = *stripPtr;
-                                    stripPtr += 1;
-                                    bufferPtr += 1 * channels;
-                                }
-                            }
-                            row++;
+                            *bufferPtr = *stripPtr;
+                            stripPtr += 1;
+                            bufferPtr += 1;
                         }
                     }
-                }
-            done:;
-            }
 
-            if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != decodeFormat)
-            {
-                int32_t err = AImgConvertFormat(destBuffer, realDestBuffer, width, height, decodeFormat, forceImageFormat);
-                if (err != AImgErrorCode::AIMG_SUCCESS)
-                    return err;
+                    // convert from YCbCr to RGB (jpeg tiffs always have bytesPerChannel == 1 and PLANARCONFIG_CONTIG, and always have three channels)
+                    if (compression == COMPRESSION_JPEG)
+                    {
+                        float Y = bufferPtr[-3];
+                        float Cb = bufferPtr[-2];
+                        float Cr = bufferPtr[-1];
+
+                        bufferPtr[-3] = (char)std::max(std::min(Y + 1.40200 * (Cr - 127.0), 255.0), 0.0);
+                        bufferPtr[-2] = (char)std::max(std::min(Y - 0.34414 * (Cb - 127.0) - 0.71414 * (Cr - 127.0), 255.0), 0.0);
+                        bufferPtr[-1] = (char)std::max(std::min(Y + 1.77200 * (Cb - 127.0), 255.0), 0.0);
+                    }
+
+                    bufferPtr += bufferSkip;
+                }
             }
 
             return AImgErrorCode::AIMG_SUCCESS;
         }
 
-        virtual int32_t openImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData)
+        virtual int32_t openImage(ReadCallback64 readCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void *callbackData)
         {
             callbacks.mReadCallback = readCallback;
             callbacks.mSeekCallback = seekCallback;
@@ -451,6 +459,14 @@ namespace AImg
             callbacks.callbackData = callbackData;
             callbacks.startPos = tellCallback(callbackData);
 
+            const uint8_t *inMemoryData = nullptr;
+            int64_t inMemorySize = 0;
+            if (getInMemoryData(readCallback, callbackData, &inMemoryData, &inMemorySize) && callbacks.startPos <= inMemorySize)
+            {
+                callbacks.inMemoryData = inMemoryData + callbacks.startPos;
+                callbacks.inMemorySize = inMemorySize - callbacks.startPos;
+            }
+
             tiff = TIFFClientOpen("", "r", (thandle_t)&callbacks, tiffRead, tiff_Write, tiff_Seek, tiff_Close, tiff_Size, tiff_Map, tiff_Unmap);
 
             if (tiff == nullptr)
@@ -556,7 +572,7 @@ namespace AImg
         }
 
         int32_t writeImage(void *data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat, const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
-            WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData, void *encodingOptions)
+            WriteCallback64 writeCallback, TellCallback64 tellCallback, SeekCallback64 seekCallback, void *callbackData, void *encodingOptions)
         {
             // Suppress unused warning
             (void)profileName;
@@ -585,16 +601,16 @@ namespace AImg
                 AIGetFormatDetails(wFormat, &numChannels, &bytesPerChannel, &floatOrInt);
 
                 // Convert
-                std::vector<uint8_t> convertBuffer(0);
+                ScratchBuffer convertBuffer(mScratch, Scratch::CONVERT);
                 if (wFormat != inputFormat)
                 {
-                    convertBuffer.resize(width * height * numChannels * bytesPerChannel);
+                    convertBuffer.resize((size_t)width * height * numChannels * bytesPerChannel);
 
-                    int32_t convertError = AImgConvertFormat(data, &convertBuffer[0], width, height, inputFormat, wFormat);
+                    int32_t convertError = AImgConvertFormat(data, convertBuffer.data(), width, height, inputFormat, wFormat);
 
                     if (convertError != AImgErrorCode::AIMG_SUCCESS)
                         return convertError;
-                    data = &convertBuffer[0];
+                    data = convertBuffer.data();
                 }
 
                 TIFFSetField(wTiff, TIFFTAG_IMAGEWIDTH, width);
@@ -659,19 +675,144 @@ namespace AImg
         return AImgErrorCode::AIMG_SUCCESS;
     }
 
-    bool TIFFImageLoader::canLoadImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData)
+    bool TIFFImageLoader::canLoadImage(const uint8_t *header, int32_t headerSize)
     {
-        int32_t startingPos = tellCallback(callbackData);
-
-        std::vector<uint8_t> header(4);
-        readCallback(callbackData, &header[0], 4);
-
-        seekCallback(callbackData, startingPos);
+        if (headerSize < 4)
+            return false;
 
         return (header[0] == 0x49 && header[1] == 0x49 && header[2] == 0x2a && header[3] == 0x00) ||
             (header[0] == 0x4d && header[1] == 0x4d && header[2] == 0x00 && header[3] == 0x2a);
     }
 
+    static bool readTiffU16(ProbeReader& reader, bool bigEndian, int64_t offset, uint16_t* value)
+    {
+        return bigEndian ? reader.readU16BE(offset, value) : reader.readU16LE(offset, value);
+    }
+
+    static bool readTiffU32(ProbeReader& reader, bool bigEndian, int64_t offset, uint32_t* value)
+    {
+        return bigEndian ? reader.readU32BE(offset, value) : reader.readU32LE(offset, value);
+    }
+
+    // Reads the first value of a SHORT or LONG directory entry, from the entry itself or from wherever it points if the
+    // values don't fit in it
+    static bool readTiffEntryValue(ProbeReader& reader, bool bigEndian, int64_t entryOffset, uint32_t* value)
+    {
+        uint16_t type;
+        uint32_t count;
+        if (!readTiffU16(reader, bigEndian, entryOffset + 2, &type) ||
+            !readTiffU32(reader, bigEndian, entryOffset + 4, &count) || count == 0)
+            return false;
+
+        int64_t valueOffset = entryOffset + 8;
+
+        if (type == TIFF_SHORT)
+        {
+            if (count > 2)
+            {
+                uint32_t pointer;
+                if (!readTiffU32(reader, bigEndian, valueOffset, &pointer))
+                    return false;
+                valueOffset = pointer;
+            }
+
+            uint16_t shortValue;
+            if (!readTiffU16(reader, bigEndian, valueOffset, &shortValue))
+                return false;
+
+            *value = shortValue;
+            return true;
+        }
+
+        if (type == TIFF_LONG)
+        {
+            if (count > 1)
+            {
+                uint32_t pointer;
+                if (!readTiffU32(reader, bigEndian, valueOffset, &pointer))
+                    return false;
+                valueOffset = pointer;
+            }
+
+            return readTiffU32(reader, bigEndian, valueOffset, value);
+        }
+
+        return false;
+    }
+
+    int32_t TIFFImageLoader::probeImage(ProbeReader& reader, AImgProbeInfo* info)
+    {
+        uint8_t byteOrder;
+        if (!reader.readU8(0, &byteOrder))
+            return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+        bool bigEndian = byteOrder == 0x4d; // "MM", otherwise it's "II"
+
+        uint32_t directoryOffset;
+        uint16_t numEntries;
+        if (!readTiffU32(reader, bigEndian, 4, &directoryOffset) ||
+            !readTiffU16(reader, bigEndian, directoryOffset, &numEntries))
+            return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+
+        // libtiff's defaults for the tags that can be left out
+        uint32_t width = 0, height = 0, bitsPerChannel = 1, channels = 1, sampleFormat = SAMPLEFORMAT_UINT, compression = COMPRESSION_NONE;
+        bool hasWidth = false, hasHeight = false, hasStripByteCounts = false;
+
+        for (uint16_t i = 0; i < numEntries; i++)
+        {
+            int64_t entryOffset = (int64_t)directoryOffset + 2 + i * 12;
+
+            uint16_t tag;
+            if (!readTiffU16(reader, bigEndian, entryOffset, &tag))
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+
+            bool ok = true;
+            switch (tag)
+            {
+            case TIFFTAG_IMAGEWIDTH:
+                ok = hasWidth = readTiffEntryValue(reader, bigEndian, entryOffset, &width);
+                break;
+            case TIFFTAG_IMAGELENGTH:
+                ok = hasHeight = readTiffEntryValue(reader, bigEndian, entryOffset, &height);
+                break;
+            case TIFFTAG_BITSPERSAMPLE:
+                ok = readTiffEntryValue(reader, bigEndian, entryOffset, &bitsPerChannel);
+                break;
+            case TIFFTAG_SAMPLESPERPIXEL:
+                ok = readTiffEntryValue(reader, bigEndian, entryOffset, &channels);
+                break;
+            case TIFFTAG_SAMPLEFORMAT:
+                ok = readTiffEntryValue(reader, bigEndian, entryOffset, &sampleFormat);
+                break;
+            case TIFFTAG_COMPRESSION:
+                ok = readTiffEntryValue(reader, bigEndian, entryOffset, &compression);
+                break;
+            case TIFFTAG_STRIPBYTECOUNTS:
+                hasStripByteCounts = true;
+                break;
+            }
+
+            if (!ok)
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+        }
+
+        // the same checks as TiffFile::openImage
+        if (!hasWidth || !hasHeight || !hasStripByteCounts || compression == COMPRESSION_JPEG)
+            return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+
+        int32_t format = getTiffDecodeFormat(channels, bitsPerChannel, sampleFormat);
+        if (bitsPerChannel % 8 != 0 || compression == COMPRESSION_OJPEG || format == AImgFormat::INVALID_FORMAT)
+            return AImgErrorCode::AIMG_LOAD_FAILED_UNSUPPORTED_TIFF;
+
+        info->width = (int32_t)width;
+        info->height = (int32_t)height;
+        info->numChannels = (int32_t)channels;
+        info->bytesPerChannel = bitsPerChannel / 8;
+        info->floatOrInt = sampleFormat == SAMPLEFORMAT_IEEEFP ? AImgFloatOrIntType::FITYPE_FLOAT : AImgFloatOrIntType::FITYPE_INT;
+        info->decodedImgFormat = format;
+
+        return AImgErrorCode::AIMG_SUCCESS;
+    }
+
     std::string TIFFImageLoader::getFileExtension()
     {
         return "tiff";
@@ -0,0 +1,22 @@
+#include "AIL.h"
+#include "trace.h"
+
+namespace AImg
+{
+    AImgTraceBeginCallback traceBegin = NULL;
+    AImgTraceEndCallback traceEnd = NULL;
+    void* traceUserData = NULL;
+}
+
+int32_t AImgSetTraceHooks(AImgTraceBeginCallback begin, AImgTraceEndCallback end, void* userData)
+{
+    // one without the other would leave stages unbalanced
+    if ((begin == NULL) != (end == NULL))
+        return AImgErrorCode::AIMG_INVALID_ARGS;
+
+    AImg::traceBegin = begin;
+    AImg::traceEnd = end;
+    AImg::traceUserData = userData;
+
+    return AImgErrorCode::AIMG_SUCCESS;
+}
@@ -0,0 +1,48 @@
+#ifndef ARTOMATIX_TRACE_H
+#define ARTOMATIX_TRACE_H
+
+#include "AIL.h"
+
+namespace AImg
+{
+    // The stage names documented with AImgSetTraceHooks. Integrations match on these, so they mustn't change.
+    const char* const TRACE_OPEN = "aimg.open";
+    const char* const TRACE_OPEN_DETECT = "aimg.open.detect";
+    const char* const TRACE_OPEN_HEADER = "aimg.open.header";
+    const char* const TRACE_DECODE = "aimg.decode";
+    const char* const TRACE_DECODE_ROWS = "aimg.decode.rows";
+    const char* const TRACE_DECODE_REGION = "aimg.decode.region";
+    const char* const TRACE_DECODE_BLOCK = "aimg.decode.block";
+    const char* const TRACE_CONVERT = "aimg.convert";
+    const char* const TRACE_ENCODE = "aimg.encode";
+
+    // Set by AImgSetTraceHooks, both NULL when tracing is off
+    extern AImgTraceBeginCallback traceBegin;
+    extern AImgTraceEndCallback traceEnd;
+    extern void* traceUserData;
+
+    // Traces a stage for as long as it lives. When tracing is off this is just a NULL check.
+    class TraceScope
+    {
+    public:
+        explicit TraceScope(const char* stage) : mStage(traceBegin != NULL ? stage : NULL)
+        {
+            if (mStage != NULL)
+                traceBegin(traceUserData, mStage);
+        }
+
+        ~TraceScope()
+        {
+            if (mStage != NULL)
+                traceEnd(traceUserData, mStage);
+        }
+
+    private:
+        TraceScope(const TraceScope&);
+        TraceScope& operator=(const TraceScope&);
+
+        const char* mStage;
+    };
+}
+
+#endif // ARTOMATIX_TRACE_H